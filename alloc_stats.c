@@ -0,0 +1,253 @@
+/* alloc_stats.c: counted wrappers for the compiler's heap allocations */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "alloc_stats.h"
+#include "ast.h"
+#include "utilities.h"
+
+// The number of categories
+#define ALLOC_CATEGORY_COUNT ALLOC_AST_CATEGORY(AST_TYPE_COUNT)
+
+static atomic_ulong total_count;
+static atomic_ulong total_bytes;
+
+// The tracked allocations of a category
+typedef struct {
+    atomic_ulong count;
+    atomic_ulong bytes;
+    atomic_ulong live;  // bytes allocated but not yet freed
+    atomic_ulong peak;  // the largest value live has had
+} category_stats;
+
+static bool tracking = false;
+static category_stats categories[ALLOC_CATEGORY_COUNT];
+static category_stats all;  // the sums for all categories
+
+// When tracking, each allocation starts with a header
+// (aligned so that the memory after it is suitably aligned for anything)
+typedef union {
+    struct {
+	size_t size;
+	alloc_category cat;
+    } h;
+    max_align_t align;
+} alloc_header;
+
+static const char *subsystem_names[ALLOC_SUBSYSTEM_COUNT] = {
+    "other", "token text", "file_location",
+    "scope", "scope_assoc", "id_attrs", "id_use",
+    "lexical_address", "traversal stack", "output", "flat_ast",
+    "task_pool", "diagnostics", "arena", "pipeline"
+};
+
+// Return the name of the category cat
+static const char *category_name(alloc_category cat)
+{
+    if (cat < ALLOC_SUBSYSTEM_COUNT) {
+	return subsystem_names[cat];
+    }
+    return ast_type_name((AST_type) (cat - ALLOC_SUBSYSTEM_COUNT));
+}
+
+// Count one allocation of size bytes
+static void count(size_t size)
+{
+    atomic_fetch_add_explicit(&total_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total_bytes, size, memory_order_relaxed);
+}
+
+// Add delta (which may be "negative") to s's live bytes,
+// counting it as an allocation of size bytes if allocated is true
+static void track(category_stats *s, unsigned long delta, size_t size,
+		  bool allocated)
+{
+    if (allocated) {
+	atomic_fetch_add_explicit(&s->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->bytes, size, memory_order_relaxed);
+    }
+    unsigned long live =
+	atomic_fetch_add_explicit(&s->live, delta, memory_order_relaxed)
+	+ delta;
+    unsigned long peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+    while (live > peak
+	   && !atomic_compare_exchange_weak_explicit(&s->peak, &peak, live,
+						     memory_order_relaxed,
+						     memory_order_relaxed)) {
+	// peak has been reloaded, try again
+    }
+}
+
+// Requires: cat < ALLOC_CATEGORY_COUNT
+// Track the change of an allocation of cat from old_size to new_size bytes
+// (old_size is 0 for a new allocation, new_size is 0 for a free)
+static void track_sizes(alloc_category cat, size_t old_size, size_t new_size)
+{
+    unsigned long delta = (unsigned long) new_size - (unsigned long) old_size;
+    bool allocated = (new_size != 0);
+    track(&categories[cat], delta, new_size, allocated);
+    track(&all, delta, new_size, allocated);
+}
+
+// Return the header of the tracked allocation p
+static alloc_header *header_of(void *p)
+{
+    return ((alloc_header *) p) - 1;
+}
+
+// Like realloc(p, size), for the category cat
+void *alloc_realloc_in(alloc_category cat, void *p, size_t size)
+{
+    count(size);
+    if (!tracking) {
+	return realloc(p, size);
+    }
+    size_t old_size = 0;
+    void *old_block = NULL;
+    if (p != NULL) {
+	alloc_header *hdr = header_of(p);
+	old_size = hdr->h.size;
+	cat = hdr->h.cat;
+	old_block = hdr;
+    }
+    if (cat >= ALLOC_CATEGORY_COUNT) {
+	bail_with_error("Bad allocation category (%u)!", cat);
+    }
+    alloc_header *hdr =
+	(alloc_header *) realloc(old_block, sizeof(alloc_header) + size);
+    if (hdr == NULL) {
+	return NULL;
+    }
+    hdr->h.size = size;
+    hdr->h.cat = cat;
+    track_sizes(cat, old_size, size);
+    return hdr + 1;
+}
+
+// Like malloc(size), for the category cat
+void *alloc_malloc_in(alloc_category cat, size_t size)
+{
+    if (!tracking) {
+	count(size);
+	return malloc(size);
+    }
+    return alloc_realloc_in(cat, NULL, size);
+}
+
+// Like calloc(n, size), for the category cat
+void *alloc_calloc_in(alloc_category cat, size_t n, size_t size)
+{
+    if (!tracking) {
+	count(n * size);
+	return calloc(n, size);
+    }
+    if (size != 0 && n > SIZE_MAX / size) {
+	return NULL;
+    }
+    void *ret = alloc_realloc_in(cat, NULL, n * size);
+    if (ret != NULL) {
+	memset(ret, 0, n * size);
+    }
+    return ret;
+}
+
+// Like strdup(s), for the category cat
+char *alloc_strdup_in(alloc_category cat, const char *s)
+{
+    size_t size = strlen(s) + 1;
+    char *ret = (char *) alloc_malloc_in(cat, size);
+    if (ret != NULL) {
+	memcpy(ret, s, size);
+    }
+    return ret;
+}
+
+// Like malloc(size), for the category alloc_other
+void *alloc_malloc(size_t size)
+{
+    return alloc_malloc_in(alloc_other, size);
+}
+
+// Like calloc(n, size), for the category alloc_other
+void *alloc_calloc(size_t n, size_t size)
+{
+    return alloc_calloc_in(alloc_other, n, size);
+}
+
+// Like realloc(p, size), for the category alloc_other
+void *alloc_realloc(void *p, size_t size)
+{
+    return alloc_realloc_in(alloc_other, p, size);
+}
+
+// Like strdup(s), for the category alloc_other
+char *alloc_strdup(const char *s)
+{
+    return alloc_strdup_in(alloc_other, s);
+}
+
+// Requires: p is NULL or was returned by one of the functions above
+// Like free(p)
+void alloc_free(void *p)
+{
+    if (!tracking || p == NULL) {
+	free(p);
+	return;
+    }
+    alloc_header *hdr = header_of(p);
+    track_sizes(hdr->h.cat, hdr->h.size, 0);
+    free(hdr);
+}
+
+// Return the counts of all allocations made so far
+alloc_counts alloc_stats_counts()
+{
+    alloc_counts ret;
+    ret.count = atomic_load_explicit(&total_count, memory_order_relaxed);
+    ret.bytes = atomic_load_explicit(&total_bytes, memory_order_relaxed);
+    return ret;
+}
+
+// Requires: nothing has been allocated through this module yet
+// Turn on tracking of each category's allocations (which
+// adds a small header to each allocation, so that frees can be tracked).
+void alloc_stats_track()
+{
+    if (alloc_stats_counts().count != 0) {
+	bail_with_error("Allocation tracking must start before any allocation!");
+    }
+    tracking = true;
+}
+
+// Is tracking on?
+bool alloc_stats_tracking()
+{
+    return tracking;
+}
+
+// Print one row of the report for s on out
+static void print_row(FILE *out, const char *name, category_stats *s)
+{
+    fprintf(out, "%-20s %10lu %12.1f %12.1f %12.1f\n", name,
+	    atomic_load_explicit(&s->count, memory_order_relaxed),
+	    atomic_load_explicit(&s->bytes, memory_order_relaxed) / 1024.0,
+	    atomic_load_explicit(&s->live, memory_order_relaxed) / 1024.0,
+	    atomic_load_explicit(&s->peak, memory_order_relaxed) / 1024.0);
+}
+
+// Requires: out != NULL
+// Print a table of the tracked bytes, counts and live bytes (at this point
+// and at their peak) of each category that allocated anything on out.
+void alloc_stats_report(FILE *out)
+{
+    fprintf(out, "%-20s %10s %12s %12s %12s\n",
+	    "allocated for", "allocs", "KB", "live KB", "peak live KB");
+    for (alloc_category cat = 0; cat < ALLOC_CATEGORY_COUNT; cat++) {
+	if (atomic_load_explicit(&categories[cat].count,
+				 memory_order_relaxed) != 0) {
+	    print_row(out, category_name(cat), &categories[cat]);
+	}
+    }
+    print_row(out, "total", &all);
+}
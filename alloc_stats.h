@@ -0,0 +1,88 @@
+/* alloc_stats.h: counted wrappers for the compiler's heap allocations */
+#ifndef _ALLOC_STATS_H
+#define _ALLOC_STATS_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The compiler's modules allocate through these functions (which behave
+// like the C library functions they are named after, returning NULL when
+// there is no space), so that the number of allocations and the bytes
+// requested can be reported (e.g., per compiler phase).
+// The counters may be updated by several threads at once.
+//
+// Each allocation is made for a category: either one of the subsystems
+// below, or (using ALLOC_AST_CATEGORY) an AST_type, for AST nodes and
+// the arrays of AST lists.  If tracking is turned on (see
+// alloc_stats_track), the bytes, counts and live bytes (current and peak)
+// of each category are kept, and can be printed with alloc_stats_report.
+
+// The subsystems that allocate memory
+typedef enum {
+    alloc_other, alloc_token_text, alloc_file_location,
+    alloc_scope, alloc_scope_assoc, alloc_id_attrs, alloc_id_use,
+    alloc_lexical_address, alloc_traversal, alloc_output, alloc_flat_ast,
+    alloc_task_pool, alloc_diagnostics, alloc_arena, alloc_pipeline
+} alloc_subsystem;
+
+// The number of alloc_subsystem values
+#define ALLOC_SUBSYSTEM_COUNT (alloc_pipeline + 1)
+
+// An alloc_subsystem or the result of ALLOC_AST_CATEGORY
+typedef unsigned int alloc_category;
+
+// The category for the AST_type t
+#define ALLOC_AST_CATEGORY(t) (ALLOC_SUBSYSTEM_COUNT + (alloc_category) (t))
+
+// Counts of the allocations made so far
+typedef struct {
+    unsigned long count;  // calls to alloc_malloc, alloc_calloc, etc.
+    unsigned long bytes;  // bytes requested by those calls
+} alloc_counts;
+
+// Like malloc(size), for the category cat
+extern void *alloc_malloc_in(alloc_category cat, size_t size);
+
+// Like calloc(n, size), for the category cat
+extern void *alloc_calloc_in(alloc_category cat, size_t n, size_t size);
+
+// Like realloc(p, size), for the category cat
+// (which should be the category p was allocated for, if p != NULL)
+extern void *alloc_realloc_in(alloc_category cat, void *p, size_t size);
+
+// Like strdup(s), for the category cat
+extern char *alloc_strdup_in(alloc_category cat, const char *s);
+
+// Like malloc(size), for the category alloc_other
+extern void *alloc_malloc(size_t size);
+
+// Like calloc(n, size), for the category alloc_other
+extern void *alloc_calloc(size_t n, size_t size);
+
+// Like realloc(p, size), for the category alloc_other
+extern void *alloc_realloc(void *p, size_t size);
+
+// Like strdup(s), for the category alloc_other
+extern char *alloc_strdup(const char *s);
+
+// Requires: p is NULL or was returned by one of the functions above
+// Like free(p)
+extern void alloc_free(void *p);
+
+// Return the counts of all allocations made so far
+extern alloc_counts alloc_stats_counts();
+
+// Requires: nothing has been allocated through this module yet
+// Turn on tracking of each category's allocations (which
+// adds a small header to each allocation, so that frees can be tracked).
+extern void alloc_stats_track();
+
+// Is tracking on?
+extern bool alloc_stats_tracking();
+
+// Requires: out != NULL
+// Print a table of the tracked bytes, counts and live bytes (at this point
+// and at their peak) of each category that allocated anything on out.
+extern void alloc_stats_report(FILE *out);
+
+#endif
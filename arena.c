@@ -0,0 +1,122 @@
+/* arena.c: region-based allocation, so a whole region can be freed at once */
+#include <string.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "utilities.h"
+
+// Size of the usual chunk (larger requests get a chunk of their own)
+#define CHUNK_SIZE (64 * 1024)
+
+// Every allocation is aligned suitably for anything
+#define ALIGNMENT (alignof(max_align_t))
+
+typedef struct {
+    char *data;
+    size_t size;
+} chunk;
+
+static bool enabled = false;
+// chunks[0 .. count-1] are allocated, and chunks[count-1] is the current one
+static chunk *chunks = NULL;
+static unsigned int count = 0;
+static unsigned int capacity = 0;
+static size_t used = 0;  // bytes of the current chunk in use
+
+// Turn on arenas (before anything is allocated from them)
+void arena_enable()
+{
+    enabled = true;
+}
+
+// Are arenas on?
+bool arena_enabled()
+{
+    return enabled;
+}
+
+// Start a new current chunk with room for at least size bytes
+static void new_chunk(size_t size)
+{
+    if (count == capacity) {
+	capacity = (capacity == 0) ? 16 : 2 * capacity;
+	chunks = (chunk *) alloc_realloc_in(alloc_arena, chunks,
+					    capacity * sizeof(chunk));
+	if (chunks == NULL) {
+	    bail_with_error("Unable to allocate space for the arena's chunks!");
+	}
+    }
+    size_t chunk_size = (size > CHUNK_SIZE) ? size : CHUNK_SIZE;
+    chunks[count].data = (char *) alloc_malloc_in(alloc_arena, chunk_size);
+    if (chunks[count].data == NULL) {
+	bail_with_error("Unable to allocate space for an arena chunk!");
+    }
+    chunks[count].size = chunk_size;
+    count++;
+    used = 0;
+}
+
+// Like alloc_malloc_in(cat, size), but from the arena if that is on
+// (cat is only used when arenas are off)
+void *arena_alloc(alloc_category cat, size_t size)
+{
+    if (!enabled) {
+	return alloc_malloc_in(cat, size);
+    }
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (count == 0 || chunks[count - 1].size - used < size) {
+	new_chunk(size);
+    }
+    void *ret = chunks[count - 1].data + used;
+    used += size;
+    return ret;
+}
+
+// Requires: p is NULL or was allocated by arena_alloc (or arena_realloc)
+//           with room for old_size bytes
+// Like alloc_realloc_in(cat, p, new_size), but from the arena if that is on
+void *arena_realloc(alloc_category cat, void *p, size_t old_size,
+		    size_t new_size)
+{
+    if (!enabled) {
+	return alloc_realloc_in(cat, p, new_size);
+    }
+    // the old space is only reclaimed when its region is released
+    void *ret = arena_alloc(cat, new_size);
+    if (p != NULL) {
+	memcpy(ret, p, (old_size < new_size) ? old_size : new_size);
+    }
+    return ret;
+}
+
+// Requires: s != NULL
+// Like alloc_strdup_in(cat, s), but from the arena if that is on
+char *arena_strdup(alloc_category cat, const char *s)
+{
+    if (!enabled) {
+	return alloc_strdup_in(cat, s);
+    }
+    size_t len = strlen(s) + 1;
+    char *ret = (char *) arena_alloc(cat, len);
+    memcpy(ret, s, len);
+    return ret;
+}
+
+// Return the current position in the arena
+arena_mark arena_get_mark()
+{
+    arena_mark ret;
+    ret.chunk = count;  // so the current chunk is kept, but newer ones freed
+    ret.used = used;
+    return ret;
+}
+
+// Requires: m was returned by arena_get_mark, and nothing allocated
+//           since then is still in use
+// Free everything allocated from the arena since m
+void arena_release(arena_mark m)
+{
+    while (count > m.chunk) {
+	alloc_free(chunks[--count].data);
+    }
+    used = m.used;
+}
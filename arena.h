@@ -0,0 +1,49 @@
+/* arena.h: region-based allocation, so a whole region can be freed at once */
+#ifndef _ARENA_H
+#define _ARENA_H
+#include <stddef.h>
+#include <stdbool.h>
+#include "alloc_stats.h"
+
+// When arenas are on (see arena_enable), the AST's nodes, lists,
+// file locations and token text are allocated from a stack of large
+// chunks, and arena_release frees everything allocated since a mark.
+// When they are off, the functions below are like the functions
+// of alloc_stats.h and arena_release does nothing.
+// (Memory allocated here must not be passed to alloc_free.)
+
+// A position in the arena, see arena_get_mark
+typedef struct {
+    unsigned int chunk;  // index of the chunk being allocated from
+    size_t used;         // bytes of that chunk already used
+} arena_mark;
+
+// Turn on arenas (before anything is allocated from them)
+extern void arena_enable();
+
+// Are arenas on?
+extern bool arena_enabled();
+
+// Like alloc_malloc_in(cat, size), but from the arena if that is on
+// (cat is only used when arenas are off)
+extern void *arena_alloc(alloc_category cat, size_t size);
+
+// Requires: p is NULL or was allocated by arena_alloc (or arena_realloc)
+//           with room for old_size bytes
+// Like alloc_realloc_in(cat, p, new_size), but from the arena if that is on
+extern void *arena_realloc(alloc_category cat, void *p, size_t old_size,
+			   size_t new_size);
+
+// Requires: s != NULL
+// Like alloc_strdup_in(cat, s), but from the arena if that is on
+extern char *arena_strdup(alloc_category cat, const char *s);
+
+// Return the current position in the arena
+extern arena_mark arena_get_mark();
+
+// Requires: m was returned by arena_get_mark, and nothing allocated
+//           since then is still in use
+// Free everything allocated from the arena since m
+extern void arena_release(arena_mark m);
+
+#endif
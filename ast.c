@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <stdlib.h>
 #include "utilities.h"
+#include "alloc_stats.h"
+#include "arena.h"
 #include "ast.h"
 #include "spl.tab.h"
 
@@ -26,10 +28,29 @@ AST_type ast_type_tag(AST t) {
     return t.generic.type_tag;
 }
 
+// Requires: t is an AST_type
+// Return the name of t (e.g., "block_ast")
+const char *ast_type_name(AST_type t) {
+    static const char *names[AST_TYPE_COUNT] = {
+	"block_ast", "const_decls_ast", "const_decl_ast",
+	"const_def_list_ast", "const_def_ast",
+	"var_decls_ast", "var_decl_ast", "ident_list_ast",
+	"proc_decls_ast", "proc_decl_ast",
+	"stmts_ast", "empty_ast", "stmt_list_ast", "stmt_ast",
+	"assign_stmt_ast", "call_stmt_ast", "if_stmt_ast", "while_stmt_ast",
+	"read_stmt_ast", "print_stmt_ast", "block_stmt_ast",
+	"condition_ast", "db_condition_ast", "rel_op_condition_ast",
+	"expr_ast", "binary_op_expr_ast", "negated_expr_ast", "ident_ast",
+	"number_ast", "token_ast"
+    };
+    return names[t];
+}
+
 // Return a pointer to a fresh copy of t
 // that has been allocated on the heap
 AST *ast_heap_copy(AST t) {
-    AST *ret = (AST *)malloc(sizeof(AST));
+    AST *ret = (AST *)arena_alloc(ALLOC_AST_CATEGORY(ast_type_tag(t)),
+				  sizeof(AST));
     if (ret == NULL) {
 	bail_with_error("Cannot allocate an AST heap copy!");
     }
@@ -58,7 +79,9 @@ extern const_decls_t ast_const_decls_empty(empty_t empty)
     const_decls_t ret;
     ret.file_loc = empty.file_loc;
     ret.type_tag = const_decls_ast;
-    ret.start = NULL;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
     return ret;
 }
 
@@ -67,19 +90,9 @@ const_decls_t ast_const_decls(const_decls_t const_decls,
 			      const_decl_t const_decl)
 {
     const_decls_t ret = const_decls;
-    // make a copy of const_decl on the heap
-    const_decl_t *p = (const_decl_t *) malloc(sizeof(const_decl_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "const_decl_t");
-    }
-    *p = const_decl;
-    p->next = NULL;
-    const_decl_t *last = ast_last_list_elem(ret.start);
-    if (last == NULL) {
-	ret.start = p;
-    } else {
-	last->next = p;
-    }
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(const_decls_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(const_decl_t));
+    ret.elems[ret.count++] = const_decl;
     return ret;
 }
 
@@ -92,7 +105,6 @@ const_decl_t ast_const_decl(const_def_list_t const_def_list)
     ret.file_loc = const_def_list.file_loc;
     ret.type_tag = const_decl_ast;
     ret.const_def_list = const_def_list;
-    ret.next = NULL;
     return ret;
 }
 
@@ -102,14 +114,10 @@ extern const_def_list_t ast_const_def_list_singleton(const_def_t const_def)
     const_def_list_t ret;
     ret.file_loc = const_def.file_loc;
     ret.type_tag = const_def_list_ast;
-    const_def_t *p = (const_def_t *) malloc(sizeof(const_def_t));
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "const_def_t"); 
-    }		    
-    *p = const_def;		
-    p->next = NULL;    
-    ret.start = p;							
-    return ret;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
+    return ast_const_def_list(ret, const_def);
 }
 
 // Return an AST for const_defs
@@ -117,19 +125,9 @@ extern const_def_list_t ast_const_def_list(const_def_list_t const_def_list,
 				           const_def_t const_def)
 {
     const_def_list_t ret = const_def_list;
-    // make a copy of const_def on the heap
-    const_def_t *p = (const_def_t *) malloc(sizeof(const_def_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "const_def_t");
-    }
-    *p = const_def;
-    p->next = NULL;
-    const_def_t *last = ast_last_list_elem(ret.start);
-    if (last == NULL) {
-	ret.start = p;
-    } else {
-	last->next = p;
-    }
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(const_def_list_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(const_def_t));
+    ret.elems[ret.count++] = const_def;
     return ret;
 }
 
@@ -140,7 +138,6 @@ const_def_t ast_const_def(ident_t ident, number_t number)
     ret.file_loc = file_location_copy(ident.file_loc);
     assert((ret.file_loc)->filename != NULL);
     ret.type_tag = const_def_ast;
-    ret.next = NULL;
     ret.ident = ident;
     ret.number = number;
     return ret;
@@ -153,7 +150,9 @@ var_decls_t ast_var_decls_empty(empty_t empty)
     var_decls_t ret;
     ret.file_loc = empty.file_loc;
     ret.type_tag = var_decls_ast;
-    ret.var_decls = NULL;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
     return ret;
 }
 
@@ -161,19 +160,9 @@ var_decls_t ast_var_decls_empty(empty_t empty)
 var_decls_t ast_var_decls(var_decls_t var_decls, var_decl_t var_decl)
 {
     var_decls_t ret = var_decls;
-    // make a copy of var_decl on the heap
-    var_decl_t *p = (var_decl_t *) malloc(sizeof(var_decl_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "var_decl_t");
-    }
-    *p = var_decl;
-    p->next = NULL;
-    var_decl_t *last = ast_last_list_elem(ret.var_decls);
-    if (last == NULL) {
-	ret.var_decls = p;
-    } else {
-	last->next = p;
-    }
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(var_decls_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(var_decl_t));
+    ret.elems[ret.count++] = var_decl;
     return ret;
 }
 
@@ -183,7 +172,6 @@ var_decl_t ast_var_decl(ident_list_t ident_list)
     var_decl_t ret;
     ret.file_loc = ident_list.file_loc;
     ret.type_tag = var_decl_ast;
-    ret.next = NULL;
     ret.ident_list = ident_list;
     return ret;
 }
@@ -194,34 +182,19 @@ extern ident_list_t ast_ident_list_singleton(ident_t ident)
     ident_list_t ret;
     ret.file_loc = ident.file_loc;
     ret.type_tag = ident_list_ast;
-    // make a copy of ident on the heap
-    ident_t *p = (ident_t *) malloc(sizeof(ident_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "ident_t"); 
-    }		    
-    *p = ident;		
-    p->next = NULL;    
-    ret.start = p;						
-    return ret;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
+    return ast_ident_list(ret, ident);
 }
 
 // Return an AST made for idents
 extern ident_list_t ast_ident_list(ident_list_t ident_list, ident_t ident)
 {
     ident_list_t ret = ident_list;
-    // make a copy of ident on the heap
-    ident_t *p = (ident_t *) malloc(sizeof(ident_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "ident_t");
-    }
-    *p = ident;
-    p->next = NULL;
-    ident_t *last = ast_last_list_elem(ret.start);
-    if (last == NULL) {
-	ret.start = p;
-    } else {
-	last->next = p;
-    }
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(ident_list_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(ident_t));
+    ret.elems[ret.count++] = ident;
     return ret;
 }
 
@@ -231,7 +204,9 @@ proc_decls_t ast_proc_decls_empty(empty_t empty)
     proc_decls_t ret;
     ret.file_loc = empty.file_loc;
     ret.type_tag = proc_decls_ast;
-    ret.proc_decls = NULL;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
     return ret;
 }
 
@@ -240,19 +215,9 @@ proc_decls_t ast_proc_decls(proc_decls_t proc_decls,
 			    proc_decl_t proc_decl)
 {
     proc_decls_t ret = proc_decls;
-    // make a copy of proc_decl on the heap
-    proc_decl_t *p = (proc_decl_t *) malloc(sizeof(proc_decl_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "proc_decl_t"); 
-    }		    
-    *p = proc_decl;		
-    p->next = NULL;    
-    proc_decl_t *last = ast_last_list_elem(ret.proc_decls);
-    if (last == NULL) {
-	ret.proc_decls = p;
-    } else {
-	last->next = p;
-    }
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(proc_decls_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(proc_decl_t));
+    ret.elems[ret.count++] = proc_decl;
     return ret;
 }
 
@@ -262,14 +227,30 @@ proc_decl_t ast_proc_decl(ident_t ident, block_t block)
     proc_decl_t ret;
     ret.file_loc = file_location_copy(ident.file_loc);
     ret.type_tag = proc_decl_ast;
-    ret.next = NULL;
     ret.name = ident.name;
-    block_t *p = (block_t *) malloc(sizeof(block_t));
+    ret.hash = ident.hash;
+    block_t *p = (block_t *) arena_alloc(ALLOC_AST_CATEGORY(block_ast),
+					 sizeof(block_t));
     if (p == NULL) {
 	bail_with_error("Unable to allocate space for a %s!", "block_t");
     }
     *p = block;
     ret.block = p;
+    memset(&ret.cache_digest, 0, sizeof(ret.cache_digest));
+    return ret;
+}
+
+// Return an AST for a proc_decl whose block is not kept
+// (because it was streamed, see ast_stream.h), so its block is NULL
+proc_decl_t ast_proc_decl_without_block(ident_t ident)
+{
+    proc_decl_t ret;
+    ret.file_loc = file_location_copy(ident.file_loc);
+    ret.type_tag = proc_decl_ast;
+    ret.name = ident.name;
+    ret.hash = ident.hash;
+    ret.block = NULL;
+    memset(&ret.cache_digest, 0, sizeof(ret.cache_digest));
     return ret;
 }
 
@@ -288,6 +269,7 @@ read_stmt_t ast_read_stmt(ident_t ident) {
     ret.file_loc = file_location_copy(ident.file_loc);
     ret.type_tag = read_stmt_ast;
     ret.name = ident.name;
+    ret.hash = ident.hash;
     return ret;
 }
 
@@ -297,7 +279,8 @@ while_stmt_t ast_while_stmt(condition_t condition, stmts_t body) {
     ret.file_loc = condition.file_loc;
     ret.type_tag = while_stmt_ast;
     ret.condition = condition;
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));
+    stmts_t *p = (stmts_t *) arena_alloc(ALLOC_AST_CATEGORY(stmts_ast),
+					 sizeof(stmts_t));
     if (p == NULL) {
 	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
     }
@@ -315,14 +298,16 @@ if_stmt_t ast_if_then_else_stmt(condition_t condition,
     ret.type_tag = if_stmt_ast;
     ret.condition = condition;
     // copy then_stmt to the heap
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));			
+    stmts_t *p = (stmts_t *) arena_alloc(ALLOC_AST_CATEGORY(stmts_ast),
+					 sizeof(stmts_t));			
     if (p == NULL) {							
 	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
     }									
     *p = then_stmts;	
     ret.then_stmts = p;						
     // copy else_stmts to the heap
-    p = (stmts_t *) malloc(sizeof(stmts_t));	
+    p = (stmts_t *) arena_alloc(ALLOC_AST_CATEGORY(stmts_ast),
+				sizeof(stmts_t));	
     if (p == NULL) {							
 	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
     }		    
@@ -340,7 +325,8 @@ extern if_stmt_t ast_if_then_stmt(condition_t condition,
     ret.type_tag = if_stmt_ast;
     ret.condition = condition;
     // copy then_stmt to the heap
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));			
+    stmts_t *p = (stmts_t *) arena_alloc(ALLOC_AST_CATEGORY(stmts_ast),
+					 sizeof(stmts_t));			
     if (p == NULL) {							
 	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
     }									
@@ -358,7 +344,8 @@ block_stmt_t ast_block_stmt(block_t block)
     ret.file_loc = block.file_loc;
     ret.type_tag = block_stmt_ast;
     // copy the block to the heap
-    block_t *p = (block_t *) malloc(sizeof(block_t));			
+    block_t *p = (block_t *) arena_alloc(ALLOC_AST_CATEGORY(block_ast),
+					 sizeof(block_t));			
     if (p == NULL) {							
 	bail_with_error("Unable to allocate space for a %s!", "block_t"); 
     }									
@@ -374,6 +361,7 @@ block_stmt_t ast_block_stmt(block_t block)
     ret.file_loc = file_location_copy(ident.file_loc);
     ret.type_tag = call_stmt_ast;
     ret.name = ident.name;
+    ret.hash = ident.hash;
     return ret;
 }
 
@@ -384,8 +372,10 @@ assign_stmt_t ast_assign_stmt(ident_t ident, expr_t expr)
     ret.file_loc = file_location_copy(ident.file_loc);
     ret.type_tag = assign_stmt_ast;
     ret.name = ident.name;
+    ret.hash = ident.hash;
     assert(ret.name != NULL);
-    expr_t *p = (expr_t *) malloc(sizeof(expr_t));
+    expr_t *p = (expr_t *) arena_alloc(ALLOC_AST_CATEGORY(expr_ast),
+				       sizeof(expr_t));
     if (p == NULL) {
 	bail_with_error("Unable to allocate space for a %s!", "expr_t");
     }
@@ -428,37 +418,34 @@ stmts_t ast_stmts(stmt_list_t stmt_list)
 
 // Return an AST for the list of statements 
 stmt_list_t ast_stmt_list_singleton(stmt_t stmt) {
-    // debug_print("Entering ast_stmts_singleton\n");
     stmt_list_t ret;
     ret.file_loc = stmt.file_loc;
     ret.type_tag = stmt_list_ast;
-    stmt.next = NULL;
-    // copy stmt to the heap
-    stmt_t *p = (stmt_t *) malloc(sizeof(stmt_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "stmt_t"); 
-    }		    
-    *p = stmt;
-    p->next = NULL;
-    // there will be no statments after stmt in the list
-    ret.start = p;					
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
+    return ast_stmt_list(ret, stmt);
+}
+
+// Return an AST for a list of no statements found at empty's location
+// (which stands for statements with syntax errors, see spl.y)
+stmt_list_t ast_stmt_list_empty(empty_t empty)
+{
+    stmt_list_t ret;
+    ret.file_loc = file_location_copy(empty.file_loc);
+    ret.type_tag = stmt_list_ast;
+    ret.count = 0;
+    ret.capacity = 0;
+    ret.elems = NULL;
     return ret;
 }
 
 // Return an AST for the list of statements 
 extern stmt_list_t ast_stmt_list(stmt_list_t stmt_list, stmt_t stmt) {
-    // debug_print("Entering ast_stmt_list...\n");
     stmt_list_t ret = stmt_list;
-    // copy stmt to the heap
-    stmt_t *s = (stmt_t *) malloc(sizeof(stmt_t));
-    if (s == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "stmt_t");
-    }
-    *s = stmt;
-    s->next = NULL;
-    stmt_t *last = ast_last_list_elem(ret.start);
-    assert(last != NULL); // because there are no empty lists of stmts
-    last->next = s;
+    ret.elems = ast_list_grow(ALLOC_AST_CATEGORY(stmt_list_ast), ret.elems,
+			      ret.count, &ret.capacity, sizeof(stmt_t));
+    ret.elems[ret.count++] = stmt;
     return ret;
 }
 
@@ -468,7 +455,6 @@ stmt_t ast_stmt_assign(assign_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = assign_stmt;
     ret.data.assign_stmt = s;
     return ret;
@@ -480,7 +466,6 @@ stmt_t ast_stmt_call(call_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = call_stmt;
     ret.data.call_stmt = s;
     return ret;
@@ -492,7 +477,6 @@ stmt_t ast_stmt_block(block_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = block_stmt;
     ret.data.block_stmt = s;
     return ret;
@@ -504,7 +488,6 @@ stmt_t ast_stmt_if(if_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = if_stmt;
     ret.data.if_stmt = s;
     return ret;
@@ -516,7 +499,6 @@ stmt_t ast_stmt_while(while_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = while_stmt;
     ret.data.while_stmt = s;
     return ret;
@@ -528,7 +510,6 @@ stmt_t ast_stmt_read(read_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = read_stmt;
     ret.data.read_stmt = s;
     return ret;
@@ -541,7 +522,6 @@ stmt_t ast_stmt_print(print_stmt_t s)
     stmt_t ret;
     ret.file_loc = s.file_loc;
     ret.type_tag = stmt_ast;
-    ret.next = NULL;
     ret.stmt_kind = print_stmt;
     ret.data.print_stmt = s;
     return ret;
@@ -601,7 +581,8 @@ binary_op_expr_t ast_binary_op_expr(expr_t expr1, token_t arith_op,
     ret.file_loc = expr1.file_loc;
     ret.type_tag = binary_op_expr_ast;
 
-    expr_t *p = (expr_t *) malloc(sizeof(expr_t));
+    expr_t *p = (expr_t *) arena_alloc(ALLOC_AST_CATEGORY(expr_ast),
+				       sizeof(expr_t));
     if (p == NULL) {
 	bail_with_error("Unable to allocate space for a %s!", "expr_t");
     }
@@ -610,7 +591,8 @@ binary_op_expr_t ast_binary_op_expr(expr_t expr1, token_t arith_op,
 
     ret.arith_op = arith_op;
     
-    p = (expr_t *) malloc(sizeof(expr_t));
+    p = (expr_t *) arena_alloc(ALLOC_AST_CATEGORY(expr_ast),
+			       sizeof(expr_t));
     if (p == NULL) {
 	bail_with_error("Unable to allocate space for a %s!", "expr_t");
     }
@@ -697,6 +679,7 @@ ident_t ast_ident(file_location *file_loc, const char *name)
     ret.file_loc = file_loc;
     ret.type_tag = ident_ast;
     ret.name = name;
+    ret.hash = hash_name(name);
     return ret;
 }
 
@@ -733,47 +716,26 @@ expr_t ast_expr_number(number_t e)
     return ret;
 }
 
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Return a pointer to the last element in lst.
-// This only returns NULL if lst == NULL.
-void *ast_last_list_elem(void *lst)
+// Requires: elems is NULL or a heap array with room for *capacity
+//           elements of elem_size bytes, the first count of which are used
+// Return elems, grown (by doubling *capacity) if needed so that
+// it has room for at least count+1 elements.
+// The space is allocated for the category cat (see alloc_stats.h).
+void *ast_list_grow(alloc_category cat, void *elems, unsigned int count,
+		    unsigned int *capacity, size_t elem_size)
 {
-    // debug_print("Entering ast_last_list_elem\n");
-    if (lst == NULL) {
-	return lst;
-    }
-    // assert(lst != NULL);
-    void *prev = NULL;
-    while (lst != NULL) {
-	prev = lst;
-	lst = ((generic_t *)lst)->next;
+    if (count < *capacity) {
+	return elems;
     }
-    // here lst == NULL;
-    return prev;
-}
-
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Return the number of elements in the linked list lst
-int ast_list_length(void *lst)
-{
-    int ret = 0;
-    generic_t *p = (generic_t *) lst;
-    while (p != NULL) {
-	p = p->next;
-	ret++;
+    unsigned int new_cap = (*capacity == 0) ? 4 : 2 * (*capacity);
+    // lists of the AST (not of other subsystems) may be in the arena
+    void *ret = (cat >= ALLOC_SUBSYSTEM_COUNT)
+	? arena_realloc(cat, elems, *capacity * elem_size, new_cap * elem_size)
+	: alloc_realloc_in(cat, elems, new_cap * elem_size);
+    if (ret == NULL) {
+	bail_with_error("Unable to allocate space for a list of %u elements!",
+			new_cap);
     }
+    *capacity = new_cap;
     return ret;
 }
-
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Is lst empty?
-bool ast_list_is_empty(void *lst)
-{
-    return lst == NULL;
-}
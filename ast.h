@@ -2,8 +2,11 @@
 #ifndef _AST_H
 #define _AST_H
 #include <stdbool.h>
+#include <stddef.h>
 #include "machine_types.h"
 #include "file_location.h"
+#include "alloc_stats.h"
+#include "digest.h"
 
 // types of ASTs (type tags)
 typedef enum {
@@ -19,6 +22,9 @@ typedef enum {
     token_ast
 } AST_type;
 
+// The number of AST_type values
+#define AST_TYPE_COUNT (token_ast + 1)
+
 // The following types for structs named N_t
 // are returned by the parser.
 // The struct N_t is the type of information kept in the AST
@@ -29,9 +35,21 @@ typedef enum {
 typedef struct {
     file_location *file_loc;
     AST_type type_tag; // says what field of the union is active
-    void *next; // for lists
 } generic_t;
 
+// Lists are stored as contiguous arrays: a list's elems field points to
+// its count elements, in a heap array with room for capacity of them
+// (elems is NULL when capacity is 0).
+// Iterate over them with ast_list_for_each.
+
+// Execute the statement that follows once for each element of the list lst,
+// in order, with p (a variable of type T *) pointing to the element.
+#define ast_list_for_each(T, p, lst) \
+    for (T *p = (lst).elems; p != NULL && p < (lst).elems + (lst).count; p++)
+
+// Is p (a pointer into the list lst) the last element of lst?
+#define ast_list_is_last(lst, p) ((p) + 1 == (lst).elems + (lst).count)
+
 // empty ::=
 typedef struct {
     file_location *file_loc;
@@ -42,8 +60,8 @@ typedef struct {
 typedef struct ident_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct ident_s *next; // for lists this is a part of
     const char *name;
+    unsigned long long hash;  // hash_name(name), computed by the lexer
 } ident_t;
 
 // (possibly signed) numbers
@@ -138,7 +156,9 @@ struct stmt_s;
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    struct stmt_s *start;
+    unsigned int count;
+    unsigned int capacity;
+    struct stmt_s *elems;
 } stmt_list_t;
 
 typedef enum { empty_stmts_e, stmt_list_e } stmts_kind_e;
@@ -156,6 +176,7 @@ typedef struct {
     file_location *file_loc;
     AST_type type_tag;
     const char *name;
+    unsigned long long hash;  // hash_name(name)
     struct expr_s *expr;
 } assign_stmt_t;
 
@@ -164,6 +185,7 @@ typedef struct {
     file_location *file_loc;
     AST_type type_tag;
     const char *name;
+    unsigned long long hash;  // hash_name(name)
 } call_stmt_t;
 
 // forward declaration for block type
@@ -198,6 +220,7 @@ typedef struct {
     file_location *file_loc;
     AST_type type_tag;
     const char *name;
+    unsigned long long hash;  // hash_name(name)
 } read_stmt_t;
 
 // stmt ::= print expr
@@ -212,7 +235,6 @@ typedef struct {
 typedef struct stmt_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct stmt_s *next; // for lists this is a part of
     stmt_kind_e stmt_kind;
     union {
 	assign_stmt_t assign_stmt;
@@ -229,30 +251,34 @@ typedef struct stmt_s {
 typedef struct proc_decl_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct proc_decl_s *next; // for lists
     const char *name;
+    unsigned long long hash;  // hash_name(name)
     struct block_s *block;
+    digest cache_digest;  // see proc_cache_proc_decl, else all 0
 } proc_decl_t;
 
 // proc-decls ::= { proc-decl }
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    proc_decl_t *proc_decls;
+    unsigned int count;
+    unsigned int capacity;
+    proc_decl_t *elems;
 } proc_decls_t;
 
 // ident-list ::= ident | ident-list ident
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    ident_t *start;
+    unsigned int count;
+    unsigned int capacity;
+    ident_t *elems;
 } ident_list_t;
 
 // var-decl ::= var ident-list
 typedef struct var_decl_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct var_decl_s *next; // for lists this is a part of
     ident_list_t ident_list;
 } var_decl_t;
 
@@ -260,14 +286,15 @@ typedef struct var_decl_s {
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    var_decl_t *var_decls;
+    unsigned int count;
+    unsigned int capacity;
+    var_decl_t *elems;
 } var_decls_t;
 
 // const-def ::= ident number
 typedef struct const_def_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct const_def_s *next; // for lists this is a part of
     ident_t ident;
     number_t number;
 } const_def_t;
@@ -276,14 +303,15 @@ typedef struct const_def_s {
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    const_def_t *start;
+    unsigned int count;
+    unsigned int capacity;
+    const_def_t *elems;
 } const_def_list_t;
 
 // const-decl ::= const const-def-list
 typedef struct const_decl_s {
     file_location *file_loc;
     AST_type type_tag;
-    struct const_decl_s *next; // for lists this is a part of
     const_def_list_t const_def_list;
 } const_decl_t;
 
@@ -291,7 +319,9 @@ typedef struct const_decl_s {
 typedef struct {
     file_location *file_loc;
     AST_type type_tag;
-    const_decl_t *start;
+    unsigned int count;
+    unsigned int capacity;
+    const_decl_t *elems;
 } const_decls_t;
 
 // block ::= begin const-decls var-decls proc-decls stmts
@@ -352,6 +382,10 @@ extern unsigned int ast_line(AST t);
 // Return the type tag of the AST t
 extern AST_type ast_type_tag(AST t);
 
+// Requires: t is an AST_type
+// Return the name of t (e.g., "block_ast")
+extern const char *ast_type_name(AST_type t);
+
 // Return a pointer to a fresh copy of t
 // that has been allocated on the heap
 extern AST *ast_heap_copy(AST t);
@@ -404,6 +438,10 @@ extern proc_decls_t ast_proc_decls(proc_decls_t proc_decls,
 // Return an AST for a proc_decl
 extern proc_decl_t ast_proc_decl(ident_t ident, block_t block);
 
+// Return an AST for a proc_decl whose block is not kept
+// (because it was streamed, see ast_stream.h), so its block is NULL
+extern proc_decl_t ast_proc_decl_without_block(ident_t ident);
+
 
 // Return an AST for the list of statements 
 extern stmts_t ast_stmts_empty(empty_t empty);
@@ -417,6 +455,10 @@ extern stmts_t ast_stmts(stmt_list_t stmt_list);
 // Return an AST for a list of statements that has stmt as a member
 extern stmt_list_t ast_stmt_list_singleton(stmt_t stmt);
 
+// Return an AST for a list of no statements found at empty's location
+// (which stands for statements with syntax errors, see spl.y)
+extern stmt_list_t ast_stmt_list_empty(empty_t empty);
+
 // Return an AST for the list of statements 
 extern stmt_list_t ast_stmt_list(stmt_list_t stmt_list, stmt_t stmt);
 
@@ -509,23 +551,13 @@ extern ident_t ast_ident(file_location *file_loc, const char *name);
 
 // Some operations on AST lists
 
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Return a pointer to the last element in lst.
-// This only returns NULL if lst == NULL.
-extern void *ast_last_list_elem(void *lst);
-
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Return the number of elements in the linked list lst
-extern int ast_list_length(void *lst);
-
-// Requires: lst is a pointer to a non-circular 
-//           linked list with next pointers
-//           as in generic_t
-// Is lst empty?
-extern bool ast_list_is_empty(void *lst);
+// Requires: elems is NULL or a heap array with room for *capacity
+//           elements of elem_size bytes, the first count of which are used
+// Return elems, grown (by doubling *capacity) if needed so that
+// it has room for at least count+1 elements.
+// The space is allocated for the category cat (see alloc_stats.h).
+extern void *ast_list_grow(alloc_category cat, void *elems,
+			   unsigned int count, unsigned int *capacity,
+			   size_t elem_size);
 
 #endif
@@ -0,0 +1,135 @@
+/* ast_image.c: binary AST image files that can be mmap-ed and used in place */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ast_image.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// Requires: fname != NULL && fa != NULL
+// Write fa to the file named fname as an AST image,
+// bailing with an error message if the file cannot be written.
+void ast_image_write(const char *fname, const flat_ast *fa)
+{
+    ast_image_header hdr;
+    memcpy(hdr.magic, AST_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = AST_IMAGE_VERSION;
+    hdr.node_count = fa->node_count;
+    hdr.strtab_size = fa->strtab_size;
+    hdr.filename = fa->filename - fa->strtab;
+    hdr.root = fa->root;
+
+    FILE *f = fopen(fname, "wb");
+    if (f == NULL) {
+	bail_with_error("Cannot open %s", fname);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+	|| fwrite(fa->nodes, sizeof(flat_node), fa->node_count, f)
+	    != fa->node_count
+	|| fwrite(fa->lines, sizeof(uint32_t), fa->node_count, f)
+	    != fa->node_count
+	|| fwrite(fa->strtab, 1, fa->strtab_size, f) != fa->strtab_size
+	|| fclose(f) == EOF) {
+	bail_with_error("Cannot write %s", fname);
+    }
+}
+
+// The mapping behind a flat AST returned by ast_image_map
+typedef struct {
+    flat_ast fa;  // first, so a flat_ast * can be converted back
+    void *base;   // start of the mapping
+    size_t size;  // size of the mapping in bytes
+} mapped_image;
+
+// Requires: fa->nodes has fa->node_count nodes
+// Does every node of fa only refer to nodes after it, as in the pre-order
+// that flat_ast_build uses?  (If so, walking the children and next links
+// cannot loop or leave the node array.)
+static bool nodes_in_pre_order(const flat_ast *fa)
+{
+    for (uint32_t i = 1; i < fa->node_count; i++) {
+	const flat_node *n = &fa->nodes[i];
+	if ((n->child != FLAT_NONE
+	     && (n->child <= i || n->child >= fa->node_count))
+	    || (n->next != FLAT_NONE
+		&& (n->next <= i || n->next >= fa->node_count))) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+// Requires: fname != NULL
+// Map the AST image file named fname into memory and return a flat AST
+// whose tables point into the mapping, bailing with an error message
+// if it cannot be read or is not a valid AST image.
+flat_ast *ast_image_map(const char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+	bail_with_error("Cannot open %s", fname);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	bail_with_error("Cannot stat %s", fname);
+    }
+    size_t size = (size_t) st.st_size;
+    if (size < sizeof(ast_image_header)) {
+	bail_with_error("%s is too short to be an AST image!", fname);
+    }
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+	bail_with_error("Cannot map %s", fname);
+    }
+    close(fd);
+
+    const ast_image_header *hdr = (const ast_image_header *) base;
+    if (memcmp(hdr->magic, AST_IMAGE_MAGIC, sizeof(hdr->magic)) != 0
+	|| hdr->version != AST_IMAGE_VERSION) {
+	bail_with_error("%s is not a version %d AST image!", fname,
+			AST_IMAGE_VERSION);
+    }
+    size_t expected = sizeof(ast_image_header)
+	+ (size_t) hdr->node_count * (sizeof(flat_node) + sizeof(uint32_t))
+	+ hdr->strtab_size;
+    if (size != expected || hdr->node_count == 0 || hdr->strtab_size == 0
+	|| hdr->root == FLAT_NONE || hdr->root >= hdr->node_count || hdr->filename >= hdr->strtab_size) {
+	bail_with_error("%s is a damaged AST image!", fname);
+    }
+
+    mapped_image *ret = (mapped_image *) alloc_malloc_in(alloc_flat_ast,
+							 sizeof(mapped_image));
+    if (ret == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "mapped_image");
+    }
+    ret->base = base;
+    ret->size = size;
+    ret->fa.node_count = hdr->node_count;
+    ret->fa.nodes = (const flat_node *) (hdr + 1);
+    ret->fa.lines = (const uint32_t *) (ret->fa.nodes + hdr->node_count);
+    ret->fa.strtab_size = hdr->strtab_size;
+    ret->fa.strtab = (const char *) (ret->fa.lines + hdr->node_count);
+    ret->fa.filename = ret->fa.strtab + hdr->filename;
+    ret->fa.root = hdr->root;
+    // so that every valid offset starts a NUL-terminated string
+    if (ret->fa.strtab[hdr->strtab_size - 1] != '\0'
+	|| !nodes_in_pre_order(&ret->fa)) {
+	bail_with_error("%s is a damaged AST image!", fname);
+    }
+    return &ret->fa;
+}
+
+// Requires: fa was returned by ast_image_map
+// Unmap fa's image and free fa.
+void ast_image_unmap(flat_ast *fa)
+{
+    mapped_image *img = (mapped_image *) fa;
+    munmap(img->base, img->size);
+    alloc_free(img);
+}
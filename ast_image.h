@@ -0,0 +1,41 @@
+/* ast_image.h: binary AST image files that can be mmap-ed and used in place */
+#ifndef _AST_IMAGE_H
+#define _AST_IMAGE_H
+#include <stdint.h>
+#include "flat_ast.h"
+
+// An AST image file is a flat AST (see flat_ast.h) written out as
+// a header, the node array, the line number side table,
+// and then the string table.  Since nodes refer to each other by index
+// and to strings by offset, a mapped image can be used in place
+// without any pointer fix-ups.
+// All integers are in the byte order of the machine that wrote the file.
+
+#define AST_IMAGE_MAGIC "SPLA"
+#define AST_IMAGE_VERSION 2
+
+typedef struct {
+    char magic[4];        // AST_IMAGE_MAGIC (without the NUL)
+    uint32_t version;     // AST_IMAGE_VERSION
+    uint32_t node_count;  // including the unused node 0
+    uint32_t strtab_size; // in bytes
+    uint32_t filename;    // string offset of the source file's name
+    uint32_t root;        // index of the program's block node
+} ast_image_header;
+
+// Requires: fname != NULL && fa != NULL
+// Write fa to the file named fname as an AST image,
+// bailing with an error message if the file cannot be written.
+extern void ast_image_write(const char *fname, const flat_ast *fa);
+
+// Requires: fname != NULL
+// Map the AST image file named fname into memory and return a flat AST
+// whose tables point into the mapping, bailing with an error message
+// if it cannot be read or is not a valid AST image.
+extern flat_ast *ast_image_map(const char *fname);
+
+// Requires: fa was returned by ast_image_map
+// Unmap fa's image and free fa.
+extern void ast_image_unmap(flat_ast *fa);
+
+#endif
@@ -0,0 +1,167 @@
+/* ast_stream.c: unparsing each procedure as soon as it is parsed */
+#include "ast_stream.h"
+#include "arena.h"
+#include "parser.h"
+#include "unparser.h"
+#include "utilities.h"
+#include "diagnostics.h"
+
+static FILE *stream_out = NULL;  // NULL when streaming is off
+// where the text is printed until the whole program has been parsed
+static FILE *spool = NULL;
+
+// The blocks being parsed, innermost last; the streamed ones
+// (the program's block and the blocks of streamed procedures)
+// are always the outermost ones
+static unsigned int open_blocks = 0;
+static unsigned int streamed_blocks = 0;
+// will the block whose "begin" is parsed next be streamed?
+static bool next_block_streamed = true;
+
+// The arena marks for the streamed procedures being parsed, innermost last
+static arena_mark *marks = NULL;
+static unsigned int mark_count = 0;
+static unsigned int mark_capacity = 0;
+
+// Requires: out != NULL, parsing has not started
+// Turn on streaming, printing to out (this also turns on arenas
+// and defers the errors reported by prog_error)
+void ast_stream_enable(FILE *out)
+{
+    spool = tmpfile();
+    if (spool == NULL) {
+	bail_with_error("Unable to create a temporary file for --stream!");
+    }
+    stream_out = out;
+    arena_enable();
+    diagnostics_defer();
+}
+
+// Is streaming on?
+bool ast_stream_enabled()
+{
+    return stream_out != NULL;
+}
+
+// Is the innermost block being parsed streamed?
+static bool in_streamed_block()
+{
+    return stream_out != NULL && open_blocks > 0
+	&& open_blocks == streamed_blocks;
+}
+
+// Should output be printed? (not after a syntax error,
+// as the AST is then only partial, see --all-errors)
+static bool printing()
+{
+    return parseErrorCount() == 0;
+}
+
+// Note that a block's "begin" has been parsed
+void ast_stream_block_begin()
+{
+    if (stream_out == NULL) {
+	return;
+    }
+    if (next_block_streamed && open_blocks == streamed_blocks) {
+	streamed_blocks++;
+    }
+    open_blocks++;
+    next_block_streamed = false;
+}
+
+// Note that the current block's declarations of constants and variables,
+// cds and vds, have been parsed
+void ast_stream_block_decls(const_decls_t cds, var_decls_t vds)
+{
+    if (in_streamed_block() && printing()) {
+	unparseBlockStart(spool, cds, vds, streamed_blocks - 1);
+    }
+}
+
+// Note that the current block has been parsed, ending with statements stmts
+void ast_stream_block_end(stmts_t stmts)
+{
+    if (stream_out == NULL) {
+	return;
+    }
+    if (in_streamed_block()) {
+	streamed_blocks--;
+	if (printing()) {
+	    // a procedure's block is followed by a semicolon
+	    unparseBlockEnd(spool, stmts, streamed_blocks,
+			    streamed_blocks > 0);
+	}
+    }
+    open_blocks--;
+}
+
+// Note that error recovery has discarded the current (partial) block
+void ast_stream_block_discarded()
+{
+    if (stream_out == NULL) {
+	return;
+    }
+    if (in_streamed_block()) {
+	streamed_blocks--;
+    }
+    open_blocks--;
+}
+
+// Requires: name != NULL
+// Note that the heading of a procedure named name has been parsed
+void ast_stream_proc_begin(const char *name)
+{
+    if (!in_streamed_block()) {
+	return;
+    }
+    if (printing()) {
+	unparseProcStart(spool, name, streamed_blocks);
+    }
+    marks = ast_list_grow(alloc_arena, marks, mark_count, &mark_capacity,
+			  sizeof(arena_mark));
+    marks[mark_count++] = arena_get_mark();
+    next_block_streamed = true;
+}
+
+// Note that the procedure whose heading was parsed last has been parsed,
+// and return true if it was printed and its block's AST freed
+// (in which case it should be represented by ast_proc_decl_without_block);
+// its AST is only freed if can_free is true
+bool ast_stream_proc_end(bool can_free)
+{
+    // its block has ended, so the innermost block is the one it is in
+    if (!in_streamed_block() || mark_count == 0) {
+	return false;
+    }
+    // (if error recovery discarded a procedure, its mark is still
+    // on the stack; releasing a later mark than this procedure's
+    // only frees less than it could, never what is still in use)
+    arena_mark m = marks[--mark_count];
+    if (!can_free) {
+	return false;
+    }
+    arena_release(m);
+    return true;
+}
+
+// Requires: the parser has accepted the whole program (up to end of file)
+// Print the streamed program to the output, unless it has a syntax error
+void ast_stream_program_end()
+{
+    if (stream_out == NULL || !printing()) {
+	return;
+    }
+    fputs(".\n", spool);
+    rewind(spool);
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), spool)) > 0) {
+	fwrite(buf, 1, n, stream_out);
+    }
+    if (ferror(spool) || fflush(stream_out) == EOF) {
+	bail_with_error("Unable to copy the streamed program to the output!");
+    }
+    fclose(spool);
+    spool = NULL;
+}
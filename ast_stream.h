@@ -0,0 +1,64 @@
+/* ast_stream.h: unparsing each procedure as soon as it is parsed */
+#ifndef _AST_STREAM_H
+#define _AST_STREAM_H
+#include <stdio.h>
+#include <stdbool.h>
+#include "ast.h"
+
+// When streaming is on (see ast_stream_enable), the parser's semantic
+// actions call the functions below to print the program (as unparseProgram
+// would) while it is being parsed: the start of each block is printed
+// when its declarations of constants and variables are parsed,
+// and the rest when its "end" is parsed.  Once a procedure declaration
+// has been parsed (and checked, in one-pass mode) and printed,
+// the AST for its block is freed (see arena.h), so only its name is kept.
+// So memory use depends on the nesting depth and the declarations
+// in scope, not on the size of the program.
+// This is done for the program's block and the procedures declared
+// in it (and in their blocks, and so on); a block statement is printed
+// along with the statement it is in.
+// The text is printed to a temporary file, which is copied to the output
+// once the whole program has been parsed without syntax errors
+// (see ast_stream_program_end, which the caller of parseProgram calls),
+// and declaration errors found while parsing are deferred (see
+// diagnostics_defer), so the output is the same as in the default mode:
+// nothing for a program with a syntax error, and a program with
+// a declaration error before its first such error.
+// When streaming is off, these functions do nothing.
+
+// Requires: out != NULL, parsing has not started
+// Turn on streaming, printing to out (this also turns on arenas
+// and defers the errors reported by prog_error)
+extern void ast_stream_enable(FILE *out);
+
+// Is streaming on?
+extern bool ast_stream_enabled();
+
+// Note that a block's "begin" has been parsed
+extern void ast_stream_block_begin();
+
+// Note that the current block's declarations of constants and variables,
+// cds and vds, have been parsed
+extern void ast_stream_block_decls(const_decls_t cds, var_decls_t vds);
+
+// Note that the current block has been parsed, ending with statements stmts
+extern void ast_stream_block_end(stmts_t stmts);
+
+// Note that error recovery has discarded the current (partial) block
+extern void ast_stream_block_discarded();
+
+// Requires: name != NULL
+// Note that the heading of a procedure named name has been parsed
+extern void ast_stream_proc_begin(const char *name);
+
+// Note that the procedure whose heading was parsed last has been parsed,
+// and return true if it was printed and its block's AST freed
+// (in which case it should be represented by ast_proc_decl_without_block);
+// its AST is only freed if can_free is true
+extern bool ast_stream_proc_end(bool can_free);
+
+// Requires: the parser has accepted the whole program (up to end of file)
+// Print the streamed program to the output, unless it has a syntax error
+extern void ast_stream_program_end();
+
+#endif
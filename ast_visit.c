@@ -0,0 +1,342 @@
+/* ast_visit.c: iterative traversal of ASTs with per-node-type callbacks */
+#include <stdlib.h>
+#include <limits.h>
+#include "ast_visit.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// parent index of the root node
+#define NO_PARENT UINT_MAX
+
+// The stack of nodes whose traversal is not yet finished;
+// a node stays on it (below its children) until its post callback is done
+typedef struct {
+    unsigned int count;
+    unsigned int capacity;
+    ast_visit_node *elems;
+} visit_stack;
+
+// Push a node for the given AST onto st,
+// as child number index (of count) of the node at stack index parent
+static void push(visit_stack *st, AST_type type_tag, const void *node,
+		 unsigned int parent, unsigned int index, unsigned int count)
+{
+    st->elems = ast_list_grow(alloc_traversal, st->elems, st->count,
+			      &st->capacity, sizeof(ast_visit_node));
+    ast_visit_node *n = &st->elems[st->count++];
+    n->type_tag = type_tag;
+    n->node = node;
+    n->index = index;
+    n->last = (index + 1 == count);
+    n->level = (parent == NO_PARENT) ? 0 : st->elems[parent].child_level;
+    n->child_level = n->level;
+    n->parent = parent;
+    n->expanded = false;
+}
+
+// Requires: exp != NULL
+// Return the type tag ast_visit uses for the expression exp
+// and set *node to the struct visited for it.
+AST_type ast_visit_expr_node(const expr_t *exp, const void **node)
+{
+    switch (exp->expr_kind) {
+    case expr_bin:
+	*node = &exp->data.binary;
+	return binary_op_expr_ast;
+    case expr_negated:
+	*node = &exp->data.negated;
+	return negated_expr_ast;
+    case expr_ident:
+	*node = &exp->data.ident;
+	return ident_ast;
+    case expr_number:
+	*node = &exp->data.number;
+	return number_ast;
+    default:
+	bail_with_error("Unexpected expr_kind_e (%d) in ast_visit_expr_node!",
+			exp->expr_kind);
+	return expr_ast;
+    }
+}
+
+// Requires: cond != NULL
+// Return the type tag ast_visit uses for the condition cond
+// and set *node to the struct visited for it.
+AST_type ast_visit_condition_node(const condition_t *cond, const void **node)
+{
+    switch (cond->cond_kind) {
+    case ck_db:
+	*node = &cond->data.db_cond;
+	return db_condition_ast;
+    case ck_rel:
+	*node = &cond->data.rel_op_cond;
+	return rel_op_condition_ast;
+    default:
+	bail_with_error("Unexpected condition_kind_e (%d) in ast_visit_condition_node!",
+			cond->cond_kind);
+	return condition_ast;
+    }
+}
+
+// Requires: s != NULL
+// Return the type tag ast_visit uses for the statement s
+// and set *node to the struct visited for it.
+AST_type ast_visit_stmt_node(const stmt_t *s, const void **node)
+{
+    switch (s->stmt_kind) {
+    case assign_stmt:
+	*node = &s->data.assign_stmt;
+	return assign_stmt_ast;
+    case call_stmt:
+	*node = &s->data.call_stmt;
+	return call_stmt_ast;
+    case if_stmt:
+	*node = &s->data.if_stmt;
+	return if_stmt_ast;
+    case while_stmt:
+	*node = &s->data.while_stmt;
+	return while_stmt_ast;
+    case read_stmt:
+	*node = &s->data.read_stmt;
+	return read_stmt_ast;
+    case print_stmt:
+	*node = &s->data.print_stmt;
+	return print_stmt_ast;
+    case block_stmt:
+	*node = &s->data.block_stmt;
+	return block_stmt_ast;
+    default:
+	bail_with_error("Unknown stmt_kind (%d) in ast_visit_stmt_node!",
+			s->stmt_kind);
+	return stmt_ast;
+    }
+}
+
+// Push the expression exp as child number index (of count) of parent
+static void push_expr(visit_stack *st, const expr_t *exp,
+		      unsigned int parent, unsigned int index,
+		      unsigned int count)
+{
+    const void *node;
+    AST_type tag = ast_visit_expr_node(exp, &node);
+    push(st, tag, node, parent, index, count);
+}
+
+// Push the condition cond as child number index (of count) of parent
+static void push_condition(visit_stack *st, const condition_t *cond,
+			   unsigned int parent, unsigned int index,
+			   unsigned int count)
+{
+    const void *node;
+    AST_type tag = ast_visit_condition_node(cond, &node);
+    push(st, tag, node, parent, index, count);
+}
+
+// Push the children of the node at stack index top onto st,
+// last child first, so that they are visited in order
+static void push_children(visit_stack *st, unsigned int top)
+{
+    // copy what is needed, as pushing may move the stack's elements
+    AST_type type_tag = st->elems[top].type_tag;
+    const void *node = st->elems[top].node;
+    switch (type_tag) {
+    case block_ast: {
+	const block_t *blk = node;
+	unsigned int nc = blk->const_decls.count;
+	unsigned int nv = blk->var_decls.count;
+	unsigned int np = blk->proc_decls.count;
+	unsigned int count = nc + nv + np + 1;
+	push(st, stmts_ast, &blk->stmts, top, count - 1, count);
+	for (unsigned int i = np; i-- > 0; ) {
+	    push(st, proc_decl_ast, &blk->proc_decls.elems[i], top,
+		 nc + nv + i, count);
+	}
+	for (unsigned int i = nv; i-- > 0; ) {
+	    push(st, var_decl_ast, &blk->var_decls.elems[i], top,
+		 nc + i, count);
+	}
+	for (unsigned int i = nc; i-- > 0; ) {
+	    push(st, const_decl_ast, &blk->const_decls.elems[i], top,
+		 i, count);
+	}
+	break;
+    }
+    case const_decl_ast: {
+	const const_def_list_t *cdl = &((const const_decl_t *) node)->const_def_list;
+	for (unsigned int i = cdl->count; i-- > 0; ) {
+	    push(st, const_def_ast, &cdl->elems[i], top, i, cdl->count);
+	}
+	break;
+    }
+    case var_decl_ast: {
+	const ident_list_t *il = &((const var_decl_t *) node)->ident_list;
+	for (unsigned int i = il->count; i-- > 0; ) {
+	    push(st, ident_ast, &il->elems[i], top, i, il->count);
+	}
+	break;
+    }
+    case proc_decl_ast:
+	push(st, block_ast, ((const proc_decl_t *) node)->block, top, 0, 1);
+	break;
+    case stmts_ast: {
+	const stmts_t *stmts = node;
+	if (stmts->stmts_kind == empty_stmts_e) {
+	    break;
+	}
+	const stmt_list_t *sl = &stmts->stmt_list;
+	for (unsigned int i = sl->count; i-- > 0; ) {
+	    const void *s;
+	    AST_type tag = ast_visit_stmt_node(&sl->elems[i], &s);
+	    push(st, tag, s, top, i, sl->count);
+	}
+	break;
+    }
+    case assign_stmt_ast:
+	push_expr(st, ((const assign_stmt_t *) node)->expr, top, 0, 1);
+	break;
+    case if_stmt_ast: {
+	const if_stmt_t *s = node;
+	unsigned int count = (s->else_stmts != NULL) ? 3 : 2;
+	if (s->else_stmts != NULL) {
+	    push(st, stmts_ast, s->else_stmts, top, 2, count);
+	}
+	push(st, stmts_ast, s->then_stmts, top, 1, count);
+	push_condition(st, &s->condition, top, 0, count);
+	break;
+    }
+    case while_stmt_ast: {
+	const while_stmt_t *s = node;
+	push(st, stmts_ast, s->body, top, 1, 2);
+	push_condition(st, &s->condition, top, 0, 2);
+	break;
+    }
+    case print_stmt_ast:
+	push_expr(st, &((const print_stmt_t *) node)->expr, top, 0, 1);
+	break;
+    case block_stmt_ast:
+	push(st, block_ast, ((const block_stmt_t *) node)->block, top, 0, 1);
+	break;
+    case db_condition_ast: {
+	const db_condition_t *c = node;
+	push_expr(st, &c->divisor, top, 1, 2);
+	push_expr(st, &c->dividend, top, 0, 2);
+	break;
+    }
+    case rel_op_condition_ast: {
+	const rel_op_condition_t *c = node;
+	push_expr(st, &c->expr2, top, 1, 2);
+	push_expr(st, &c->expr1, top, 0, 2);
+	break;
+    }
+    case binary_op_expr_ast: {
+	const binary_op_expr_t *e = node;
+	push_expr(st, e->expr2, top, 1, 2);
+	push_expr(st, e->expr1, top, 0, 2);
+	break;
+    }
+    case negated_expr_ast:
+	push_expr(st, ((const negated_expr_t *) node)->expr, top, 0, 1);
+	break;
+    case const_def_ast: case call_stmt_ast: case read_stmt_ast:
+    case ident_ast: case number_ast:
+	break;
+    default:
+	bail_with_error("Unexpected type_tag (%d) in ast_visit!", type_tag);
+	break;
+    }
+}
+
+// Push the children of the flat node (of fa) at stack index top onto st,
+// so that they are visited in order; as they are a list from first
+// to last, they are pushed in that order and then reversed on st
+static void push_flat_children(visit_stack *st, unsigned int top,
+			       const flat_ast *fa)
+{
+    const flat_node *n = st->elems[top].node;
+    unsigned int count = 0;
+    for (uint32_t c = n->child; c != FLAT_NONE;
+	 c = flat_ast_node_at(fa, c)->next) {
+	count++;
+    }
+    unsigned int first = st->count;
+    unsigned int i = 0;
+    for (uint32_t c = n->child; c != FLAT_NONE; ) {
+	const flat_node *child = flat_ast_node_at(fa, c);
+	if (child->type_tag >= AST_TYPE_COUNT) {
+	    bail_with_error("Unexpected type_tag (%d) in ast_visit_flat!",
+			    child->type_tag);
+	}
+	push(st, (AST_type) child->type_tag, child, top, i++, count);
+	c = child->next;
+    }
+    for (unsigned int lo = first, hi = st->count; lo + 1 < hi; lo++, hi--) {
+	ast_visit_node tmp = st->elems[lo];
+	st->elems[lo] = st->elems[hi - 1];
+	st->elems[hi - 1] = tmp;
+    }
+}
+
+// Visit the node on st (its only element) and all its descendants
+// in pre-order, calling the callbacks of v with data;
+// fa is the flat AST the node is in, or NULL if it is not a flat node
+static void visit(const ast_visitor *v, void *data, visit_stack *st,
+		  const flat_ast *fa)
+{
+    while (st->count > 0) {
+	unsigned int top = st->count - 1;
+	ast_visit_node *n = &st->elems[top];
+	const ast_visit_node *parent =
+	    (n->parent == NO_PARENT) ? NULL : &st->elems[n->parent];
+	if (n->expanded) {
+	    if (v->post[n->type_tag] != NULL) {
+		v->post[n->type_tag](data, n, parent);
+	    }
+	    st->count--;
+	    continue;
+	}
+	n->expanded = true;
+	if (v->pre[n->type_tag] != NULL
+	    && !v->pre[n->type_tag](data, n, parent)) {
+	    st->count--;
+	    continue;
+	}
+	if (fa == NULL) {
+	    push_children(st, top);
+	} else {
+	    push_flat_children(st, top, fa);
+	}
+    }
+    alloc_free(st->elems);
+}
+
+// Requires: v != NULL, node points to an AST of the kind given by type_tag
+//           (as described in ast_visit.h)
+// Visit node and all its descendants in pre-order, calling the callbacks
+// of v with data, and giving node the level root_level.
+void ast_visit(const ast_visitor *v, void *data, AST_type type_tag,
+	       const void *node, int root_level)
+{
+    visit_stack st = { 0, 0, NULL };
+    push(&st, type_tag, node, NO_PARENT, 0, 1);
+    st.elems[0].level = root_level;
+    st.elems[0].child_level = root_level;
+    visit(v, data, &st, NULL);
+}
+
+// Requires: v != NULL, fa != NULL, and i is the index of a node of fa
+// Visit the node i of the flat AST fa and all its descendants in pre-order,
+// like ast_visit, giving node i the level root_level.
+void ast_visit_flat(const ast_visitor *v, void *data, const flat_ast *fa,
+		    uint32_t i, int root_level)
+{
+    const flat_node *n = flat_ast_node_at(fa, i);
+    if (n->type_tag >= AST_TYPE_COUNT) {
+	bail_with_error("Unexpected type_tag (%d) in ast_visit_flat!",
+			n->type_tag);
+    }
+    visit_stack st = { 0, 0, NULL };
+    push(&st, (AST_type) n->type_tag, n, NO_PARENT, 0, 1);
+    st.elems[0].level = root_level;
+    st.elems[0].child_level = root_level;
+    visit(v, data, &st, fa);
+}
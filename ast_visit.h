@@ -0,0 +1,92 @@
+/* ast_visit.h: iterative traversal of ASTs with per-node-type callbacks */
+#ifndef _AST_VISIT_H
+#define _AST_VISIT_H
+#include <stdbool.h>
+#include "ast.h"
+#include "flat_ast.h"
+
+// ast_visit walks an AST in pre-order using an explicit stack on the heap,
+// so the depth of nesting it can handle is only limited by memory.
+// The nodes visited, and the children of each, in order, are:
+//   block_ast (a block_t): const_decl_ast*, var_decl_ast*, proc_decl_ast*,
+//                          stmts_ast
+//   const_decl_ast (a const_decl_t): const_def_ast+
+//   const_def_ast (a const_def_t): none
+//   var_decl_ast (a var_decl_t): ident_ast+
+//   proc_decl_ast (a proc_decl_t): block_ast
+//   stmts_ast (a stmts_t): the statements, if any
+//   assign_stmt_ast (an assign_stmt_t): an expression
+//   call_stmt_ast, read_stmt_ast (call_stmt_t, read_stmt_t): none
+//   if_stmt_ast (an if_stmt_t): a condition, stmts_ast, [stmts_ast]
+//   while_stmt_ast (a while_stmt_t): a condition, stmts_ast
+//   print_stmt_ast (a print_stmt_t): an expression
+//   block_stmt_ast (a block_stmt_t): block_ast
+//   db_condition_ast (a db_condition_t): two expressions
+//   rel_op_condition_ast (a rel_op_condition_t): two expressions
+//   binary_op_expr_ast (a binary_op_expr_t): two expressions
+//   negated_expr_ast (a negated_expr_t): an expression
+//   ident_ast (an ident_t), number_ast (a number_t): none
+// Statements, conditions and expressions are visited as the struct
+// in their data union (e.g., an if_stmt_t, not its stmt_t).
+
+// The information about a node that the callbacks receive
+typedef struct {
+    AST_type type_tag;    // says which kind of struct node points to
+    const void *node;     // the node being visited
+    unsigned int index;   // its position among its parent's children
+    bool last;            // is it the last of its parent's children?
+    int level;            // the child_level of its parent (or the root level)
+    int child_level;      // the level for its children (initially level)
+    unsigned int parent;  // used internally
+    bool expanded;        // used internally
+} ast_visit_node;
+
+// Called before visiting n's children, with parent == NULL for the root;
+// returning false skips n's children and its post callback.
+// It may set n->child_level to change the level of n's children.
+typedef bool (*ast_visit_pre_fn)(void *data, ast_visit_node *n,
+				 const ast_visit_node *parent);
+
+// Called after visiting n's children, with parent == NULL for the root
+typedef void (*ast_visit_post_fn)(void *data, const ast_visit_node *n,
+				  const ast_visit_node *parent);
+
+// The callbacks of a traversal, indexed by type tag (NULL entries are skipped)
+typedef struct {
+    ast_visit_pre_fn pre[AST_TYPE_COUNT];
+    ast_visit_post_fn post[AST_TYPE_COUNT];
+} ast_visitor;
+
+// Requires: v != NULL, node points to an AST of the kind given by type_tag
+//           (as described above)
+// Visit node and all its descendants in pre-order, calling the callbacks
+// of v with data, and giving node the level root_level.
+extern void ast_visit(const ast_visitor *v, void *data, AST_type type_tag,
+		      const void *node, int root_level);
+
+// Requires: v != NULL, fa != NULL, and i is the index of a node of fa
+// Visit the node i of the flat AST fa and all its descendants in pre-order,
+// like ast_visit, giving node i the level root_level.
+// The node of each ast_visit_node is then its const flat_node *,
+// and the children of each node are those listed in flat_ast.h
+// (so, unlike above, a const_def_ast has a number_ast child).
+extern void ast_visit_flat(const ast_visitor *v, void *data,
+			   const flat_ast *fa, uint32_t i, int root_level);
+
+// Requires: exp != NULL
+// Return the type tag ast_visit uses for the expression exp
+// and set *node to the struct visited for it.
+extern AST_type ast_visit_expr_node(const expr_t *exp, const void **node);
+
+// Requires: cond != NULL
+// Return the type tag ast_visit uses for the condition cond
+// and set *node to the struct visited for it.
+extern AST_type ast_visit_condition_node(const condition_t *cond,
+					 const void **node);
+
+// Requires: s != NULL
+// Return the type tag ast_visit uses for the statement s
+// and set *node to the struct visited for it.
+extern AST_type ast_visit_stmt_node(const stmt_t *s, const void **node);
+
+#endif
@@ -0,0 +1,43 @@
+#!/bin/sh
+# $Id$
+# Run the compiler's phases on synthetic programs of growing sizes
+# (made by spl_gen) and print the time and peak RSS of each run.
+# Usage: ./bench.sh [results-file]
+# The sizes can be changed by setting SIZES (and DEEP_SIZES for the
+# deep shape, whose nesting is limited by the parser's stack).
+
+COMPILER=${COMPILER:-./compiler}
+GEN=${GEN:-./spl_gen}
+SHAPES=${SHAPES:-"wide deep stmts expr procs lookup"}
+SIZES=${SIZES:-"1000 2000 4000 8000 16000"}
+DEEP_SIZES=${DEEP_SIZES:-"100 200 400 800"}
+STAGES=${STAGES:-"parse unparse check"}
+RESULTS=${1:-bench-results.txt}
+BENCHDIR=${BENCHDIR:-bench-inputs}
+
+mkdir -p "$BENCHDIR" || exit 1
+printf '%-8s %8s %-8s %12s %12s %14s\n' \
+    shape size stage "wall ms" "cpu ms" "peak RSS KB" | tee "$RESULTS"
+for shape in $SHAPES
+do
+    if test "$shape" = deep; then sizes=$DEEP_SIZES; else sizes=$SIZES; fi
+    for n in $sizes
+    do
+	input="$BENCHDIR/$shape-$n.spl"
+	"$GEN" "$shape" "$n" >"$input" || exit 1
+	for stage in $STAGES
+	do
+	    # the --time-phases report's total line and peak RSS line
+	    "$COMPILER" --stage="$stage" --time-phases "$input" \
+		2>"$BENCHDIR/report" >/dev/null \
+		|| { cat "$BENCHDIR/report" >&2; exit 1; }
+	    awk -v shape="$shape" -v n="$n" -v stage="$stage" '
+		$1 == "total" { wall = $2; cpu = $3 }
+		$1 == "peak" { rss = $3 }
+		END { printf "%-8s %8d %-8s %12.3f %12.3f %14d\n",
+			     shape, n, stage, wall, cpu, rss }' \
+		"$BENCHDIR/report" | tee -a "$RESULTS"
+	done
+    done
+done
+rm -f "$BENCHDIR/report"
@@ -0,0 +1,136 @@
+/* check_pipe.c: checking declarations on another thread while parsing */
+#include <string.h>
+#include "check_pipe.h"
+#include "scope_check.h"
+#include "task_pool.h"
+#include "diagnostics.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// the checker thread, a pool with one worker, so tasks run in order
+static task_pool *checker = NULL;
+
+// the number of blocks being parsed (the program's block is number 1)
+static unsigned int open_blocks = 0;
+
+// the pieces of the program's block that are handed to the checker
+typedef struct {
+    const_decls_t cds;
+    var_decls_t vds;
+} decls_piece;
+
+// Return a copy of the size bytes at p, allocated for a task
+static void *copy_piece(const void *p, size_t size)
+{
+    void *ret = alloc_malloc_in(alloc_pipeline, size);
+    if (ret == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "check task");
+    }
+    memcpy(ret, p, size);
+    return ret;
+}
+
+// Should the checker skip the rest of the program?
+// (only the first error is reported, unless errors are collected)
+static bool stopped()
+{
+    return !diagnostics_collecting() && diagnostics_count() > 0;
+}
+
+// Check the program's declarations of constants and variables in arg
+static void check_decls(void *arg)
+{
+    decls_piece *d = (decls_piece *) arg;
+    scope_check_program_decls(d->cds, d->vds);
+    alloc_free(d);
+}
+
+// Check the procedure declaration in arg
+static void check_proc(void *arg)
+{
+    if (!stopped()) {
+	scope_check_program_proc(*(proc_decl_t *) arg);
+    }
+    alloc_free(arg);
+}
+
+// Check the program's statements in arg
+static void check_stmts(void *arg)
+{
+    if (!stopped()) {
+	scope_check_program_stmts(*(stmts_t *) arg);
+    }
+    alloc_free(arg);
+}
+
+// Requires: the symbol table is initialized and parsing has not started
+// Start the checker thread
+void check_pipe_start()
+{
+    diagnostics_defer();
+    checker = task_pool_create(1);
+}
+
+// Has check_pipe_start been called (and check_pipe_finish not yet)?
+bool check_pipe_running()
+{
+    return checker != NULL;
+}
+
+// Note that a block's "begin" has been parsed
+void check_pipe_block_begin()
+{
+    if (checker != NULL) {
+	open_blocks++;
+    }
+}
+
+// Note that the current block's declarations of constants and variables,
+// cds and vds, have been parsed
+void check_pipe_block_decls(const_decls_t cds, var_decls_t vds)
+{
+    if (checker != NULL && open_blocks == 1) {
+	decls_piece d = { cds, vds };
+	task_pool_submit(checker, check_decls, copy_piece(&d, sizeof(d)));
+    }
+}
+
+// Note that the procedure declaration pd has been parsed
+void check_pipe_proc_decl(proc_decl_t pd)
+{
+    // its block has ended, so the current block is the one it is in
+    if (checker != NULL && open_blocks == 1) {
+	task_pool_submit(checker, check_proc, copy_piece(&pd, sizeof(pd)));
+    }
+}
+
+// Note that the current block has been parsed, ending with statements stmts
+void check_pipe_block_end(stmts_t stmts)
+{
+    if (checker == NULL) {
+	return;
+    }
+    if (open_blocks == 1) {
+	task_pool_submit(checker, check_stmts,
+			 copy_piece(&stmts, sizeof(stmts)));
+    }
+    open_blocks--;
+}
+
+// Note that error recovery has discarded the current (partial) block
+void check_pipe_block_discarded()
+{
+    if (checker != NULL) {
+	open_blocks--;
+    }
+}
+
+// Wait for the checker thread to check everything handed to it
+// and stop it (if it was started)
+void check_pipe_finish()
+{
+    if (checker != NULL) {
+	task_pool_destroy(checker);
+	checker = NULL;
+    }
+}
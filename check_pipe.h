@@ -0,0 +1,46 @@
+/* check_pipe.h: checking declarations on another thread while parsing */
+#ifndef _CHECK_PIPE_H
+#define _CHECK_PIPE_H
+#include <stdbool.h>
+#include "ast.h"
+
+// After check_pipe_start, the parser's semantic actions call the
+// functions below to hand each finished piece of the program's block
+// (its declarations of constants and variables, each procedure declared
+// in it, and its statements) to a checker thread, which checks them
+// in order with scope_check_program_decls, scope_check_program_proc
+// and scope_check_program_stmts.  As the pieces are checked in the order
+// they are parsed, each procedure is checked in the symbol table as it
+// was when the procedure was declared, while the parser goes on.
+// Errors are deferred (see diagnostics.h), so they are still reported
+// after any syntax errors and the unparsed program.
+// When the checker thread is not started, these functions do nothing.
+
+// Requires: the symbol table is initialized and parsing has not started
+// Start the checker thread
+extern void check_pipe_start();
+
+// Has check_pipe_start been called (and check_pipe_finish not yet)?
+extern bool check_pipe_running();
+
+// Note that a block's "begin" has been parsed
+extern void check_pipe_block_begin();
+
+// Note that the current block's declarations of constants and variables,
+// cds and vds, have been parsed
+extern void check_pipe_block_decls(const_decls_t cds, var_decls_t vds);
+
+// Note that the procedure declaration pd has been parsed
+extern void check_pipe_proc_decl(proc_decl_t pd);
+
+// Note that the current block has been parsed, ending with statements stmts
+extern void check_pipe_block_end(stmts_t stmts);
+
+// Note that error recovery has discarded the current (partial) block
+extern void check_pipe_block_discarded();
+
+// Wait for the checker thread to check everything handed to it
+// and stop it (if it was started)
+extern void check_pipe_finish();
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "parser.h"
 #include "lexer.h"
 #include "ast.h"
@@ -7,41 +8,345 @@
 #include "scope_check.h"
 #include "utilities.h"
 #include "unparser.h"
+#include "proc_cache.h"
+#include "flat_ast.h"
+#include "ast_image.h"
+#include "task_pool.h"
+#include "phase_stats.h"
+#include "alloc_stats.h"
+#include "trace.h"
+#include "symtab_stats.h"
+#include "diagnostics.h"
+#include "ast_stream.h"
+#include "lex_pipe.h"
+#include "check_pipe.h"
 
 /* Print a usage message on stderr 
    and exit with failure. */
 static void usage(const char *cmdname)
 {
     fprintf(stderr,
-	    "Usage: %s file.spl\n",
-	    cmdname);
+	    "Usage: %s [options] file.spl\n"
+	    "   or: %s [options] --load-ast=FILE\n"
+	    "Options:\n"
+	    "  --cache=DIR      reuse per-procedure results cached in DIR\n"
+	    "  --emit-ast=FILE  write the parsed AST to FILE as an AST image\n"
+	    "  --load-ast=FILE  use the AST image in FILE instead of parsing\n"
+	    "  --flat           unparse and check a flat copy of the AST\n"
+	    "  --jobs=N         unparse and check procedures in parallel\n"
+	    "                   on N threads\n"
+	    "                   (N = 0 means one per processor)\n"
+	    "  --stage=STAGE    stop after STAGE, one of: parse (only parse),\n"
+	    "                   unparse (do not check), check (do not unparse),\n"
+	    "                   all (the default)\n"
+	    "  --time-phases    print the time and allocations of each phase\n"
+	    "                   on stderr\n"
+	    "  --alloc-stats    print the memory allocated for each AST type\n"
+	    "                   and subsystem on stderr at exit\n"
+	    "  --trace=FILE     write a Chrome/Perfetto trace of the phases\n"
+	    "                   and of each procedure to FILE\n"
+	    "  --symtab-stats   print symbol table lookup statistics\n"
+	    "                   on stderr at exit\n"
+	    "  --persistent-symtab  keep the symbol table's scopes in persistent\n"
+	    "                   hash tries, whose snapshots cost O(1)\n"
+	    "  --all-errors     report all syntax errors, then all declaration\n"
+	    "                   errors (sorted by line), not just the first\n"
+	    "  --one-pass       check declarations while parsing, instead of\n"
+	    "                   in a separate pass over the AST\n"
+	    "  --stream         unparse and check each procedure as soon as\n"
+	    "                   it is parsed, then free its AST (implies\n"
+	    "                   --one-pass, only with --stage=all)\n"
+	    "  --pipeline       lex on one thread, parse on another, and check\n"
+	    "                   each procedure declared in the program's block\n"
+	    "                   on a third as soon as it is parsed\n",
+	    cmdname, cmdname);
     exit(EXIT_FAILURE);
 }
 
+/* The stages that can be selected with --stage */
+typedef enum { stage_parse, stage_unparse, stage_check, stage_all } stage_kind;
+
+/* Return the stage named name, or use the usage message if there is none */
+static stage_kind stage_named(const char *cmdname, const char *name)
+{
+    static const char *names[] = { "parse", "unparse", "check", "all" };
+    for (int i = 0; i <= stage_all; i++) {
+	if (strcmp(name, names[i]) == 0) {
+	    return (stage_kind) i;
+	}
+    }
+    usage(cmdname);
+    return stage_all;
+}
+
+/* Return the size in bytes of the file named fname (0 if unknown) */
+static size_t file_size(const char *fname)
+{
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) {
+	return 0;
+    }
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+	size = ftell(f);
+    }
+    fclose(f);
+    return (size < 0) ? 0 : (size_t) size;
+}
+
+/* Print the --time-phases report (if asked for) for the input file fname */
+static void report_phases(const char *fname)
+{
+    if (phase_stats_enabled()) {
+	phase_stats_report(stderr, file_size(fname));
+    }
+}
+
+/* Print the --symtab-stats report (called at exit) */
+static void report_symtab()
+{
+    symtab_stats_report(stderr);
+}
+
+/* Start phase p, which is traced as a span named span */
+static void begin_phase(phase_kind p, const char *span)
+{
+    phase_stats_begin(p);
+    trace_begin(span, NULL);
+}
+
+/* End phase p, which was started by begin_phase */
+static void end_phase(phase_kind p)
+{
+    trace_end();
+    phase_stats_end(p);
+}
+
+/* Wait for the checking done on its own thread (see --pipeline), if any */
+static void finish_pipelined_check()
+{
+    if (check_pipe_running()) {
+	begin_phase(phase_check, "check_pipe_finish");
+	check_pipe_finish();
+	end_phase(phase_check);
+    }
+}
+
+/* If there were syntax errors or errors were saved (see --all-errors),
+   print the saved errors and exit with failure */
+static void report_errors()
+{
+    if (diagnostics_count() > 0 || parseErrorCount() > 0) {
+	diagnostics_report(stderr);
+	exit(EXIT_FAILURE);
+    }
+}
+
+/* Print the --alloc-stats report (called at exit) */
+static void report_allocs()
+{
+    alloc_stats_report(stderr);
+}
+
 int main(int argc, char *argv[])
 {
     const char *cmdname = argv[0];
-    --argc;
+    const char *emit_ast_name = NULL;
+    const char *load_ast_name = NULL;
+    bool use_flat = false;
+    bool one_pass = false;
+    bool stream = false;
+    bool pipeline = false;
+    int jobs = 1;
+    stage_kind stage = stage_all;
+    int argi = 1;
+    /* options come before the file name */
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+	const char *opt = argv[argi];
+	if (strncmp(opt, "--cache=", strlen("--cache=")) == 0) {
+	    proc_cache_initialize(opt + strlen("--cache="));
+	} else if (strncmp(opt, "--emit-ast=", strlen("--emit-ast=")) == 0) {
+	    emit_ast_name = opt + strlen("--emit-ast=");
+	} else if (strncmp(opt, "--load-ast=", strlen("--load-ast=")) == 0) {
+	    load_ast_name = opt + strlen("--load-ast=");
+	} else if (strcmp(opt, "--flat") == 0) {
+	    use_flat = true;
+	} else if (strncmp(opt, "--jobs=", strlen("--jobs=")) == 0) {
+	    char *end;
+	    long n = strtol(opt + strlen("--jobs="), &end, 10);
+	    if (*end != '\0' || end == opt + strlen("--jobs=")
+		|| n < 0 || n > 1024) {
+		usage(cmdname);
+	    }
+	    jobs = (n == 0) ? task_pool_cpu_count() : (int) n;
+	} else if (strncmp(opt, "--stage=", strlen("--stage=")) == 0) {
+	    stage = stage_named(cmdname, opt + strlen("--stage="));
+	} else if (strcmp(opt, "--time-phases") == 0) {
+	    phase_stats_enable();
+	} else if (strcmp(opt, "--alloc-stats") == 0) {
+	    /* nothing has been allocated yet */
+	    alloc_stats_track();
+	    atexit(report_allocs);
+	} else if (strcmp(opt, "--symtab-stats") == 0) {
+	    symtab_stats_enable();
+	    atexit(report_symtab);
+	} else if (strcmp(opt, "--persistent-symtab") == 0) {
+	    symtab_use_persistent();
+	} else if (strcmp(opt, "--one-pass") == 0) {
+	    one_pass = true;
+	} else if (strcmp(opt, "--stream") == 0) {
+	    stream = true;
+	} else if (strcmp(opt, "--pipeline") == 0) {
+	    pipeline = true;
+	} else if (strcmp(opt, "--all-errors") == 0) {
+	    diagnostics_collect();
+	} else if (strncmp(opt, "--trace=", strlen("--trace=")) == 0) {
+	    trace_open(opt + strlen("--trace="));
+	    atexit(trace_close);
+	} else {
+	    usage(cmdname);
+	}
+    }
+
+    /* streaming needs the AST to come from the parser, a piece at a time */
+    if (stream && (stage != stage_all || use_flat || emit_ast_name != NULL
+		   || load_ast_name != NULL)) {
+	usage(cmdname);
+    }
+    /* the pipeline's threads share the lexer's and parser's allocations,
+       which streaming frees */
+    if (pipeline && (stream || load_ast_name != NULL)) {
+	usage(cmdname);
+    }
+
+    if (load_ast_name != NULL) {
+	/* no source file, the image replaces lexing and parsing */
+	if (argc != argi || emit_ast_name != NULL) {
+	    usage(cmdname);
+	}
+	begin_phase(phase_parse, "ast_image_map");
+	flat_ast *img = ast_image_map(load_ast_name);
+	end_phase(phase_parse);
+	if (stage == stage_unparse || stage == stage_all) {
+	    begin_phase(phase_unparse, "unparseFlat");
+	    unparseFlat(stdout, img);
+	    end_phase(phase_unparse);
+	}
+	if (stage == stage_check || stage == stage_all) {
+	    begin_phase(phase_check, "scope_check_flat");
+	    symtab_initialize();
+	    scope_check_flat(img);
+	    end_phase(phase_check);
+	    report_errors();
+	}
+	ast_image_unmap(img);
+	report_phases(load_ast_name);
+	return EXIT_SUCCESS;
+    }
+
     /* 1 non-option argument */
-    if (argc != 1 || argv[1][0] == '-') {
+    if (argc - argi != 1) {
 	    usage(cmdname);
     }
+    char *file_name = argv[argi];
 
-    lexer_init(argv[1]);
+    // with --one-pass (or --stream), the parser also does the checking
+    bool check = (stage == stage_check || stage == stage_all);
+    if ((one_pass || stream) && check) {
+	symtab_initialize();
+	scope_check_one_pass_enable();
+	check = false;
+    }
+    // with --stream, the parser also does the unparsing
+    if (stream) {
+	ast_stream_enable(stdout);
+    }
+    // with --pipeline, the parser hands what it parses to a checker thread
+    if (pipeline && check) {
+	symtab_initialize();
+	check_pipe_start();
+	check = false;
+    }
 
-    // parsing
-    block_t progast = parseProgram(argv[1]);
+    // parsing (which includes the lexing, the lexer is timed separately)
+    begin_phase(phase_parse, "parse");
+    trace_begin("lexer_init", NULL);
+    lexer_init(file_name);
+    if (pipeline) {
+	lex_pipe_start();
+    }
+    trace_end();
+    trace_begin("yyparse", NULL);
+    block_t progast = parseProgram(file_name);
+    if (pipeline) {
+	lex_pipe_finish();
+    }
+    trace_end();
+    // the streamed text is only printed once the parser has accepted
+    // the whole program, as a syntax error may follow its final "."
+    if (stream) {
+	ast_stream_program_end();
+    }
+    // after syntax errors (see --all-errors) the partial AST is checked,
+    // but not unparsed
+    bool unparse = (stage == stage_unparse || stage == stage_all)
+	&& parseErrorCount() == 0 && !stream;
+
+    if (use_flat || emit_ast_name != NULL) {
+	trace_begin("flat_ast_build", NULL);
+	flat_ast *fa = flat_ast_build(progast);
+	trace_end();
+	if (emit_ast_name != NULL) {
+	    ast_image_write(emit_ast_name, fa);
+	}
+	if (use_flat) {
+	    end_phase(phase_parse);
+	    if (unparse) {
+		begin_phase(phase_unparse, "unparseFlat");
+		unparseFlat(stdout, fa);
+		end_phase(phase_unparse);
+	    }
+	    if (check) {
+		begin_phase(phase_check, "scope_check_flat");
+		symtab_initialize();
+		scope_check_flat(fa);
+		end_phase(phase_check);
+	    }
+	    finish_pipelined_check();
+	    report_errors();
+	    report_phases(file_name);
+	    return EXIT_SUCCESS;
+	}
+	flat_ast_free(fa);
+    }
+    end_phase(phase_parse);
 
     // unparse to check on the AST
-    unparseProgram(stdout, progast);
+    if (unparse) {
+	begin_phase(phase_unparse, "unparseProgram");
+	if (jobs > 1) {
+	    unparseProgramParallel(stdout, progast, jobs);
+	} else {
+	    unparseProgram(stdout, progast);
+	}
+	end_phase(phase_unparse);
+    }
+
+    if (check) {
+	begin_phase(phase_check, "scope_check_program");
 
-    // comment out the next two commands to disable declaration checking
+	// building symbol table
+	symtab_initialize();
+	scope_check_parallel_enable(jobs);
 
-    // building symbol table
-    symtab_initialize();
+	// check for duplicate declarations
+	scope_check_program(progast);
 
-    // check for duplicate declarations
-    scope_check_program(progast);
+	end_phase(phase_check);
+    }
+    finish_pipelined_check();
+    report_errors();
 
+    report_phases(file_name);
     return EXIT_SUCCESS;
 }
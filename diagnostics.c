@@ -0,0 +1,165 @@
+/* diagnostics.c: reporting errors in the program being compiled */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "diagnostics.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// A saved error
+typedef struct {
+    file_location floc;
+    unsigned int group;  // see diagnostics_set_group
+    unsigned int seq;    // the number of errors reported before this one
+    char *msg;
+} diagnostic;
+
+static bool collecting = false;
+static bool deferring = false;
+static _Thread_local unsigned int group = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;  // protects these:
+static diagnostic *saved = NULL;
+static unsigned int saved_count = 0;
+static unsigned int saved_capacity = 0;
+
+// Save the errors reported by prog_error instead of exiting
+void diagnostics_collect()
+{
+    collecting = true;
+}
+
+// Are errors being saved?
+bool diagnostics_collecting()
+{
+    return collecting;
+}
+
+// Save the errors reported by prog_error, but only report the first one
+void diagnostics_defer()
+{
+    deferring = true;
+}
+
+// Make the errors that the calling thread reports from now on belong to
+// group g (threads start in group 0).  Saved errors are ordered by group
+// before the order they were reported in, so threads checking different
+// parts of a program at once can number the parts in source order.
+void diagnostics_set_group(unsigned int g)
+{
+    group = g;
+}
+
+// Requires: fmt != NULL
+// Report an error at floc with a message formatted as in printf.
+// If errors are being saved or deferred, save the message and return,
+// otherwise print it as bail_with_prog_error does and exit.
+void prog_error(file_location floc, const char *fmt, ...)
+{
+    // the message is formatted once to find its length, then into msg
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0) {
+	bail_with_error("Unable to format a diagnostic!");
+    }
+    char *msg = (char *) alloc_malloc_in(alloc_diagnostics, (size_t) len + 1);
+    if (msg == NULL) {
+	bail_with_error("Unable to allocate space for a diagnostic!");
+    }
+    va_start(args, fmt);
+    vsnprintf(msg, (size_t) len + 1, fmt, args);
+    va_end(args);
+
+    if (!collecting && !deferring) {
+	bail_with_prog_error(floc, "%s", msg);
+    }
+
+    pthread_mutex_lock(&lock);
+    if (saved_count == saved_capacity) {
+	saved_capacity = (saved_capacity == 0) ? 16 : 2 * saved_capacity;
+	saved = (diagnostic *) alloc_realloc_in(alloc_diagnostics, saved,
+						saved_capacity * sizeof(diagnostic));
+	if (saved == NULL) {
+	    bail_with_error("Unable to allocate space for diagnostics!");
+	}
+    }
+    saved[saved_count].floc = floc;
+    saved[saved_count].group = group;
+    saved[saved_count].seq = saved_count;
+    saved[saved_count].msg = msg;
+    saved_count++;
+    pthread_mutex_unlock(&lock);
+}
+
+// Return the number of errors saved so far
+unsigned int diagnostics_count()
+{
+    pthread_mutex_lock(&lock);
+    unsigned int ret = saved_count;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+// Compare diagnostics by group, then order of reporting
+static int compare_reported(const diagnostic *d1, const diagnostic *d2)
+{
+    if (d1->group != d2->group) {
+	return (d1->group < d2->group) ? -1 : 1;
+    }
+    return (d1->seq < d2->seq) ? -1 : (d1->seq > d2->seq);
+}
+
+// Compare diagnostics by file name, then line, then as compare_reported
+static int compare_diagnostics(const void *a, const void *b)
+{
+    const diagnostic *d1 = a;
+    const diagnostic *d2 = b;
+    int c = strcmp(d1->floc.filename, d2->floc.filename);
+    if (c != 0) {
+	return c;
+    }
+    if (d1->floc.line != d2->floc.line) {
+	return (d1->floc.line < d2->floc.line) ? -1 : 1;
+    }
+    return compare_reported(d1, d2);
+}
+
+// Requires: out != NULL
+// Print the saved errors on out, sorted by file name and line
+// (by group and then in the order they were reported, for errors on
+// the same line), each in the form bail_with_prog_error uses,
+// and forget them.  If errors are only being deferred, print just
+// the first one (the first reported in the lowest group).
+void diagnostics_report(FILE *out)
+{
+    fflush(stdout); // so errors come after the output so far
+    pthread_mutex_lock(&lock);
+    unsigned int count = saved_count;
+    if (collecting && saved_count > 0) {
+	qsort(saved, saved_count, sizeof(diagnostic), compare_diagnostics);
+    } else if (saved_count > 0) {
+	// move the first one to saved[0]
+	for (unsigned int i = 1; i < saved_count; i++) {
+	    if (compare_reported(&saved[i], &saved[0]) < 0) {
+		diagnostic d = saved[0];
+		saved[0] = saved[i];
+		saved[i] = d;
+	    }
+	}
+	count = 1;
+    }
+    for (unsigned int i = 0; i < saved_count; i++) {
+	if (i < count) {
+	    fprintf(out, "%s: line %d %s\n", saved[i].floc.filename,
+		    saved[i].floc.line, saved[i].msg);
+	}
+	alloc_free(saved[i].msg);
+    }
+    alloc_free(saved);
+    saved = NULL;
+    saved_count = 0;
+    saved_capacity = 0;
+    pthread_mutex_unlock(&lock);
+}
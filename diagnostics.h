@@ -0,0 +1,51 @@
+/* diagnostics.h: reporting errors in the program being compiled */
+#ifndef _DIAGNOSTICS_H
+#define _DIAGNOSTICS_H
+#include <stdio.h>
+#include <stdbool.h>
+#include "file_location.h"
+
+// By default, prog_error reports an error in the program like
+// bail_with_prog_error, so compilation stops at the first one.
+// After diagnostics_collect is called, errors are instead saved,
+// so that checking can go on and find the others; the caller should
+// then print them with diagnostics_report before exiting.
+// After diagnostics_defer is called, errors are also saved, but
+// diagnostics_report prints only the first one reported
+// (unless they are being collected), so that a checker can run
+// ahead of output that should come before its first error.
+// These functions may be called by several threads at once.
+
+// Save the errors reported by prog_error instead of exiting
+extern void diagnostics_collect();
+
+// Are errors being saved?
+extern bool diagnostics_collecting();
+
+// Save the errors reported by prog_error, but only report the first one
+extern void diagnostics_defer();
+
+// Make the errors that the calling thread reports from now on belong to
+// group g (threads start in group 0).  Saved errors are ordered by group
+// before the order they were reported in, so threads checking different
+// parts of a program at once can number the parts in source order.
+extern void diagnostics_set_group(unsigned int g);
+
+// Requires: fmt != NULL
+// Report an error at floc with a message formatted as in printf.
+// If errors are being saved or deferred, save the message and return,
+// otherwise print it as bail_with_prog_error does and exit.
+extern void prog_error(file_location floc, const char *fmt, ...);
+
+// Return the number of errors saved so far
+extern unsigned int diagnostics_count();
+
+// Requires: out != NULL
+// Print the saved errors on out, sorted by file name and line
+// (by group and then in the order they were reported, for errors on
+// the same line), each in the form bail_with_prog_error uses,
+// and forget them.  If errors are only being deferred, print just
+// the first one (the first reported in the lowest group).
+extern void diagnostics_report(FILE *out);
+
+#endif
@@ -0,0 +1,136 @@
+/* digest.c: SHA-256 digests, for keys that must not collide */
+#include <string.h>
+#include "digest.h"
+
+// The round constants of SHA-256 (FIPS 180-4, section 4.2.2)
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Add the 64 bytes in ctx->block to the state in ctx
+static void compress(digest_ctx *ctx)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+	const unsigned char *p = ctx->block + 4 * i;
+	w[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+	    | ((uint32_t) p[2] << 8) | p[3];
+    }
+    for (int i = 16; i < 64; i++) {
+	uint32_t s0 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+	uint32_t s1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+	w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2],
+	d = ctx->state[3], e = ctx->state[4], f = ctx->state[5],
+	g = ctx->state[6], h = ctx->state[7];
+    for (int i = 0; i < 64; i++) {
+	uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25))
+	    + ((e & f) ^ (~e & g)) + K[i] + w[i];
+	uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+	    + ((a & b) ^ (a & c) ^ (b & c));
+	h = g;
+	g = f;
+	f = e;
+	e = d + t1;
+	d = c;
+	c = b;
+	b = a;
+	a = t1 + t2;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+// Requires: ctx != NULL
+// Start a new digest in ctx
+void digest_init(digest_ctx *ctx)
+{
+    static const uint32_t initial[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->len = 0;
+}
+
+// Requires: ctx was started by digest_init and data points to len bytes
+// Add the len bytes at data to the digest in ctx
+void digest_add(digest_ctx *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    while (len > 0) {
+	size_t used = ctx->len % sizeof(ctx->block);
+	size_t n = sizeof(ctx->block) - used;
+	if (n > len) {
+	    n = len;
+	}
+	memcpy(ctx->block + used, p, n);
+	ctx->len += n;
+	p += n;
+	len -= n;
+	if (ctx->len % sizeof(ctx->block) == 0) {
+	    compress(ctx);
+	}
+    }
+}
+
+// Requires: ctx was started by digest_init
+// Return the digest of the bytes added to ctx (after which ctx
+// must be started again before it is used)
+digest digest_finish(digest_ctx *ctx)
+{
+    // pad with a 1 bit, then 0 bits up to 8 bytes short of a block,
+    // then the length in bits (big-endian)
+    uint64_t bits = ctx->len * 8;
+    static const unsigned char one = 0x80;
+    static const unsigned char zero = 0;
+    digest_add(ctx, &one, 1);
+    while (ctx->len % sizeof(ctx->block) != sizeof(ctx->block) - 8) {
+	digest_add(ctx, &zero, 1);
+    }
+    unsigned char len_bytes[8];
+    for (int i = 0; i < 8; i++) {
+	len_bytes[i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    digest_add(ctx, len_bytes, sizeof(len_bytes));
+
+    digest ret;
+    for (int i = 0; i < 8; i++) {
+	ret.bytes[4 * i] = (unsigned char) (ctx->state[i] >> 24);
+	ret.bytes[4 * i + 1] = (unsigned char) (ctx->state[i] >> 16);
+	ret.bytes[4 * i + 2] = (unsigned char) (ctx->state[i] >> 8);
+	ret.bytes[4 * i + 3] = (unsigned char) ctx->state[i];
+    }
+    return ret;
+}
+
+// Are d1 and d2 the same digest?
+bool digest_equal(digest d1, digest d2)
+{
+    return memcmp(d1.bytes, d2.bytes, DIGEST_SIZE) == 0;
+}
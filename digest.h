@@ -0,0 +1,39 @@
+/* digest.h: SHA-256 digests, for keys that must not collide */
+#ifndef _DIGEST_H
+#define _DIGEST_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DIGEST_SIZE 32
+
+// A SHA-256 digest; unlike hash_bytes (see utilities.h), two different
+// inputs can be assumed never to have the same digest
+typedef struct {
+    unsigned char bytes[DIGEST_SIZE];
+} digest;
+
+// The state of a digest being computed
+typedef struct {
+    uint32_t state[8];
+    uint64_t len;             // number of bytes added so far
+    unsigned char block[64];  // the bytes of the block being filled
+} digest_ctx;
+
+// Requires: ctx != NULL
+// Start a new digest in ctx
+extern void digest_init(digest_ctx *ctx);
+
+// Requires: ctx was started by digest_init and data points to len bytes
+// Add the len bytes at data to the digest in ctx
+extern void digest_add(digest_ctx *ctx, const void *data, size_t len);
+
+// Requires: ctx was started by digest_init
+// Return the digest of the bytes added to ctx (after which ctx
+// must be started again before it is used)
+extern digest digest_finish(digest_ctx *ctx);
+
+// Are d1 and d2 the same digest?
+extern bool digest_equal(digest d1, digest d2);
+
+#endif
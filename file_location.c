@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include "file_location.h"
 #include "utilities.h"
+#include "alloc_stats.h"
+#include "arena.h"
 
 // Requires: filename != NULL
 // Return a (pointer to a) fresh file_location with the given
@@ -11,7 +13,8 @@
 file_location *file_location_make(const char *filename,
 					 unsigned int line)
 {
-    file_location *ret = (file_location *) malloc(sizeof(file_location));
+    file_location *ret = (file_location *) arena_alloc(alloc_file_location,
+						       sizeof(file_location));
     if (ret == NULL) {
 	bail_with_error("Could not allocate space for a file_location!");
     }
@@ -24,7 +27,8 @@ file_location *file_location_make(const char *filename,
 // Return a (pointer to a) fresh copy of fl
 file_location *file_location_copy(file_location *fl)
 {
-    file_location *ret = (file_location *) malloc(sizeof(file_location));
+    file_location *ret = (file_location *) arena_alloc(alloc_file_location,
+						       sizeof(file_location));
     if (ret == NULL) {
 	bail_with_error("Could not allocate space for a file_location!");
     }
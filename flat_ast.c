@@ -0,0 +1,346 @@
+/* flat_ast.c: a flat, index-based form of the AST for fast traversals */
+#include <stdlib.h>
+#include <string.h>
+#include "flat_ast.h"
+#include "ast_visit.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// A node being built whose children are not all built yet
+typedef struct {
+    uint32_t node;  // its index
+    uint32_t last;  // the index of its last child so far, or FLAT_NONE
+} open_node;
+
+// The state used while building a flat AST
+typedef struct {
+    flat_node *nodes;
+    uint32_t *lines;
+    uint32_t node_count;
+    uint32_t node_cap;
+    char *strtab;
+    uint32_t str_size;
+    uint32_t str_cap;
+    // open addressing hash table of (string offset + 1), 0 if empty
+    uint32_t *slots;
+    uint32_t slot_cap; // a power of 2
+    uint32_t str_count;
+    // the nodes whose children are being built, innermost last
+    unsigned int open_count;
+    unsigned int open_cap;
+    open_node *open;
+} flat_builder;
+
+// Return the line number of floc, or 0 if there is none
+static uint32_t line_of(file_location *floc)
+{
+    return (floc == NULL) ? 0 : floc->line;
+}
+
+// Add a new node to b with the given type tag, kind, line and aux value,
+// returning its index
+static uint32_t new_node(flat_builder *b, AST_type tag, unsigned int kind,
+			 file_location *floc, uint32_t aux)
+{
+    if (b->node_count == b->node_cap) {
+	b->node_cap = 2 * b->node_cap;
+	b->nodes = (flat_node *)
+	    alloc_realloc_in(alloc_flat_ast, b->nodes,
+			     b->node_cap * sizeof(flat_node));
+	b->lines = (uint32_t *)
+	    alloc_realloc_in(alloc_flat_ast, b->lines,
+			     b->node_cap * sizeof(uint32_t));
+	if (b->nodes == NULL || b->lines == NULL) {
+	    bail_with_error("Unable to allocate space for %u flat AST nodes!",
+			    b->node_cap);
+	}
+    }
+    uint32_t ret = b->node_count++;
+    flat_node *n = &b->nodes[ret];
+    n->type_tag = (uint8_t) tag;
+    n->kind = (uint8_t) kind;
+    n->reserved = 0;
+    b->lines[ret] = line_of(floc);
+    n->child = FLAT_NONE;
+    n->next = FLAT_NONE;
+    n->aux = aux;
+    return ret;
+}
+
+// Make child the next child of parent, where *lastp is parent's
+// current last child (or FLAT_NONE); *lastp is updated to child.
+// (Indexes are used, since building children may move b->nodes.)
+static void append_child(flat_builder *b, uint32_t parent, uint32_t *lastp,
+			 uint32_t child)
+{
+    if (*lastp == FLAT_NONE) {
+	b->nodes[parent].child = child;
+    } else {
+	b->nodes[*lastp].next = child;
+    }
+    *lastp = child;
+}
+
+// Double the size of b's string hash table
+static void grow_slots(flat_builder *b)
+{
+    uint32_t new_cap = 2 * b->slot_cap;
+    uint32_t *new_slots = (uint32_t *) alloc_calloc_in(alloc_flat_ast, new_cap,
+						       sizeof(uint32_t));
+    if (new_slots == NULL) {
+	bail_with_error("Unable to allocate space for the string table!");
+    }
+    for (uint32_t i = 0; i < b->slot_cap; i++) {
+	if (b->slots[i] != 0) {
+	    const char *s = b->strtab + b->slots[i] - 1;
+	    uint32_t j = hash_bytes(HASH_SEED, s, strlen(s)) & (new_cap - 1);
+	    while (new_slots[j] != 0) {
+		j = (j + 1) & (new_cap - 1);
+	    }
+	    new_slots[j] = b->slots[i];
+	}
+    }
+    alloc_free(b->slots);
+    b->slots = new_slots;
+    b->slot_cap = new_cap;
+}
+
+// Return the offset of s in b's string table, adding it if needed
+static uint32_t intern(flat_builder *b, const char *s)
+{
+    size_t len = strlen(s);
+    uint32_t i = hash_bytes(HASH_SEED, s, len) & (b->slot_cap - 1);
+    while (b->slots[i] != 0) {
+	if (strcmp(b->strtab + b->slots[i] - 1, s) == 0) {
+	    return b->slots[i] - 1;
+	}
+	i = (i + 1) & (b->slot_cap - 1);
+    }
+    while (b->str_size + len + 1 > b->str_cap) {
+	b->str_cap = 2 * b->str_cap;
+	b->strtab = (char *) alloc_realloc_in(alloc_flat_ast, b->strtab,
+					      b->str_cap);
+	if (b->strtab == NULL) {
+	    bail_with_error("Unable to allocate space for the string table!");
+	}
+    }
+    uint32_t ret = b->str_size;
+    memcpy(b->strtab + ret, s, len + 1);
+    b->str_size += len + 1;
+    b->slots[i] = ret + 1;
+    // keep the table at most half full
+    if (2 * ++b->str_count > b->slot_cap) {
+	grow_slots(b);
+    }
+    return ret;
+}
+
+// The flat AST is built by the ast_visit callbacks below, so nesting
+// depth is not limited by the C stack; their data is the flat_builder.
+
+// Add a node for n to b, as the next child of the innermost open node
+// (if any), and make it the innermost open node;
+// a const-def's number is added as its child here,
+// as ast_visit does not visit it
+static bool build_pre(void *data, ast_visit_node *n,
+		      const ast_visit_node *parent)
+{
+    flat_builder *b = (flat_builder *) data;
+    unsigned int kind = 0;
+    uint32_t aux = 0;
+    switch (n->type_tag) {
+    case const_def_ast:
+	aux = intern(b, ((const const_def_t *) n->node)->ident.name);
+	break;
+    case ident_ast:
+	aux = intern(b, ((const ident_t *) n->node)->name);
+	break;
+    case proc_decl_ast:
+	aux = intern(b, ((const proc_decl_t *) n->node)->name);
+	break;
+    case assign_stmt_ast:
+	aux = intern(b, ((const assign_stmt_t *) n->node)->name);
+	break;
+    case call_stmt_ast:
+	aux = intern(b, ((const call_stmt_t *) n->node)->name);
+	break;
+    case read_stmt_ast:
+	aux = intern(b, ((const read_stmt_t *) n->node)->name);
+	break;
+    case stmts_ast:
+	kind = ((const stmts_t *) n->node)->stmts_kind;
+	break;
+    case if_stmt_ast:
+	kind = (((const if_stmt_t *) n->node)->else_stmts != NULL);
+	break;
+    case rel_op_condition_ast:
+	aux = intern(b, ((const rel_op_condition_t *) n->node)->rel_op.text);
+	break;
+    case binary_op_expr_ast:
+	aux = intern(b, ((const binary_op_expr_t *) n->node)->arith_op.text);
+	break;
+    case number_ast:
+	aux = (uint32_t) ((const number_t *) n->node)->value;
+	break;
+    default:
+	break;
+    }
+    uint32_t ret = new_node(b, n->type_tag, kind,
+			    ((const generic_t *) n->node)->file_loc, aux);
+    if (b->open_count > 0) {
+	open_node *top = &b->open[b->open_count - 1];
+	append_child(b, top->node, &top->last, ret);
+    }
+    b->open = ast_list_grow(alloc_flat_ast, b->open, b->open_count,
+			    &b->open_cap, sizeof(open_node));
+    open_node *mine = &b->open[b->open_count++];
+    mine->node = ret;
+    mine->last = FLAT_NONE;
+    if (n->type_tag == const_def_ast) {
+	const number_t *num = &((const const_def_t *) n->node)->number;
+	append_child(b, ret, &mine->last,
+		     new_node(b, number_ast, 0, num->file_loc,
+			      (uint32_t) num->value));
+    }
+    return true;
+}
+
+// Finish the innermost open node of b, whose children are all built
+static void build_post(void *data, const ast_visit_node *n,
+		       const ast_visit_node *parent)
+{
+    ((flat_builder *) data)->open_count--;
+}
+
+static const ast_visitor build_visitor = {
+    .pre = {
+	[block_ast] = build_pre,
+	[const_decl_ast] = build_pre,
+	[const_def_ast] = build_pre,
+	[var_decl_ast] = build_pre,
+	[proc_decl_ast] = build_pre,
+	[stmts_ast] = build_pre,
+	[assign_stmt_ast] = build_pre,
+	[call_stmt_ast] = build_pre,
+	[if_stmt_ast] = build_pre,
+	[while_stmt_ast] = build_pre,
+	[read_stmt_ast] = build_pre,
+	[print_stmt_ast] = build_pre,
+	[block_stmt_ast] = build_pre,
+	[db_condition_ast] = build_pre,
+	[rel_op_condition_ast] = build_pre,
+	[binary_op_expr_ast] = build_pre,
+	[negated_expr_ast] = build_pre,
+	[ident_ast] = build_pre,
+	[number_ast] = build_pre,
+    },
+    .post = {
+	[block_ast] = build_post,
+	[const_decl_ast] = build_post,
+	[const_def_ast] = build_post,
+	[var_decl_ast] = build_post,
+	[proc_decl_ast] = build_post,
+	[stmts_ast] = build_post,
+	[assign_stmt_ast] = build_post,
+	[call_stmt_ast] = build_post,
+	[if_stmt_ast] = build_post,
+	[while_stmt_ast] = build_post,
+	[read_stmt_ast] = build_post,
+	[print_stmt_ast] = build_post,
+	[block_stmt_ast] = build_post,
+	[db_condition_ast] = build_post,
+	[rel_op_condition_ast] = build_post,
+	[binary_op_expr_ast] = build_post,
+	[negated_expr_ast] = build_post,
+	[ident_ast] = build_post,
+	[number_ast] = build_post,
+    },
+};
+
+// Return a freshly allocated flat AST for the program AST prog.
+// If there is no space, bail with an error message,
+// so this should never return NULL.
+flat_ast *flat_ast_build(block_t prog)
+{
+    flat_builder b;
+    b.node_cap = 1024;
+    b.nodes = (flat_node *) alloc_malloc_in(alloc_flat_ast,
+					    b.node_cap * sizeof(flat_node));
+    b.lines = (uint32_t *) alloc_malloc_in(alloc_flat_ast,
+					   b.node_cap * sizeof(uint32_t));
+    b.str_cap = 4096;
+    b.strtab = (char *) alloc_malloc_in(alloc_flat_ast, b.str_cap);
+    b.slot_cap = 256;
+    b.slots = (uint32_t *) alloc_calloc_in(alloc_flat_ast, b.slot_cap,
+					   sizeof(uint32_t));
+    flat_ast *ret = (flat_ast *) alloc_malloc_in(alloc_flat_ast,
+						 sizeof(flat_ast));
+    if (b.nodes == NULL || b.lines == NULL || b.strtab == NULL
+	|| b.slots == NULL || ret == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "flat_ast");
+    }
+    b.str_size = 0;
+    b.str_count = 0;
+    b.open_count = 0;
+    b.open_cap = 0;
+    b.open = NULL;
+    // node 0 stands for "no node"
+    b.node_count = 0;
+    new_node(&b, empty_ast, 0, NULL, 0);
+
+    uint32_t filename = intern(&b, (prog.file_loc == NULL) ? ""
+			       : prog.file_loc->filename);
+    ret->root = b.node_count;
+    ast_visit(&build_visitor, &b, block_ast, &prog, 0);
+    alloc_free(b.open);
+    alloc_free(b.slots);
+    ret->nodes = b.nodes;
+    ret->lines = b.lines;
+    ret->node_count = b.node_count;
+    ret->strtab = b.strtab;
+    ret->strtab_size = b.str_size;
+    ret->filename = b.strtab + filename;
+    return ret;
+}
+
+// Requires: fa was returned by flat_ast_build
+// Free fa and all of its tables.
+void flat_ast_free(flat_ast *fa)
+{
+    alloc_free((void *) fa->nodes);
+    alloc_free((void *) fa->lines);
+    alloc_free((void *) fa->strtab);
+    alloc_free(fa);
+}
+
+// Requires: fa != NULL
+// Return the node at index i of fa, bailing with an error
+// if i is not a valid node index.
+const flat_node *flat_ast_node_at(const flat_ast *fa, uint32_t i)
+{
+    if (i == FLAT_NONE || i >= fa->node_count) {
+	bail_with_error("Invalid node index (%u) in flat AST!", i);
+    }
+    return &fa->nodes[i];
+}
+
+// Requires: fa != NULL
+// Return the string at offset off in fa's string table, bailing
+// with an error if off is not a valid offset.
+const char *flat_ast_str(const flat_ast *fa, uint32_t off)
+{
+    if (off >= fa->strtab_size) {
+	bail_with_error("Invalid string offset (%u) in flat AST!", off);
+    }
+    return fa->strtab + off;
+}
+
+// Requires: fa != NULL && n is a node of fa
+// Return the source file location of n.
+file_location flat_ast_file_loc(const flat_ast *fa, const flat_node *n)
+{
+    file_location ret;
+    ret.filename = fa->filename;
+    ret.line = fa->lines[n - fa->nodes];
+    return ret;
+}
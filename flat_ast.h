@@ -0,0 +1,79 @@
+/* flat_ast.h: a flat, index-based form of the AST for fast traversals */
+#ifndef _FLAT_AST_H
+#define _FLAT_AST_H
+#include <stdint.h>
+#include "ast.h"
+#include "file_location.h"
+
+// A flat AST keeps all nodes in one array, in the order a pre-order
+// traversal visits them, so walking the tree is mostly a linear scan.
+// Nodes refer to other nodes by their index in that array and to names
+// by their byte offset in a table of NUL-terminated strings.
+// Data that traversals rarely need is kept in side tables
+// indexed like the nodes (currently just the line numbers).
+
+// node index 0 is never used, so it can mean "no node"
+#define FLAT_NONE 0
+
+// Nodes use the type tags of ast.h, with these children and aux values:
+//   block_ast: const_decl_ast*, var_decl_ast*, proc_decl_ast*, stmts_ast
+//   const_decl_ast: const_def_ast+
+//   const_def_ast: aux = name; number_ast
+//   var_decl_ast: ident_ast+
+//   proc_decl_ast: aux = name; block_ast
+//   stmts_ast: kind = stmts_kind_e; the statements
+//   assign_stmt_ast: aux = name; an expression
+//   call_stmt_ast, read_stmt_ast: aux = name
+//   if_stmt_ast: kind = 1 if it has an else; a condition, stmts_ast, [stmts_ast]
+//   while_stmt_ast: a condition, stmts_ast
+//   print_stmt_ast: an expression
+//   block_stmt_ast: block_ast
+//   db_condition_ast: two expressions
+//   rel_op_condition_ast: aux = operator text; two expressions
+//   binary_op_expr_ast: aux = operator text; two expressions
+//   negated_expr_ast: an expression
+//   ident_ast: aux = name
+//   number_ast: aux = value
+typedef struct {
+    uint8_t type_tag;   // an AST_type
+    uint8_t kind;       // see above, otherwise 0
+    uint16_t reserved;  // always 0
+    uint32_t child;     // index of the first child, or FLAT_NONE
+    uint32_t next;      // index of the next sibling, or FLAT_NONE
+    uint32_t aux;       // string offset or value, see above
+} flat_node;
+
+typedef struct {
+    const flat_node *nodes;
+    const uint32_t *lines;  // side table: lines[i] is node i's line number
+    uint32_t node_count;    // including the unused node 0
+    const char *strtab;
+    uint32_t strtab_size;   // in bytes
+    const char *filename;   // the source file's name
+    uint32_t root;          // index of the program's block node
+} flat_ast;
+
+// Return a freshly allocated flat AST for the program AST prog.
+// If there is no space, bail with an error message,
+// so this should never return NULL.
+extern flat_ast *flat_ast_build(block_t prog);
+
+// Requires: fa was returned by flat_ast_build
+// Free fa and all of its tables.
+extern void flat_ast_free(flat_ast *fa);
+
+// Requires: fa != NULL
+// Return the node at index i of fa, bailing with an error
+// if i is not a valid node index.
+extern const flat_node *flat_ast_node_at(const flat_ast *fa, uint32_t i);
+
+// Requires: fa != NULL
+// Return the string at offset off in fa's string table, bailing
+// with an error if off is not a valid offset.
+extern const char *flat_ast_str(const flat_ast *fa, uint32_t off);
+
+// Requires: fa != NULL && n is a node of fa
+// Return the source file location of n.
+extern file_location flat_ast_file_loc(const flat_ast *fa, const flat_node *n);
+
+#endif
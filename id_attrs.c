@@ -5,24 +5,55 @@
 #include "utilities.h"
 #include "id_attrs.h"
 
-// Return a freshly allocated id_attrs struct
-// with its field file_loc set to floc, kind set to k, 
-// and its offset_count set to ofst_cnt.
-// If there is no space, bail with an error message,
-// so this should never return NULL.
-extern id_attrs *create_id_attrs(file_location floc, id_kind k,
-				 unsigned int ofst_cnt)
+// Requires: ofst_cnt <= MAX_OFFSET_COUNT
+// Return the id_attrs with file location floc, kind k,
+// and offset_count ofst_cnt.
+id_attrs id_attrs_make(file_location floc, id_kind k, unsigned int ofst_cnt)
 {
-    id_attrs *ret = (id_attrs *)malloc(sizeof(id_attrs));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate id_attrs!");
-    }
-    ret->file_loc = floc;
-    ret->kind = k;
-    ret->offset_count = ofst_cnt;
+    id_attrs ret;
+    ret.filename = floc.filename;
+    ret.line = floc.line;
+    ret.kind_offset = (unsigned int) k;
+    id_attrs_set_offset_count(&ret, ofst_cnt);
+    return ret;
+}
+
+// Requires: attrs != NULL
+// Return the file location of the declaration attrs describes
+file_location id_attrs_file_loc(const id_attrs *attrs)
+{
+    file_location ret;
+    ret.filename = attrs->filename;
+    ret.line = attrs->line;
     return ret;
 }
 
+// Requires: attrs != NULL
+// Return the kind of identifier attrs describes
+id_kind id_attrs_kind(const id_attrs *attrs)
+{
+    return (id_kind) (attrs->kind_offset & ((1u << ID_KIND_BITS) - 1));
+}
+
+// Requires: attrs != NULL
+// Return the offset_count of attrs
+unsigned int id_attrs_offset_count(const id_attrs *attrs)
+{
+    return attrs->kind_offset >> ID_KIND_BITS;
+}
+
+// Requires: attrs != NULL and ofst_cnt <= MAX_OFFSET_COUNT
+// Set the offset_count of attrs to ofst_cnt
+void id_attrs_set_offset_count(id_attrs *attrs, unsigned int ofst_cnt)
+{
+    if (ofst_cnt > MAX_OFFSET_COUNT) {
+	bail_with_error("Offset count (%u) is too large for id_attrs!",
+			ofst_cnt);
+    }
+    attrs->kind_offset = (ofst_cnt << ID_KIND_BITS)
+	| (attrs->kind_offset & ((1u << ID_KIND_BITS) - 1));
+}
+
 // Return a lowercase version of the kind's name as a string
 // (i.e. if k == variable_idk, return "variable"
 //       else if k == constant_idk, return "constant",
@@ -1,28 +1,51 @@
 /* $Id: id_attrs.h,v 1.6 2023/10/15 12:32:59 leavens Exp $ */
 #ifndef _ID_ATTRS_H
 #define _ID_ATTRS_H
+#include <limits.h>
 #include "file_location.h"
 
 // kinds of entries in the symbol table
 typedef enum {constant_idk, variable_idk, procedure_idk} id_kind;
 
-// attributes of identifiers in the symbol table
+// the number of bits of an id_attrs' kind_offset that hold its kind
+#define ID_KIND_BITS 2
+
+// the largest offset_count an id_attrs can hold
+#define MAX_OFFSET_COUNT (UINT_MAX >> ID_KIND_BITS)
+
+// attributes of identifiers in the symbol table, packed into 16 bytes,
+// as scopes store them inline (use the functions below to make and read them)
 typedef struct {
-    // file_loc is the source file location of the identifier's declaration
-    file_location file_loc;
-    id_kind kind;  // kind of identifier
-    // offset_count is the number of constant or variable decls before this one
-    // in this scope
-    unsigned int offset_count;
+    // the source file name and line of the identifier's declaration
+    const char *filename;
+    unsigned int line;
+    // the kind of identifier in the low ID_KIND_BITS bits, and above them
+    // the offset_count: the number of constant or variable decls
+    // before this one in this scope
+    unsigned int kind_offset;
 } id_attrs;
 
-// Return a freshly allocated id_attrs struct
-// with its field file_loc set to floc, kind set to k, 
-// and its offset_count set to ofst_cnt.
-// If there is no space, bail with an error message,
-// so this should never return NULL.
-extern id_attrs *create_id_attrs(file_location floc, id_kind k,
-				 unsigned int ofst_cnt);
+// Requires: ofst_cnt <= MAX_OFFSET_COUNT
+// Return the id_attrs with file location floc, kind k,
+// and offset_count ofst_cnt.
+extern id_attrs id_attrs_make(file_location floc, id_kind k,
+			      unsigned int ofst_cnt);
+
+// Requires: attrs != NULL
+// Return the file location of the declaration attrs describes
+extern file_location id_attrs_file_loc(const id_attrs *attrs);
+
+// Requires: attrs != NULL
+// Return the kind of identifier attrs describes
+extern id_kind id_attrs_kind(const id_attrs *attrs);
+
+// Requires: attrs != NULL
+// Return the offset_count of attrs
+extern unsigned int id_attrs_offset_count(const id_attrs *attrs);
+
+// Requires: attrs != NULL and ofst_cnt <= MAX_OFFSET_COUNT
+// Set the offset_count of attrs to ofst_cnt
+extern void id_attrs_set_offset_count(id_attrs *attrs, unsigned int ofst_cnt);
 
 // Return a lowercase version of the kind's name as a string
 // (i.e. if k == variable_idk, return "variable"
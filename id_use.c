@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "id_use.h"
 #include "utilities.h"
+#include "alloc_stats.h"
 
 // Requires: attrs != NULL
 // Return a (pointer to a fresh) id_use struct containing the attributes
@@ -11,7 +12,7 @@
 // so this should never return NULL.
 extern id_use *id_use_create(id_attrs *attrs, unsigned int levelsOut)
 {
-    id_use *ret = (id_use *)malloc(sizeof(id_use));
+    id_use *ret = (id_use *)alloc_malloc_in(alloc_id_use, sizeof(id_use));
     if (ret == NULL) {
 	bail_with_error("No space to allocate id_use!");
     }
@@ -28,7 +29,8 @@ extern id_use *id_use_create(id_attrs *attrs, unsigned int levelsOut)
 /*
 extern lexical_address *id_use_2_lexical_address(id_use *idu)
 {
-    lexical_address *ret = (lexical_address *)malloc(sizeof(lexical_address));
+    lexical_address *ret = (lexical_address *)alloc_malloc_in(alloc_lexical_address,
+							      sizeof(lexical_address));
     if (ret == NULL) {
 	bail_with_error("No space to allocate lexical_address!");
     }
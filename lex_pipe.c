@@ -0,0 +1,189 @@
+/* lex_pipe.c: running the lexer on its own thread, ahead of the parser */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "lex_pipe.h"
+#include "lexer.h"
+#include "phase_stats.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// the number of tokens the ring holds (a power of 2)
+#define RING_SIZE 1024
+// how many times a waiting side checks the ring before yielding
+#define SPINS 64
+// the size of a cache line, to keep the two indexes apart
+#define CACHE_LINE 64
+
+// A token in the ring, with what the parser may ask the lexer about it
+typedef struct {
+    int code;
+    AST val;
+    unsigned int line;     // the lexer's line just after the token
+    const char *filename;  // the lexer's file name just after the token
+    char *errors;          // messages for lexical errors before it, or NULL
+} token_slot;
+
+typedef struct {
+    // the number of tokens ever taken, written only by the parser
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    // the number of tokens ever put in, written only by the lexer thread
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    _Alignas(CACHE_LINE) token_slot slots[RING_SIZE];
+} token_ring;
+
+// (static, so that it gets the alignment asked for above)
+static token_ring the_ring;
+static token_ring *ring = NULL;  // &the_ring while running
+static pthread_t lexer_thread;
+static _Thread_local bool is_lexer_thread = false;
+
+// the parser's copy of the line and file name of the last token it took
+static unsigned int last_line = 0;
+static const char *last_filename = NULL;
+
+// the lexical errors found since the last token was put in the ring
+// (used only by the lexer thread)
+static char *pending_errors = NULL;
+static size_t pending_length = 0;
+
+// Wait a little, after checking the ring the given number of times
+static void backoff(unsigned int *checks)
+{
+    if (++*checks >= SPINS) {
+	sched_yield();
+    }
+}
+
+// Put the token t into the ring, waiting until there is room
+static void put(const token_slot *t)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int checks = 0;
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire)
+	   == RING_SIZE) {
+	backoff(&checks);
+    }
+    ring->slots[tail & (RING_SIZE - 1)] = *t;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Take the oldest token from the ring into *t, waiting until there is one
+static void take(token_slot *t)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int checks = 0;
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+	backoff(&checks);
+    }
+    *t = ring->slots[head & (RING_SIZE - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Read all the tokens, up to the end of file, into the ring
+static void *run_lexer(void *arg)
+{
+    (void) arg;
+    is_lexer_thread = true;
+    token_slot t;
+    lexer_set_value_dest(&t.val);
+    do {
+	t.code = phase_stats_lex(yylex);
+	t.line = lexer_line();
+	t.filename = lexer_filename();
+	t.errors = pending_errors;
+	pending_errors = NULL;
+	pending_length = 0;
+	put(&t);
+    } while (t.code != 0);  // 0 is the end of file token
+    return NULL;
+}
+
+// Requires: lexer_init has been called and the lexer has not been used
+// Start the lexer thread, bailing with an error message if it cannot start.
+void lex_pipe_start()
+{
+    ring = &the_ring;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    if (pthread_create(&lexer_thread, NULL, run_lexer, NULL) != 0) {
+	bail_with_error("Cannot start the lexer thread!");
+    }
+}
+
+// Has lex_pipe_start been called (and lex_pipe_finish not yet)?
+bool lex_pipe_running()
+{
+    return ring != NULL;
+}
+
+// Is the calling thread the lexer thread?
+bool lex_pipe_on_lexer_thread()
+{
+    return is_lexer_thread;
+}
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the next token's code and put its value in *val,
+// after printing the errors the lexer found before it on stderr.
+int lex_pipe_next(AST *val)
+{
+    token_slot t;
+    take(&t);
+    if (t.errors != NULL) {
+	fflush(stdout);
+	fputs(t.errors, stderr);
+	alloc_free(t.errors);
+    }
+    last_line = t.line;
+    last_filename = t.filename;
+    *val = t.val;
+    return t.code;
+}
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the lexer's line number just after
+// the token last returned by lex_pipe_next
+unsigned int lex_pipe_line()
+{
+    return last_line;
+}
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the lexer's file name just after
+// the token last returned by lex_pipe_next
+const char *lex_pipe_filename()
+{
+    return last_filename;
+}
+
+// Requires: lex_pipe_on_lexer_thread(), filename and msg are not NULL
+// Save the lexical error msg, found at line of filename, to be printed
+// (as yyerror prints it) when the parser takes the next token
+void lex_pipe_defer_error(const char *filename, unsigned int line,
+			  const char *msg)
+{
+    int len = snprintf(NULL, 0, "%s:%u: %s\n", filename, line, msg);
+    char *errors = (char *) alloc_realloc_in(alloc_pipeline, pending_errors,
+					     pending_length + len + 1);
+    if (errors == NULL) {
+	bail_with_error("Unable to allocate space for a lexical error!");
+    }
+    snprintf(errors + pending_length, len + 1, "%s:%u: %s\n",
+	     filename, line, msg);
+    pending_errors = errors;
+    pending_length += len;
+}
+
+// Requires: lex_pipe_running() and lex_pipe_next has returned
+//           the end of file token
+// Wait for the lexer thread to end.
+void lex_pipe_finish()
+{
+    pthread_join(lexer_thread, NULL);
+    ring = NULL;
+}
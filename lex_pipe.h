@@ -0,0 +1,55 @@
+/* lex_pipe.h: running the lexer on its own thread, ahead of the parser */
+#ifndef _LEX_PIPE_H
+#define _LEX_PIPE_H
+#include <stdbool.h>
+#include "ast.h"
+
+// After lex_pipe_start, a lexer thread reads the tokens of the input
+// and puts them (with their values) into a single-producer,
+// single-consumer ring buffer, from which the parser takes them
+// with lex_pipe_next.  The ring's indexes are atomics, so neither side
+// takes a lock; a side that finds the ring empty (or full) waits
+// by yielding the processor.
+// Along with each token, the ring carries what the parser could
+// otherwise ask the lexer about after reading it: the lexer's line
+// and file name, and the messages of any lexical errors found on the way
+// to it, which lex_pipe_next prints.  So errors and their line numbers
+// come out as if the parser had called the lexer itself.
+
+// Requires: lexer_init has been called and the lexer has not been used
+// Start the lexer thread, bailing with an error message if it cannot start.
+extern void lex_pipe_start();
+
+// Has lex_pipe_start been called (and lex_pipe_finish not yet)?
+extern bool lex_pipe_running();
+
+// Is the calling thread the lexer thread?
+extern bool lex_pipe_on_lexer_thread();
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the next token's code and put its value in *val,
+// after printing the errors the lexer found before it on stderr.
+extern int lex_pipe_next(AST *val);
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the lexer's line number just after
+// the token last returned by lex_pipe_next
+extern unsigned int lex_pipe_line();
+
+// Requires: lex_pipe_running() && !lex_pipe_on_lexer_thread()
+// Return the lexer's file name just after
+// the token last returned by lex_pipe_next
+extern const char *lex_pipe_filename();
+
+// Requires: lex_pipe_on_lexer_thread(), filename and msg are not NULL
+// Save the lexical error msg, found at line of filename, to be printed
+// (as yyerror prints it) when the parser takes the next token
+extern void lex_pipe_defer_error(const char *filename, unsigned int line,
+				 const char *msg);
+
+// Requires: lex_pipe_running() and lex_pipe_next has returned
+//           the end of file token
+// Wait for the lexer thread to end.
+extern void lex_pipe_finish();
+
+#endif
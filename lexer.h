@@ -2,6 +2,7 @@
 #ifndef _LEXER_H
 #define _LEXER_H
 #include <stdbool.h>
+#include "ast.h"
 
 // Requires: fname != NULL
 // Requires: fname is the name of a readable file
@@ -18,6 +19,11 @@ extern const char *lexer_filename();
 // Return the line number of the next token
 extern unsigned int lexer_line();
 
+// Requires: dest != NULL
+// Put the value of each token the lexer returns in *dest,
+// instead of in yylval
+extern void lexer_set_value_dest(AST *dest);
+
 // On standard output:
 // Print a message about the file name of the lexer's input
 // and then print a heading for the lexer's output.
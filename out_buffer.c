@@ -0,0 +1,108 @@
+/* out_buffer.c: growable byte buffers for building output text */
+#include <stdlib.h>
+#include <string.h>
+#include "out_buffer.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// Size of the first allocation for a buffer's data
+#define INITIAL_CAPACITY 4096
+
+// A run of spaces that indentation is copied from
+static const char spaces[] =
+    "                                                                ";
+#define SPACES_LEN (sizeof(spaces) - 1)
+
+// Requires: b != NULL
+// Make b an empty buffer
+void out_buffer_init(out_buffer *b)
+{
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+// Requires: b was initialized
+// Free the space used by b, making it empty
+void out_buffer_free(out_buffer *b)
+{
+    alloc_free(b->data);
+    out_buffer_init(b);
+}
+
+// Make room in b for at least extra more bytes
+static void reserve(out_buffer *b, size_t extra)
+{
+    if (b->len + extra <= b->cap) {
+	return;
+    }
+    size_t new_cap = (b->cap == 0) ? INITIAL_CAPACITY : b->cap;
+    while (new_cap < b->len + extra) {
+	new_cap *= 2;
+    }
+    char *p = (char *) alloc_realloc_in(alloc_output, b->data, new_cap);
+    if (p == NULL) {
+	bail_with_error("Unable to allocate %zu bytes of output!", new_cap);
+    }
+    b->data = p;
+    b->cap = new_cap;
+}
+
+// Requires: b was initialized and s points to len bytes
+// Append the len bytes at s to b
+void out_buffer_write(out_buffer *b, const char *s, size_t len)
+{
+    if (len == 0) {
+	return;
+    }
+    reserve(b, len);
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+}
+
+// Requires: b was initialized and s != NULL
+// Append the NUL-terminated string s (without the NUL) to b
+void out_buffer_puts(out_buffer *b, const char *s)
+{
+    out_buffer_write(b, s, strlen(s));
+}
+
+// Requires: b was initialized
+// Append num spaces to b
+void out_buffer_spaces(out_buffer *b, int num)
+{
+    while (num > 0) {
+	size_t n = ((size_t) num < SPACES_LEN) ? (size_t) num : SPACES_LEN;
+	out_buffer_write(b, spaces, n);
+	num -= (int) n;
+    }
+}
+
+// Requires: b was initialized
+// Append the decimal form of i to b
+void out_buffer_int(out_buffer *b, int i)
+{
+    char digits[16];  // enough for a sign and the digits of any int
+    char *p = digits + sizeof(digits);
+    // work with the magnitude as unsigned, so INT_MIN is not a problem
+    unsigned int u = (i < 0) ? 0u - (unsigned int) i : (unsigned int) i;
+    do {
+	*--p = (char) ('0' + u % 10);
+	u /= 10;
+    } while (u != 0);
+    if (i < 0) {
+	*--p = '-';
+    }
+    out_buffer_write(b, p, (size_t) (digits + sizeof(digits) - p));
+}
+
+// Requires: b was initialized and out != NULL
+// Write the contents of b to out and make b empty
+// (keeping its space for reuse)
+void out_buffer_flush(out_buffer *b, FILE *out)
+{
+    if (b->len > 0 && fwrite(b->data, 1, b->len, out) != b->len) {
+	bail_with_error("Cannot write output!");
+    }
+    b->len = 0;
+}
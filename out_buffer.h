@@ -0,0 +1,44 @@
+/* out_buffer.h: growable byte buffers for building output text */
+#ifndef _OUT_BUFFER_H
+#define _OUT_BUFFER_H
+#include <stdio.h>
+#include <stddef.h>
+
+// An out_buffer collects text in memory, so that it can be
+// written with a single fwrite instead of many small stdio calls.
+typedef struct {
+    char *data;   // the text so far (not NUL-terminated)
+    size_t len;   // number of bytes used in data
+    size_t cap;   // number of bytes allocated for data
+} out_buffer;
+
+// Requires: b != NULL
+// Make b an empty buffer
+extern void out_buffer_init(out_buffer *b);
+
+// Requires: b was initialized
+// Free the space used by b, making it empty
+extern void out_buffer_free(out_buffer *b);
+
+// Requires: b was initialized and s points to len bytes
+// Append the len bytes at s to b
+extern void out_buffer_write(out_buffer *b, const char *s, size_t len);
+
+// Requires: b was initialized and s != NULL
+// Append the NUL-terminated string s (without the NUL) to b
+extern void out_buffer_puts(out_buffer *b, const char *s);
+
+// Requires: b was initialized
+// Append num spaces to b
+extern void out_buffer_spaces(out_buffer *b, int num);
+
+// Requires: b was initialized
+// Append the decimal form of i to b
+extern void out_buffer_int(out_buffer *b, int i);
+
+// Requires: b was initialized and out != NULL
+// Write the contents of b to out and make b empty
+// (keeping its space for reuse)
+extern void out_buffer_flush(out_buffer *b, FILE *out);
+
+#endif
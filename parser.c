@@ -8,6 +8,9 @@
 // putting the AST into progast
 extern int yyparse (char const *file_name);
 
+// The number of syntax errors yyparse has found
+extern int yynerrs;
+
 // Parse a PL/0 program using the tokens from the lexer,
 // returning the program's AST
 extern block_t parseProgram(char const *file_name)
@@ -18,3 +21,11 @@ extern block_t parseProgram(char const *file_name)
     }
     return progast;
 }
+
+// Return the number of syntax errors found by parseProgram
+// (which can only be more than 0 if all errors are being reported,
+// see diagnostics.h, in which case progast is only partial)
+extern int parseErrorCount()
+{
+    return yynerrs;
+}
@@ -10,4 +10,9 @@ extern block_t progast;
 // returning the program's AST
 extern block_t parseProgram(char const *file_name);
 
+// Return the number of syntax errors found by parseProgram
+// (which can only be more than 0 if all errors are being reported,
+// see diagnostics.h, in which case progast is only partial)
+extern int parseErrorCount();
+
 #endif
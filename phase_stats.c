@@ -0,0 +1,133 @@
+/* phase_stats.c: timing and allocation counts for the compiler's phases */
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <sys/resource.h>
+#include "phase_stats.h"
+#include "alloc_stats.h"
+
+// A point in a run, or (as a total) the difference between two points
+typedef struct {
+    double wall;  // seconds of elapsed time
+    double cpu;   // seconds of CPU time, counting all threads
+    alloc_counts allocs;
+} phase_point;
+
+static bool enabled = false;
+static phase_point starts[PHASE_COUNT];
+static phase_point totals[PHASE_COUNT];
+static unsigned long tokens = 0;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "lex", "parse", "unparse", "check"
+};
+
+// Return the time in seconds on the given clock
+static double seconds(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Return the current point in the run
+static phase_point now()
+{
+    phase_point ret;
+    ret.wall = seconds(CLOCK_MONOTONIC);
+    ret.cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    ret.allocs = alloc_stats_counts();
+    return ret;
+}
+
+// Add the difference between end and start to *total
+static void add_since(phase_point *total, const phase_point *start,
+		      const phase_point *end)
+{
+    total->wall += end->wall - start->wall;
+    total->cpu += end->cpu - start->cpu;
+    total->allocs.count += end->allocs.count - start->allocs.count;
+    total->allocs.bytes += end->allocs.bytes - start->allocs.bytes;
+}
+
+// Start measuring phases (nothing is measured until this is called)
+void phase_stats_enable()
+{
+    enabled = true;
+}
+
+// Is measuring on?
+bool phase_stats_enabled()
+{
+    return enabled;
+}
+
+// Start timing phase p (if measuring is on)
+void phase_stats_begin(phase_kind p)
+{
+    if (enabled) {
+	starts[p] = now();
+    }
+}
+
+// Requires: phase_stats_begin(p) was called (and this not since)
+// Stop timing phase p, adding the time and allocations since
+// the call to phase_stats_begin(p) to p's totals (if measuring is on).
+void phase_stats_end(phase_kind p)
+{
+    if (enabled) {
+	phase_point end = now();
+	add_since(&totals[p], &starts[p], &end);
+    }
+}
+
+// Requires: lex != NULL
+// Return lex(), counting the call's time and allocations
+// as lexing (and the call as a token) if measuring is on.
+int phase_stats_lex(int (*lex)(void))
+{
+    if (!enabled) {
+	return lex();
+    }
+    phase_point start = now();
+    int ret = lex();
+    phase_point end = now();
+    add_since(&totals[phase_lex], &start, &end);
+    tokens++;
+    return ret;
+}
+
+// Print one row of the report on out
+static void print_row(FILE *out, const char *name, const phase_point *t,
+		      size_t input_bytes)
+{
+    double kb_per_sec = (t->wall > 0) ? input_bytes / 1024.0 / t->wall : 0;
+    fprintf(out, "%-8s %10.3f %10.3f %12.1f %10lu %10.1f\n",
+	    name, t->wall * 1e3, t->cpu * 1e3, kb_per_sec,
+	    t->allocs.count, t->allocs.bytes / 1024.0);
+}
+
+// Requires: out != NULL
+// Print a table of the totals for each phase on out,
+// with throughputs based on an input of input_bytes bytes.
+// The parsing totals do not include the lexing done while parsing.
+void phase_stats_report(FILE *out, size_t input_bytes)
+{
+    phase_point parse = totals[phase_parse];
+    phase_point none = { 0.0, 0.0, { 0, 0 } };
+    // the lexer is only called by the parser, so take out its share
+    add_since(&parse, &totals[phase_lex], &none);
+    phase_point total = none;
+    fprintf(out, "%-8s %10s %10s %12s %10s %10s\n",
+	    "phase", "wall ms", "cpu ms", "input KB/s", "allocs", "alloc KB");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+	const phase_point *t = (p == phase_parse) ? &parse : &totals[p];
+	print_row(out, phase_names[p], t, input_bytes);
+	add_since(&total, &none, t);
+    }
+    print_row(out, "total", &total, input_bytes);
+    fprintf(out, "%lu tokens in %zu bytes of input\n", tokens, input_bytes);
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+	fprintf(out, "peak RSS: %ld KB\n", usage.ru_maxrss);
+    }
+}
@@ -0,0 +1,43 @@
+/* phase_stats.h: timing and allocation counts for the compiler's phases */
+#ifndef _PHASE_STATS_H
+#define _PHASE_STATS_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The phases that are measured
+typedef enum {
+    phase_lex, phase_parse, phase_unparse, phase_check
+} phase_kind;
+
+// The number of phase_kind values
+#define PHASE_COUNT (phase_check + 1)
+
+// Start measuring phases (nothing is measured until this is called)
+extern void phase_stats_enable();
+
+// Is measuring on?
+extern bool phase_stats_enabled();
+
+// Start timing phase p (if measuring is on)
+extern void phase_stats_begin(phase_kind p);
+
+// Requires: phase_stats_begin(p) was called (and this not since)
+// Stop timing phase p, adding the time and allocations since
+// the call to phase_stats_begin(p) to p's totals (if measuring is on).
+extern void phase_stats_end(phase_kind p);
+
+// Requires: lex != NULL
+// Return lex(), counting the call's time and allocations
+// as lexing (and the call as a token) if measuring is on.
+// (The parser calls the lexer through this, see spl.y.)
+extern int phase_stats_lex(int (*lex)(void));
+
+// Requires: out != NULL
+// Print a table of the totals for each phase on out,
+// with throughputs based on an input of input_bytes bytes.
+// The parsing totals do not include the lexing done while parsing.
+// The process's peak resident set size so far is printed last.
+extern void phase_stats_report(FILE *out, size_t input_bytes);
+
+#endif
@@ -0,0 +1,320 @@
+// proc_cache.c: on-disk cache of per-procedure results, includes function bodies
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "proc_cache.h"
+#include "symtab.h"
+#include "ast_visit.h"
+#include "utilities.h"
+
+// Bumped whenever the meaning of a cache entry changes,
+// so stale entries from older compilers are never reused
+#define PROC_CACHE_VERSION 3
+
+static const char* cache_dir = NULL; // NULL when the cache is disabled
+
+// Pre-Conditions: dir is not NULL
+// Post-Conditions: Enables the cache, keeping its entries in the directory
+// dir (which is created if needed), produces an error message if dir
+// cannot be created
+void proc_cache_initialize(const char* dir)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        bail_with_error("Cannot create cache directory %s", dir);
+    }
+    errno = 0; // EEXIST is not an error worth reporting later
+    cache_dir = dir;
+    symtab_digest_environments(); // For the check keys
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if proc_cache_initialize has been called
+bool proc_cache_enabled()
+{
+    return cache_dir != NULL;
+}
+
+// Add the string s to ctx, including its terminator so adjacent strings stay distinct
+static void add_str(digest_ctx* ctx, const char* s)
+{
+    digest_add(ctx, s, strlen(s) + 1);
+}
+
+// Add the int i to ctx
+static void add_int(digest_ctx* ctx, int i)
+{
+    digest_add(ctx, &i, sizeof(i));
+}
+
+// Procedures are digested by the ast_visit callback below, so nesting depth
+// is not limited by the C stack; its data is the digest_ctx.
+// Each node adds its type tag, its names and values, and the number of
+// its children where that varies, so the pre-order sequence is unambiguous.
+
+// Pre-Conditions: n is a node of the procedure being digested into *data
+// Post-Conditions: Adds n to the digest, and for a nested procedure
+// adds its saved digest instead of visiting its block
+static bool digest_node_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    digest_ctx* ctx = (digest_ctx*) data;
+    add_int(ctx, n->type_tag);
+    const void* node = n->node;
+    switch (n->type_tag)
+    {
+        case block_ast:
+        {
+            const block_t* blk = node;
+            add_int(ctx, blk->const_decls.count);
+            add_int(ctx, blk->var_decls.count);
+            add_int(ctx, blk->proc_decls.count);
+            break;
+        }
+        case const_decl_ast:
+            add_int(ctx, ((const const_decl_t*) node)->const_def_list.count);
+            break;
+        case const_def_ast:
+            add_str(ctx, ((const const_def_t*) node)->ident.name);
+            add_int(ctx, ((const const_def_t*) node)->number.value);
+            break;
+        case var_decl_ast:
+            add_int(ctx, ((const var_decl_t*) node)->ident_list.count);
+            break;
+        case proc_decl_ast:
+            if (parent != NULL) // A nested procedure
+            {
+                digest_add(ctx, ((const proc_decl_t*) node)->cache_digest.bytes, DIGEST_SIZE);
+                return false;
+            }
+            add_str(ctx, ((const proc_decl_t*) node)->name);
+            break;
+        case stmts_ast:
+        {
+            const stmts_t* stmts = node;
+            add_int(ctx, (stmts->stmts_kind == empty_stmts_e) ? 0 : stmts->stmt_list.count);
+            break;
+        }
+        case assign_stmt_ast:
+            add_str(ctx, ((const assign_stmt_t*) node)->name);
+            break;
+        case call_stmt_ast:
+            add_str(ctx, ((const call_stmt_t*) node)->name);
+            break;
+        case read_stmt_ast:
+            add_str(ctx, ((const read_stmt_t*) node)->name);
+            break;
+        case if_stmt_ast:
+            add_int(ctx, ((const if_stmt_t*) node)->else_stmts != NULL);
+            break;
+        case rel_op_condition_ast:
+            add_int(ctx, ((const rel_op_condition_t*) node)->rel_op.code);
+            break;
+        case binary_op_expr_ast:
+            add_int(ctx, ((const binary_op_expr_t*) node)->arith_op.code);
+            break;
+        case ident_ast:
+            add_str(ctx, ((const ident_t*) node)->name);
+            break;
+        case number_ast:
+            add_int(ctx, ((const number_t*) node)->value);
+            break;
+        default: // The rest have a fixed number of children and nothing else
+            break;
+    }
+    return true;
+}
+
+static const ast_visitor digest_visitor = {
+    .pre = {
+        [block_ast] = digest_node_pre,
+        [const_decl_ast] = digest_node_pre,
+        [const_def_ast] = digest_node_pre,
+        [var_decl_ast] = digest_node_pre,
+        [proc_decl_ast] = digest_node_pre,
+        [stmts_ast] = digest_node_pre,
+        [assign_stmt_ast] = digest_node_pre,
+        [call_stmt_ast] = digest_node_pre,
+        [if_stmt_ast] = digest_node_pre,
+        [while_stmt_ast] = digest_node_pre,
+        [read_stmt_ast] = digest_node_pre,
+        [print_stmt_ast] = digest_node_pre,
+        [block_stmt_ast] = digest_node_pre,
+        [db_condition_ast] = digest_node_pre,
+        [rel_op_condition_ast] = digest_node_pre,
+        [binary_op_expr_ast] = digest_node_pre,
+        [negated_expr_ast] = digest_node_pre,
+        [ident_ast] = digest_node_pre,
+        [number_ast] = digest_node_pre,
+    },
+};
+
+// Pre-Conditions: procD is a proc_decl AST that was just parsed, so the
+// procedures declared in its block have been passed to this already
+// Post-Conditions: If the cache is enabled, saves in procD a digest of its
+// name and block that only depends on the tokens in them (using the saved
+// digests of the procedures declared in its block, so each procedure is
+// digested once, no matter how deeply it is nested)
+void proc_cache_proc_decl(proc_decl_t* procD)
+{
+    if (!proc_cache_enabled())
+    {
+        return;
+    }
+
+    digest_ctx ctx;
+    digest_init(&ctx);
+    add_int(&ctx, PROC_CACHE_VERSION);
+    ast_visit(&digest_visitor, &ctx, proc_decl_ast, procD, 0);
+    procD->cache_digest = digest_finish(&ctx);
+}
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with
+// the cache enabled
+// Post-Conditions: Returns the digest of procD's name and block saved in it
+digest proc_cache_proc_digest(proc_decl_t procD)
+{
+    return procD.cache_digest;
+}
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with the cache
+// enabled, and has been inserted into the current scope of the symbol table
+// Post-Conditions: Returns the key for procD's declaration checking results
+digest proc_cache_check_key(proc_decl_t procD)
+{
+    digest env = symtab_digest_visible();
+    digest_ctx ctx;
+    digest_init(&ctx);
+    add_str(&ctx, "chk");
+    digest_add(&ctx, procD.cache_digest.bytes, DIGEST_SIZE);
+    digest_add(&ctx, env.bytes, DIGEST_SIZE);
+    return digest_finish(&ctx);
+}
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with
+// the cache enabled
+// Post-Conditions: Returns the key for procD's unparsed text at the
+// given nesting level
+digest proc_cache_text_key(proc_decl_t procD, int level)
+{
+    digest_ctx ctx;
+    digest_init(&ctx);
+    add_str(&ctx, "txt");
+    digest_add(&ctx, procD.cache_digest.bytes, DIGEST_SIZE);
+    add_int(&ctx, level);
+    return digest_finish(&ctx);
+}
+
+// Each entry is a file named by the first 8 bytes of its key (in hex)
+// that starts with the whole key, which is compared with the key looked up
+// before the entry is used, so an entry whose name matches by chance
+// (or that is left from an older compiler) is never reused.
+
+// Put the name of the cache file for key with the given suffix into buf
+static void entry_name(char* buf, size_t size, digest key, const char* suffix)
+{
+    unsigned long long prefix = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        prefix = (prefix << 8) | key.bytes[i];
+    }
+    snprintf(buf, size, "%s/%016llx.%s", cache_dir, prefix, suffix);
+}
+
+// Write key and then len bytes of data to the cache file for key with the
+// given suffix. The entry is written to a temporary file that is then
+// renamed, so concurrent compiler runs never see a partial entry.
+static void write_entry(digest key, const char* suffix, const char* data, size_t len)
+{
+    char name[FILENAME_MAX];
+    char tmp_name[FILENAME_MAX + 32];
+    entry_name(name, sizeof(name), key, suffix);
+    snprintf(tmp_name, sizeof(tmp_name), "%s.%ld.tmp", name, (long) getpid());
+
+    FILE* f = fopen(tmp_name, "wb");
+    if (f == NULL)
+    {
+        bail_with_error("Cannot write cache file %s", tmp_name);
+    }
+    if (fwrite(key.bytes, 1, DIGEST_SIZE, f) != DIGEST_SIZE || fwrite(data, 1, len, f) != len
+        || fclose(f) == EOF || rename(tmp_name, name) != 0)
+    {
+        bail_with_error("Cannot write cache file %s", name);
+    }
+}
+
+// Open the cache file for key with the given suffix for reading, positioned
+// just after the key it starts with; returns NULL if there is no such file
+// or it is for another key
+static FILE* open_entry(digest key, const char* suffix)
+{
+    char name[FILENAME_MAX];
+    entry_name(name, sizeof(name), key, suffix);
+    FILE* f = fopen(name, "rb");
+    if (f == NULL)
+    {
+        errno = 0; // A missing entry is just a cache miss
+        return NULL;
+    }
+
+    digest stored;
+    if (fread(stored.bytes, 1, DIGEST_SIZE, f) != DIGEST_SIZE || !digest_equal(stored, key))
+    {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// Pre-Conditions: The cache is enabled
+// Post-Conditions: Returns true if the procedure with the given check key
+// has previously passed declaration checking
+bool proc_cache_checked(digest key)
+{
+    FILE* f = open_entry(key, "chk");
+    if (f == NULL)
+    {
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+// Pre-Conditions: The cache is enabled
+// Post-Conditions: Records that the procedure with the given check key
+// passed declaration checking
+void proc_cache_record_checked(digest key)
+{
+    write_entry(key, "chk", "", 0);
+}
+
+// Pre-Conditions: The cache is enabled, out is an initialized out_buffer
+// Post-Conditions: If there is unparsed text cached under key, appends it
+// to out and returns true, otherwise returns false
+bool proc_cache_read_text(out_buffer* out, digest key)
+{
+    FILE* f = open_entry(key, "txt");
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        out_buffer_write(out, buf, n);
+    }
+    fclose(f);
+    return true;
+}
+
+// Pre-Conditions: The cache is enabled, text points to len bytes
+// Post-Conditions: Caches the len bytes of text under key
+void proc_cache_store_text(digest key, const char* text, size_t len)
+{
+    write_entry(key, "txt", text, len);
+}
@@ -0,0 +1,69 @@
+// proc_cache.h: on-disk cache of per-procedure results, includes function declarations
+// Entries are keyed by a digest (see digest.h) of a procedure's AST (its
+// token stream, ignoring layout and line numbers) combined with either the
+// declarations visible to it (for checking) or its nesting level (for
+// unparsing), so unchanged procedures can skip work in later compiler runs.
+
+#ifndef _PROC_CACHE_H
+#define _PROC_CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+#include "out_buffer.h"
+
+// Pre-Conditions: dir is not NULL
+// Post-Conditions: Enables the cache, keeping its entries in the directory
+// dir (which is created if needed), produces an error message if dir
+// cannot be created
+extern void proc_cache_initialize(const char* dir);
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if proc_cache_initialize has been called
+extern bool proc_cache_enabled();
+
+// Pre-Conditions: procD is a proc_decl AST that was just parsed, so the
+// procedures declared in its block have been passed to this already
+// Post-Conditions: If the cache is enabled, saves in procD a digest of its
+// name and block that only depends on the tokens in them (using the saved
+// digests of the procedures declared in its block, so each procedure is
+// digested once, no matter how deeply it is nested)
+extern void proc_cache_proc_decl(proc_decl_t* procD);
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with
+// the cache enabled
+// Post-Conditions: Returns the digest of procD's name and block saved in it
+extern digest proc_cache_proc_digest(proc_decl_t procD);
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with the cache
+// enabled, and has been inserted into the current scope of the symbol table
+// Post-Conditions: Returns the key for procD's declaration checking results
+extern digest proc_cache_check_key(proc_decl_t procD);
+
+// Pre-Conditions: procD was passed to proc_cache_proc_decl with
+// the cache enabled
+// Post-Conditions: Returns the key for procD's unparsed text at the
+// given nesting level
+extern digest proc_cache_text_key(proc_decl_t procD, int level);
+
+// Pre-Conditions: The cache is enabled
+// Post-Conditions: Returns true if the procedure with the given check key
+// has previously passed declaration checking
+extern bool proc_cache_checked(digest key);
+
+// Pre-Conditions: The cache is enabled
+// Post-Conditions: Records that the procedure with the given check key
+// passed declaration checking
+extern void proc_cache_record_checked(digest key);
+
+// Pre-Conditions: The cache is enabled, out is an initialized out_buffer
+// Post-Conditions: If there is unparsed text cached under key, appends it
+// to out and returns true, otherwise returns false
+extern bool proc_cache_read_text(out_buffer* out, digest key);
+
+// Pre-Conditions: The cache is enabled, text points to len bytes
+// Post-Conditions: Caches the len bytes of text under key
+extern void proc_cache_store_text(digest key, const char* text, size_t len);
+
+#endif
@@ -0,0 +1,294 @@
+// pscope.c: persistent scopes, includes function bodies
+
+#include <stdlib.h>
+#include <string.h>
+#include "pscope.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+#include "spl_probes.h"
+#include "symtab_stats.h"
+
+#define PSCOPE_MASK ((1u << PSCOPE_BITS) - 1) // Bits of the hash used at one level
+
+// Pre-Conditions: shift is less than 64
+// Post-Conditions: Returns the bit of a trie node's bitmap for hash at shift
+static unsigned int pscope_bit(unsigned long long hash, unsigned int shift)
+{
+    return 1u << ((hash >> shift) & PSCOPE_MASK);
+}
+
+// Pre-Conditions: bit is a single bit
+// Post-Conditions: Returns the index in a node's entries of the entry for bit
+static unsigned int pscope_index(unsigned int bitmap, unsigned int bit)
+{
+    return (unsigned int)__builtin_popcount(bitmap & (bit - 1));
+}
+
+// Pre-Conditions: e is a valid entry
+// Post-Conditions: Adds a reference to what e refers to
+static void entry_retain(pscope_entry e)
+{
+    if (e.is_node) atomic_fetch_add(&((pscope_node*)e.ptr)->refs, 1);
+    else atomic_fetch_add(&((pscope_assoc*)e.ptr)->refs, 1);
+}
+
+// Pre-Conditions: my_assoc is NULL or retained by the caller
+// Post-Conditions: Drops the caller's reference to my_assoc, freeing it
+// and the older associations no longer referred to
+static void assoc_release(pscope_assoc* my_assoc)
+{
+    // Follow prev in a loop, as a scope's associations form a long chain
+    while (my_assoc != NULL && atomic_fetch_sub(&my_assoc->refs, 1) == 1)
+    {
+        pscope_assoc* prev = my_assoc->prev;
+        assoc_release(my_assoc->same_hash); // Names whose hashes collide are rare
+        alloc_free(my_assoc);
+        my_assoc = prev;
+    }
+}
+
+// Pre-Conditions: my_node is NULL or retained by the caller
+// Post-Conditions: Drops the caller's reference to my_node, freeing it
+// and what only it referred to
+static void node_release(pscope_node* my_node)
+{
+    if (my_node == NULL || atomic_fetch_sub(&my_node->refs, 1) != 1) return;
+
+    unsigned int count = (unsigned int)__builtin_popcount(my_node->bitmap);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (my_node->entries[i].is_node) node_release(my_node->entries[i].ptr); // At most 64 / PSCOPE_BITS deep
+        else assoc_release(my_node->entries[i].ptr);
+    }
+    alloc_free(my_node);
+}
+
+// Pre-Conditions: bitmap is not 0
+// Post-Conditions: Returns a new node with room for an entry per bit of bitmap
+// and one reference.
+// Produces error message if space cannot be allocated.
+static pscope_node* node_alloc(unsigned int bitmap)
+{
+    unsigned int count = (unsigned int)__builtin_popcount(bitmap);
+    pscope_node* ret = (pscope_node*)alloc_malloc_in(alloc_scope, sizeof(pscope_node) + count * sizeof(pscope_entry)); // FREE THIS
+    if (ret == NULL) bail_with_error("No space to allocate scope trie node!");
+    atomic_init(&ret->refs, 1);
+    ret->bitmap = bitmap;
+    return ret;
+}
+
+// Pre-Conditions: my_node is NULL or a node of a trie at the given shift,
+// my_assoc is not NULL and its name is not in the trie
+// Post-Conditions: Returns a new node (with one reference) for the trie
+// with my_assoc added, copying only the nodes on its path and sharing the rest
+static pscope_node* trie_insert(pscope_node* my_node, pscope_assoc* my_assoc, unsigned int shift)
+{
+    unsigned int bit = pscope_bit(my_assoc->hash, shift);
+    pscope_entry new_entry = { false, my_assoc };
+
+    if (my_node == NULL)
+    {
+        pscope_node* ret = node_alloc(bit);
+        atomic_fetch_add(&my_assoc->refs, 1);
+        ret->entries[0] = new_entry;
+        return ret;
+    }
+
+    unsigned int count = (unsigned int)__builtin_popcount(my_node->bitmap);
+    unsigned int index = pscope_index(my_node->bitmap, bit);
+
+    if ((my_node->bitmap & bit) == 0) // A new entry goes between the others
+    {
+        pscope_node* ret = node_alloc(my_node->bitmap | bit);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            entry_retain(my_node->entries[i]);
+            ret->entries[i < index ? i : i + 1] = my_node->entries[i];
+        }
+        atomic_fetch_add(&my_assoc->refs, 1);
+        ret->entries[index] = new_entry;
+        return ret;
+    }
+
+    // The entry for bit is replaced, the others are shared
+    pscope_node* ret = node_alloc(my_node->bitmap);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (i == index) continue;
+        entry_retain(my_node->entries[i]);
+        ret->entries[i] = my_node->entries[i];
+    }
+
+    pscope_entry old = my_node->entries[index];
+    if (old.is_node)
+    {
+        ret->entries[index].is_node = true;
+        ret->entries[index].ptr = trie_insert(old.ptr, my_assoc, shift + PSCOPE_BITS);
+    }
+    else if (((pscope_assoc*)old.ptr)->hash == my_assoc->hash) // Whole hashes collide
+    {
+        atomic_fetch_add(&((pscope_assoc*)old.ptr)->refs, 1);
+        my_assoc->same_hash = old.ptr; // Not yet shared, so it can still be set
+        atomic_fetch_add(&my_assoc->refs, 1);
+        ret->entries[index] = new_entry;
+    }
+    else // Two hashes that differ in later bits, so both go one level down
+    {
+        pscope_node* single = trie_insert(NULL, old.ptr, shift + PSCOPE_BITS);
+        ret->entries[index].is_node = true;
+        ret->entries[index].ptr = trie_insert(single, my_assoc, shift + PSCOPE_BITS);
+        node_release(single);
+    }
+
+    return ret;
+}
+
+// Pre-Conditions: my_scope and my_name are not NULL, hash is hash_name(my_name)
+// Post-Conditions: Returns the association that my_name has in my_scope
+// (not counting the scopes around it), or NULL if it has none
+static pscope_assoc* trie_lookup(pscope* my_scope, const char* my_name, unsigned long long hash)
+{
+    pscope_node* my_node = my_scope->root;
+    unsigned int compared = 0;
+
+    for (unsigned int shift = 0; my_node != NULL; shift += PSCOPE_BITS)
+    {
+        unsigned int bit = pscope_bit(hash, shift);
+        if ((my_node->bitmap & bit) == 0) break;
+
+        pscope_entry e = my_node->entries[pscope_index(my_node->bitmap, bit)];
+        if (e.is_node)
+        {
+            my_node = e.ptr;
+            continue;
+        }
+
+        for (pscope_assoc* my_assoc = e.ptr; my_assoc != NULL; my_assoc = my_assoc->same_hash)
+        {
+            compared++;
+            if (my_assoc->hash == hash && !strcmp(my_assoc->name, my_name))
+            {
+                SPL_PROBE3(scope_lookup, my_name, compared, 1);
+                symtab_stats_count_scope_lookup(compared);
+                return my_assoc;
+            }
+        }
+        break;
+    }
+
+    SPL_PROBE3(scope_lookup, my_name, compared, 0);
+    symtab_stats_count_scope_lookup(compared);
+    return NULL;
+}
+
+// Pre-Conditions: parent is NULL or a retained scope
+// Post-Conditions: Returns a new empty scope inside parent (retaining
+// parent), with one reference. Produces error message if space cannot be allocated.
+pscope* pscope_enter(pscope* parent)
+{
+    pscope* ret = (pscope*)alloc_malloc_in(alloc_scope, sizeof(pscope)); // FREE THIS
+    if (ret == NULL) bail_with_error("No space to allocate scope!");
+
+    atomic_init(&ret->refs, 1);
+    ret->parent = pscope_retain(parent);
+    ret->root = NULL;
+    ret->newest = NULL;
+    ret->size = 0;
+    ret->depth = (parent == NULL) ? 0 : parent->depth + 1;
+    memset(&ret->env_digest, 0, sizeof(ret->env_digest));
+
+    return ret;
+}
+
+// Pre-Conditions: my_scope is NULL or retained
+// Post-Conditions: Adds a reference to my_scope and returns it
+pscope* pscope_retain(pscope* my_scope)
+{
+    if (my_scope != NULL) atomic_fetch_add(&my_scope->refs, 1);
+    return my_scope;
+}
+
+// Pre-Conditions: my_scope is NULL or retained by the caller
+// Post-Conditions: Drops the caller's reference to my_scope, freeing
+// the versions, nodes and associations no longer referred to
+void pscope_release(pscope* my_scope)
+{
+    // Follow parent in a loop, as scopes may be nested deeply
+    while (my_scope != NULL && atomic_fetch_sub(&my_scope->refs, 1) == 1)
+    {
+        pscope* parent = my_scope->parent;
+        node_release(my_scope->root);
+        assoc_release(my_scope->newest);
+        alloc_free(my_scope);
+        my_scope = parent;
+    }
+}
+
+// Pre-Conditions: my_scope, my_name and my_attrs are not NULL, hash is
+// hash_name(my_name), my_name has no association in my_scope (not counting
+// the scopes around it), and my_name stays allocated while the association does
+// Post-Conditions: Returns a new version of my_scope with my_name associated
+// to a copy of my_attrs (with its offset count set to the size of my_scope),
+// with one reference; my_scope is not changed.
+// Produces error message if space cannot be allocated.
+pscope* pscope_insert(pscope* my_scope, const char* my_name, unsigned long long hash, id_attrs* my_attrs)
+{
+    pscope_assoc* new_assoc = (pscope_assoc*)alloc_malloc_in(alloc_scope_assoc, sizeof(pscope_assoc)); // FREE THIS
+    if (new_assoc == NULL) bail_with_error("No space to allocate association!");
+
+    atomic_init(&new_assoc->refs, 1); // For the new version's newest
+    new_assoc->name = my_name;
+    new_assoc->attrs = *my_attrs;
+    id_attrs_set_offset_count(&new_assoc->attrs, my_scope->size);
+    new_assoc->hash = hash;
+    new_assoc->prev = my_scope->newest;
+    if (new_assoc->prev != NULL) atomic_fetch_add(&new_assoc->prev->refs, 1);
+    new_assoc->same_hash = NULL;
+
+    pscope* ret = (pscope*)alloc_malloc_in(alloc_scope, sizeof(pscope)); // FREE THIS
+    if (ret == NULL) bail_with_error("No space to allocate scope!");
+
+    atomic_init(&ret->refs, 1);
+    ret->parent = pscope_retain(my_scope->parent);
+    ret->root = trie_insert(my_scope->root, new_assoc, 0);
+    ret->newest = new_assoc;
+    ret->size = my_scope->size + 1;
+    ret->depth = my_scope->depth;
+    ret->env_digest = my_scope->env_digest;
+    SPL_PROBE2(scope_insert, my_name, ret->size);
+
+    return ret;
+}
+
+// Pre-Conditions: my_scope and my_name are not NULL, hash is hash_name(my_name).
+// Post-Conditions: Returns the attributes of the association that my_name has
+// in my_scope (not counting the scopes around it), or NULL if it has none
+id_attrs* pscope_lookup_current(pscope* my_scope, const char* my_name, unsigned long long hash)
+{
+    pscope_assoc* found = trie_lookup(my_scope, my_name, hash);
+    return (found == NULL) ? NULL : &found->attrs;
+}
+
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name), levels_out is not NULL
+// Post-Conditions: Returns the attributes of the association that my_name has
+// in my_scope or the nearest scope around it that has one, setting *levels_out
+// to the number of scopes out it was found, or returns NULL if there is none
+// (setting *levels_out to the number of scopes searched)
+id_attrs* pscope_lookup(pscope* my_scope, const char* my_name, unsigned long long hash, unsigned int* levels_out)
+{
+    unsigned int lvlsOut = 0;
+
+    for (; my_scope != NULL; my_scope = my_scope->parent)
+    {
+        pscope_assoc* found = trie_lookup(my_scope, my_name, hash);
+        if (found != NULL)
+        {
+            *levels_out = lvlsOut;
+            return &found->attrs;
+        }
+        lvlsOut++;
+    }
+
+    *levels_out = lvlsOut;
+    return NULL;
+}
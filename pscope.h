@@ -0,0 +1,96 @@
+// pscope.h: persistent scopes, includes data structures and function declarations
+#ifndef _PSCOPE_H
+#define _PSCOPE_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "id_attrs.h"
+#include "digest.h"
+
+// A persistent scope is never changed once made: inserting a name into it
+// returns a new version of it, which shares all but O(log n) of its storage
+// with the old one, and entering a scope returns a new empty scope whose
+// parent is the old one. So any pscope pointer is a complete environment
+// (the scope and the scopes around it) that stays valid and unchanged
+// for as long as it is retained, and can be shared between threads.
+// The names of each scope are kept in a hash array mapped trie (HAMT):
+// each node of the trie uses 5 more bits of the name's hash to choose
+// among up to 32 children, and only stores the children that exist.
+
+#define PSCOPE_BITS 5 // Bits of the hash used at each level of the trie
+
+// An association of a name with its attributes. Each scope's associations
+// are also linked newest first, so they can be visited in insertion order.
+typedef struct pscope_assoc
+{
+    atomic_uint refs; // Number of references to this association
+    const char* name; // Name of identifier
+    id_attrs attrs; // Attributes of identifier
+    unsigned long long hash; // hash_name(name)
+    struct pscope_assoc* prev; // Previously inserted association in its scope
+    struct pscope_assoc* same_hash; // Another association in its trie slot with the same hash
+} pscope_assoc;
+
+// An entry of a trie node, which is a child node or an association
+typedef struct
+{
+    bool is_node;
+    void* ptr; // A pscope_node* if is_node, else a pscope_assoc*
+} pscope_entry;
+
+// A node of a scope's trie
+typedef struct pscope_node
+{
+    atomic_uint refs; // Number of references to this node
+    unsigned int bitmap; // Bit i is set if the node has an entry for hash bits i
+    pscope_entry entries[]; // One per set bit of bitmap, in order of the bits
+} pscope_node;
+
+// One version of a scope, with the scopes around it
+typedef struct pscope
+{
+    atomic_uint refs; // Number of references to this version
+    struct pscope* parent; // Scope around this one, or NULL if outermost
+    pscope_node* root; // Trie of the associations, or NULL if none
+    pscope_assoc* newest; // Most recently inserted association, or NULL
+    unsigned int size; // Number of associations in this scope
+    unsigned int depth; // Number of scopes around this one
+    digest env_digest; // Kept by the symbol table (see symtab_digest_visible), initially all 0
+} pscope;
+
+// Pre-Conditions: parent is NULL or a retained scope
+// Post-Conditions: Returns a new empty scope inside parent (retaining
+// parent), with one reference. Produces error message if space cannot be allocated.
+extern pscope* pscope_enter(pscope* parent);
+
+// Pre-Conditions: my_scope is NULL or retained
+// Post-Conditions: Adds a reference to my_scope and returns it
+extern pscope* pscope_retain(pscope* my_scope);
+
+// Pre-Conditions: my_scope is NULL or retained by the caller
+// Post-Conditions: Drops the caller's reference to my_scope, freeing
+// the versions, nodes and associations no longer referred to
+extern void pscope_release(pscope* my_scope);
+
+// Pre-Conditions: my_scope, my_name and my_attrs are not NULL, hash is
+// hash_name(my_name), my_name has no association in my_scope (not counting
+// the scopes around it), and my_name stays allocated while the association does
+// Post-Conditions: Returns a new version of my_scope with my_name associated
+// to a copy of my_attrs (with its offset count set to the size of my_scope),
+// with one reference; my_scope is not changed.
+// Produces error message if space cannot be allocated.
+extern pscope* pscope_insert(pscope* my_scope, const char* my_name, unsigned long long hash, id_attrs* my_attrs);
+
+// Pre-Conditions: my_scope and my_name are not NULL, hash is hash_name(my_name).
+// Post-Conditions: Returns the attributes of the association that my_name has
+// in my_scope (not counting the scopes around it), or NULL if it has none
+extern id_attrs* pscope_lookup_current(pscope* my_scope, const char* my_name, unsigned long long hash);
+
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name), levels_out is not NULL
+// Post-Conditions: Returns the attributes of the association that my_name has
+// in my_scope or the nearest scope around it that has one, setting *levels_out
+// to the number of scopes out it was found, or returns NULL if there is none
+// (setting *levels_out to the number of scopes searched)
+extern id_attrs* pscope_lookup(pscope* my_scope, const char* my_name, unsigned long long hash, unsigned int* levels_out);
+
+#endif
@@ -3,8 +3,64 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "scope.h"
 #include "utilities.h"
+#include "alloc_stats.h"
+#include "trace.h"
+#include "spl_probes.h"
+#include "symtab_stats.h"
+
+static atomic_long live_scopes; // Scopes initialized but not yet destroyed
+
+// Pre-Conditions: my_scope has a Bloom filter.
+// Post-Conditions: Returns the mask of the bit for hash in word *word of
+// my_scope's Bloom filter, using the given half (0 or 1) of hash
+static unsigned long long bloom_bit(scope* my_scope, unsigned long long hash, int half, unsigned int* word)
+{
+    unsigned int bits = (unsigned int)(hash >> (32 * half)) & (64 * my_scope->bloom_words - 1);
+    *word = bits / 64;
+    return 1ULL << (bits % 64);
+}
+
+// Pre-Conditions: my_scope has a Bloom filter.
+// Post-Conditions: Adds the name with the given hash to my_scope's Bloom filter
+static void bloom_add(scope* my_scope, unsigned long long hash)
+{
+    unsigned int word;
+    for (int half = 0; half < 2; half++) {
+        unsigned long long mask = bloom_bit(my_scope, hash, half, &word);
+        my_scope->bloom[word] |= mask;
+    }
+}
+
+// Pre-Conditions: my_scope has a Bloom filter.
+// Post-Conditions: Returns false if the name with the given hash is
+// surely not in my_scope, true if it may be
+static bool bloom_may_contain(scope* my_scope, unsigned long long hash)
+{
+    unsigned int word;
+    for (int half = 0; half < 2; half++) {
+        unsigned long long mask = bloom_bit(my_scope, hash, half, &word);
+        if ((my_scope->bloom[word] & mask) == 0) return false;
+    }
+    return true;
+}
+
+// Pre-Conditions: my_scope is not NULL, its assoc_arr has just grown.
+// Post-Conditions: Makes my_scope's Bloom filter fit its capacity,
+// and adds all its names to it. Produces error message if space cannot be allocated.
+static void bloom_rebuild(scope* my_scope)
+{
+    unsigned int words = (my_scope->capacity + 7) / 8; // 8 bits per association
+    alloc_free(my_scope->bloom);
+    my_scope->bloom = (unsigned long long*)alloc_calloc_in(alloc_scope, words, sizeof(unsigned long long)); // FREE THIS
+    if (my_scope->bloom == NULL) bail_with_error("No space to grow scope's Bloom filter!");
+    my_scope->bloom_words = words;
+    for (int i = 0; i < my_scope->size; i++) {
+        bloom_add(my_scope, my_scope->assoc_arr[i].hash);
+    }
+}
 
 // Pre-Conditions: None.
 // Post-Conditions: Returns an empty initialized scope with a size of 0
@@ -12,18 +68,20 @@
 scope* scope_initialize()
 {
     // Attempt to allocate space for new scope
-    scope* new_scope = (scope*)malloc(sizeof(scope)); // FREE THIS
+    scope* new_scope = (scope*)alloc_malloc_in(alloc_scope, sizeof(scope)); // FREE THIS
     if (new_scope == NULL) bail_with_error("No space to allocate scope!");
+    trace_counter("live scopes", atomic_fetch_add(&live_scopes, 1) + 1);
 
     // Initialize size and number of associations
     new_scope->size = 0;
     new_scope->loc_count = 0;
-    
-    // Initialize all associations to NULL
-    for (int i = 0; i < MAX_SCOPE_SIZE; i++)
-    {
-        new_scope->assoc_arr[i] = NULL;
-    }
+
+    // No room for associations until the first is inserted
+    new_scope->capacity = 0;
+    new_scope->assoc_arr = NULL;
+    new_scope->bloom = NULL;
+    new_scope->bloom_words = 0;
+    memset(&new_scope->env_digest, 0, sizeof(new_scope->env_digest));
 
     return new_scope;
 }
@@ -34,14 +92,38 @@ void scope_destroy(scope* my_scope)
 {
     if (my_scope == NULL) return;
 
-    // Free each association in the scope
-    for (int i = 0; i < my_scope->size; i++) {
-        if (my_scope->assoc_arr[i] != NULL) {
-            free(my_scope->assoc_arr[i]->attrs);  // Free attributes
-            free(my_scope->assoc_arr[i]);         // Free association struct
-        }
-    }
-    free(my_scope); // Free the scope itself
+    alloc_free(my_scope->assoc_arr); // Free the array of associations, with their attributes
+    alloc_free(my_scope->bloom); // Free the Bloom filter
+    alloc_free(my_scope); // Free the scope itself
+    trace_counter("live scopes", atomic_fetch_sub(&live_scopes, 1) - 1);
+}
+
+// Pre-Conditions: my_scope is not NULL, size is at most its size, and no
+// associations are inserted into my_scope until the view is destroyed.
+// Post-Conditions: Returns a read-only view of the first size associations
+// of my_scope (sharing them), which can be looked up in like a scope.
+// Produces error message if space cannot be allocated.
+scope* scope_view(scope* my_scope, unsigned int size)
+{
+    scope* view = (scope*)alloc_malloc_in(alloc_scope, sizeof(scope)); // FREE THIS
+    if (view == NULL) bail_with_error("No space to allocate scope view!");
+
+    view->size = size;
+    view->loc_count = size;
+    view->capacity = 0; // Never inserted into, so the array is never grown
+    view->assoc_arr = my_scope->assoc_arr;
+    view->bloom = my_scope->bloom; // Has the view's names (and maybe a few more)
+    view->bloom_words = my_scope->bloom_words;
+    view->env_digest = my_scope->env_digest; // Only right if size is my_scope's size
+
+    return view;
+}
+
+// Pre-Conditions: view was returned by scope_view.
+// Post-Conditions: Frees the view, but not the associations it shares.
+void scope_view_destroy(scope* view)
+{
+    alloc_free(view);
 }
 
 // Pre-Conditions: my_scope is not NULL.
@@ -82,49 +164,95 @@ bool scope_declared(scope* my_scope, const char* my_name)
 // Pre-Conditions: my_scope, my_name, the associations in the scope,
 // the names of all scope associations, and my_attrs are all not NULL, 
 // my_name has no association in my_scope, my_scope is not full.
-// Post-Conditions: Inserts an association of my_name to my_attrs into
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs
+// (with its offset count set to the number of associations before it) into
 // my_scope. Produces an error message if space cannot be allocated.
 void scope_insert(scope* my_scope, const char* my_name, id_attrs* my_attrs)
 {
-    if (scope_declared(my_scope, my_name)) {
+    if (my_name == NULL) {
+        bail_with_error("Attempted to insert a NULL name!");
+    }
+    unsigned long long hash = hash_name(my_name);
+    if (scope_lookup_hashed(my_scope, my_name, hash) != NULL) {
         bail_with_error("An association already exists for (%s)!", my_name);
     }
+    scope_append(my_scope, my_name, hash, my_attrs);
+}
+
+// Pre-Conditions: my_scope, my_name and my_attrs are not NULL, hash is
+// hash_name(my_name), the caller has made sure my_name has no association
+// in my_scope, my_scope is not full.
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs
+// (with its offset count set to the number of associations before it) into
+// my_scope, without searching it first. Produces an error message if space
+// cannot be allocated.
+void scope_append(scope* my_scope, const char* my_name, unsigned long long hash, id_attrs* my_attrs)
+{
     if (my_attrs == NULL) {
         bail_with_error("Attempted to insert an association with NULL attributes!");
     }
     if (scope_full(my_scope)) {
         bail_with_error("Attempted to insert an association into a full scope!");
     }
-    scope_assoc* new_assoc = (scope_assoc*)malloc(sizeof(scope_assoc)); // FREE THIS
-    if (new_assoc == NULL) bail_with_error("No space to allocate association!");
+    if (scope_size(my_scope) == my_scope->capacity) { // Make room by doubling the array
+        unsigned int new_capacity = (my_scope->capacity == 0) ? 8 : 2 * my_scope->capacity;
+        scope_assoc* new_arr = (scope_assoc*)alloc_realloc_in(alloc_scope_assoc, my_scope->assoc_arr, new_capacity * sizeof(scope_assoc));
+        if (new_arr == NULL) bail_with_error("No space to grow scope!");
+        my_scope->assoc_arr = new_arr;
+        my_scope->capacity = new_capacity;
+        bloom_rebuild(my_scope); // Keep the filter's bits per association
+    }
+    scope_assoc* new_assoc = &my_scope->assoc_arr[scope_size(my_scope)];
 
     new_assoc->name = my_name;
-    new_assoc->attrs = my_attrs;
-    new_assoc->attrs->offset_count = scope_loc_count(my_scope);
+    new_assoc->hash = hash;
+    new_assoc->attrs = *my_attrs;
+    id_attrs_set_offset_count(&new_assoc->attrs, scope_loc_count(my_scope));
     my_scope->loc_count++;
-    my_scope->assoc_arr[scope_size(my_scope)] = new_assoc;
     my_scope->size++;
+    bloom_add(my_scope, hash);
+    SPL_PROBE2(scope_insert, my_name, scope_size(my_scope));
 }
 
 // Pre-Conditions: my_scope, my_name, the associations in the scope,
 // and the names of all scope associations are not NULL.
-// Post-Conditions: Returns the attributes of the association that my_name has,
-// returns NULL if an association cannot be found for my_name.
+// Post-Conditions: Returns the attributes of the association that my_name has
+// (which stay where they are until an association is next inserted into
+// my_scope or it is destroyed), returns NULL if an association cannot be
+// found for my_name.
 id_attrs* scope_lookup(scope* my_scope, const char* my_name)
 {
     if (my_name == NULL) {
         bail_with_error("Attempted to lookup a NULL name!");
     }
+    return scope_lookup_hashed(my_scope, my_name, hash_name(my_name));
+}
+
+// Pre-Conditions: my_scope, my_name, the associations in the scope,
+// and the names of all scope associations are not NULL,
+// hash is hash_name(my_name).
+// Post-Conditions: Returns what scope_lookup(my_scope, my_name) returns,
+// but only compares names if my_scope's Bloom filter says my_name may be there
+id_attrs* scope_lookup_hashed(scope* my_scope, const char* my_name, unsigned long long hash)
+{
+    // A scope has a Bloom filter once it has room for associations
+    if (scope_size(my_scope) == 0 || !bloom_may_contain(my_scope, hash)) {
+        SPL_PROBE3(scope_lookup, my_name, 0, 0);
+        symtab_stats_count_scope_lookup(0);
+        return NULL;
+    }
     for (int i = 0; i < scope_size(my_scope); i++) {
-        if (my_scope->assoc_arr[i] == NULL) {
-            bail_with_error("Attempting to access a NULL association!");
-        }
-        if (my_scope->assoc_arr[i]->name == NULL) {
+        if (my_scope->assoc_arr[i].name == NULL) {
             bail_with_error("Attempting to access a NULL name!");
         }
-        if (!strcmp(my_scope->assoc_arr[i]->name, my_name)) {
-            return my_scope->assoc_arr[i]->attrs;
+        // Only names with the same hash need their characters compared
+        if (my_scope->assoc_arr[i].hash == hash && !strcmp(my_scope->assoc_arr[i].name, my_name)) {
+            SPL_PROBE3(scope_lookup, my_name, i + 1, 1);
+            symtab_stats_count_scope_lookup(i + 1);
+            return &my_scope->assoc_arr[i].attrs;
         }
     }
+    SPL_PROBE3(scope_lookup, my_name, scope_size(my_scope), 0);
+    symtab_stats_count_scope_lookup(scope_size(my_scope));
     return NULL;
 }
\ No newline at end of file
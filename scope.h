@@ -7,20 +7,28 @@
 #include "id_attrs.h"
 #include "id_use.h"
 #include "machine_types.h"
+#include "digest.h"
 
-#define MAX_SCOPE_SIZE 4096
+#define MAX_SCOPE_SIZE (1u << 28) // Most associations a scope can hold
 
+// An association of a name with its attributes, stored inline in its scope's
+// array (32 bytes), so a scope's declarations take one allocation in all
 typedef struct
 {
     const char* name; // Name of identifier
-    id_attrs* attrs; // Attributes of identifier
+    unsigned long long hash; // hash_name(name)
+    id_attrs attrs; // Attributes of identifier
 } scope_assoc;
 
 typedef struct
 {
     unsigned int size; // Size of scope
     unsigned int loc_count; // Number of associations in scope
-    scope_assoc* assoc_arr[MAX_SCOPE_SIZE]; // Array of pointers to scope associations
+    unsigned int capacity; // Number of associations assoc_arr has room for
+    scope_assoc* assoc_arr; // Array of the scope associations, grown as needed
+    unsigned long long* bloom; // Bloom filter of the names, of bloom_words words (NULL if none)
+    unsigned int bloom_words; // Words in bloom, a power of 2 (8 bits per association there is room for)
+    digest env_digest; // Kept by the symbol table (see symtab_digest_visible), initially all 0
 } scope;
 
 // Pre-Conditions: None.
@@ -32,6 +40,17 @@ extern scope* scope_initialize();
 // Post-Conditions: Frees all memory associated with the given scope.
 extern void scope_destroy(scope *my_scope);  // Added declaration for scope_destroy
 
+// Pre-Conditions: my_scope is not NULL, size is at most its size, and no
+// associations are inserted into my_scope until the view is destroyed.
+// Post-Conditions: Returns a read-only view of the first size associations
+// of my_scope (sharing them), which can be looked up in like a scope.
+// Produces error message if space cannot be allocated.
+extern scope* scope_view(scope* my_scope, unsigned int size);
+
+// Pre-Conditions: view was returned by scope_view.
+// Post-Conditions: Frees the view, but not the associations it shares.
+extern void scope_view_destroy(scope* view);
+
 // Pre-Conditions: my_scope is not NULL.
 // Post-Conditions: Returns the number of associations in my_scope.
 extern address_type scope_loc_count(scope* my_scope);
@@ -52,14 +71,33 @@ extern bool scope_declared(scope* my_scope, const char* my_name);
 // Pre-Conditions: my_scope, my_name, the associations in the scope,
 // the names of all scope associations, and my_attrs are all not NULL, 
 // my_name has no association in my_scope, my_scope is not full.
-// Post-Conditions: Inserts an association of my_name to my_attrs into
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs
+// (with its offset count set to the number of associations before it) into
 // my_scope. Produces an error message if space cannot be allocated.
 extern void scope_insert(scope* my_scope, const char* my_name, id_attrs* my_attrs);
 
+// Pre-Conditions: my_scope, my_name and my_attrs are not NULL, hash is
+// hash_name(my_name), the caller has made sure my_name has no association
+// in my_scope, my_scope is not full.
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs
+// (with its offset count set to the number of associations before it) into
+// my_scope, without searching it first. Produces an error message if space
+// cannot be allocated.
+extern void scope_append(scope* my_scope, const char* my_name, unsigned long long hash, id_attrs* my_attrs);
+
 // Pre-Conditions: my_scope, my_name, the associations in the scope,
 // and the names of all scope associations are not NULL.
-// Post-Conditions: Returns the attributes of the association that my_name has,
-// returns NULL if an association cannot be found for my_name.
+// Post-Conditions: Returns the attributes of the association that my_name has
+// (which stay where they are until an association is next inserted into
+// my_scope or it is destroyed), returns NULL if an association cannot be
+// found for my_name.
 extern id_attrs* scope_lookup(scope* my_scope, const char* my_name);
 
+// Pre-Conditions: my_scope, my_name, the associations in the scope,
+// and the names of all scope associations are not NULL,
+// hash is hash_name(my_name).
+// Post-Conditions: Returns what scope_lookup(my_scope, my_name) returns,
+// but only compares names if my_scope's Bloom filter says my_name may be there
+extern id_attrs* scope_lookup_hashed(scope* my_scope, const char* my_name, unsigned long long hash);
+
 #endif
\ No newline at end of file
@@ -5,32 +5,295 @@
 #include "id_use.h"
 #include "id_attrs.h"
 #include "utilities.h"
+#include "alloc_stats.h"
 #include "scope_check.h"
 #include "symtab.h"
+#include "proc_cache.h"
+#include "ast_visit.h"
+#include "trace.h"
+#include "diagnostics.h"
+#include "task_pool.h"
+
+// Declaration checking is done by the ast_visit callbacks below, so nesting
+// depth is not limited by the C stack; they need no data of their own.
+
+// Pre-Conditions: n is a block node
+// Post-Conditions: Enters the block's scope
+static bool scope_check_block_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    symtab_enter_scope(); // Enter scope
+    return true;
+}
+
+// Pre-Conditions: n is a block node whose contents have been checked
+// Post-Conditions: Exits the block's scope
+static void scope_check_block_post(void* data, const ast_visit_node* n, const ast_visit_node* parent)
+{
+    symtab_exit_scope(); // Exit scope
+}
+
+// Pre-Conditions: n is a const_def node
+// Post-Conditions: Declares the constant, produces an error message if duplicate
+static bool scope_check_const_def_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    scope_check_declare_ident(((const const_def_t*) n->node)->ident, constant_idk);
+    return true;
+}
+
+// Pre-Conditions: n is an ident node
+// Post-Conditions: Declares the identifier if it is in a var_decl, otherwise
+// produces an error message if it has not been declared
+static bool scope_check_ident_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const ident_t* ident = n->node;
+
+    if (parent != NULL && parent->type_tag == var_decl_ast) // Identifier being declared
+    {
+        scope_check_declare_ident(*ident, variable_idk);
+    }
+
+    else if (ident->file_loc != NULL) // Identifier being used
+    {
+        scope_check_ident_declared(*(ident->file_loc), ident->name, ident->hash);
+    }
+
+    return true;
+}
+
+// Pre-Conditions: n is a proc_decl node
+// Post-Conditions: Declares the procedure, produces an error message if duplicate,
+// returns false (skipping the block) if there is no block to check or the block
+// already passed in this same environment
+static bool scope_check_proc_decl_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const proc_decl_t* procD = n->node;
+
+    if (procD->file_loc == NULL)
+    {
+        return false;
+    }
+
+    scope_check_declare_name(*(procD->file_loc), procD->name, procD->hash, procedure_idk); // Add to symbol table
+
+    if (procD->block == NULL)
+    {
+        return false;
+    }
+
+    if (proc_cache_enabled() && proc_cache_checked(proc_cache_check_key(*procD)))
+    {
+        return false;
+    }
+
+    trace_begin("check", procD->name); // Ended in scope_check_proc_decl_post
+    return true;
+}
+
+// Pre-Conditions: n is a proc_decl node whose block has been checked
+// Post-Conditions: Records that the block passed, if the cache is enabled
+static void scope_check_proc_decl_post(void* data, const ast_visit_node* n, const ast_visit_node* parent)
+{
+    trace_end();
+
+    // Once an error is saved (see diagnostics.h), blocks may not have passed
+    if (proc_cache_enabled() && diagnostics_count() == 0)
+    {
+        // The visible declarations are the same as before the block was checked
+        proc_cache_record_checked(proc_cache_check_key(*(const proc_decl_t*) n->node));
+    }
+}
+
+// Pre-Conditions: floc is the file location of an assign, call or read
+// statement, my_name is the identifier it names and hash is its hash
+// Post-Conditions: Produces an error message if my_name has not been declared
+static bool scope_check_named_stmt(const file_location* floc, const char* my_name, unsigned long long hash)
+{
+    if (floc != NULL)
+    {
+        scope_check_ident_declared(*floc, my_name, hash); // Make sure ident is declared
+    }
+
+    return true;
+}
+
+// Pre-Conditions: n is an assign_stmt node
+// Post-Conditions: Checks that the assigned identifier is declared
+static bool scope_check_assign_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const assign_stmt_t* aStmt = n->node;
+    return scope_check_named_stmt(aStmt->file_loc, aStmt->name, aStmt->hash);
+}
+
+// Pre-Conditions: n is a call_stmt node
+// Post-Conditions: Checks that the called identifier is declared
+static bool scope_check_call_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const call_stmt_t* cStmt = n->node;
+    return scope_check_named_stmt(cStmt->file_loc, cStmt->name, cStmt->hash);
+}
+
+// Pre-Conditions: n is a read_stmt node
+// Post-Conditions: Checks that the identifier read into is declared
+static bool scope_check_read_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const read_stmt_t* rStmt = n->node;
+    return scope_check_named_stmt(rStmt->file_loc, rStmt->name, rStmt->hash);
+}
+
+static const ast_visitor scope_check_visitor = {
+    .pre = {
+        [block_ast] = scope_check_block_pre,
+        [const_def_ast] = scope_check_const_def_pre,
+        [ident_ast] = scope_check_ident_pre,
+        [proc_decl_ast] = scope_check_proc_decl_pre,
+        [assign_stmt_ast] = scope_check_assign_pre,
+        [call_stmt_ast] = scope_check_call_pre,
+        [read_stmt_ast] = scope_check_read_pre,
+    },
+    .post = {
+        [block_ast] = scope_check_block_post,
+        [proc_decl_ast] = scope_check_proc_decl_post,
+    },
+};
+
+static int parallel_jobs = 1; // Threads for checking procedures at once
+
+// Pre-Conditions: Checking has not started, jobs is positive
+// Post-Conditions: If jobs is more than 1, makes scope_check_program check
+// the blocks of the procedures declared in the program's block on jobs
+// threads at once; each sees a snapshot of the program's scope with the
+// declarations before it (and itself), and errors are still reported
+// in source order (see diagnostics_set_group)
+void scope_check_parallel_enable(int jobs)
+{
+    parallel_jobs = jobs;
+}
+
+// A procedure's block to check on a worker thread
+typedef struct
+{
+    proc_decl_t procD; // Its block is NULL if there is nothing to check
+    unsigned int visible; // Size of the program's scope it sees
+    symtab_snapshot snap; // What it sees
+    unsigned int group; // Its errors' group, for reporting in source order
+} proc_check_task;
+
+// Pre-Conditions: arg is a proc_check_task whose snapshot is taken
+// Post-Conditions: Performs declaration checking on the procedure's block
+// in the calling thread's symbol table, on top of the snapshot
+static void scope_check_proc_task(void* arg)
+{
+    proc_check_task* task = arg;
+
+    diagnostics_set_group(task->group);
+    symtab_use_snapshot(task->snap);
+    trace_begin("check", task->procD.name);
+    ast_visit(&scope_check_visitor, NULL, block_ast, task->procD.block, 0);
+    trace_end();
+    symtab_leave_snapshot();
+    diagnostics_set_group(0);
+}
+
+// Pre-Conditions: Block is a valid block AST
+// Post-Conditions: Performs declaration checking on block, as the visitor
+// does, but checks the blocks of its procedures on parallel_jobs threads
+static void scope_check_program_parallel(block_t block)
+{
+    unsigned int count = block.proc_decls.count;
+
+    // Errors are saved until checking is done, then put in source order:
+    // group 0 for the constants and variables, then groups 2i+1 and 2i+2
+    // for the i-th procedure's name and block, then the statements
+    if (!diagnostics_collecting()) diagnostics_defer();
+
+    scope_check_program_decls(block.const_decls, block.var_decls);
+
+    proc_check_task* tasks = (proc_check_task*)alloc_malloc_in(alloc_traversal, count * sizeof(proc_check_task)); // FREE THIS
+    if (tasks == NULL) bail_with_error("No space to allocate procedure checks!");
+
+    task_pool* pool = task_pool_create(parallel_jobs);
+
+    // Declare the procedures in order, noting what each one can see
+    for (unsigned int i = 0; i < count; i++)
+    {
+        tasks[i].procD = block.proc_decls.elems[i];
+
+        if (tasks[i].procD.file_loc == NULL)
+        {
+            tasks[i].procD.block = NULL;
+            continue;
+        }
+
+        diagnostics_set_group(2 * i + 1);
+        scope_check_declare_name(*(tasks[i].procD.file_loc), tasks[i].procD.name, tasks[i].procD.hash, procedure_idk);
+        tasks[i].visible = symtab_scope_size();
+        tasks[i].group = 2 * i + 2;
+
+        // A persistent snapshot is not changed by the declarations after it,
+        // so the block can be checked while they are made
+        if (symtab_persistent())
+        {
+            tasks[i].snap = symtab_take_snapshot(tasks[i].visible);
+            task_pool_submit(pool, scope_check_proc_task, &tasks[i]);
+        }
+    }
+
+    // Otherwise the program's scope does not change while the blocks are checked
+    for (unsigned int i = 0; i < count && !symtab_persistent(); i++)
+    {
+        if (tasks[i].procD.block != NULL)
+        {
+            tasks[i].snap = symtab_take_snapshot(tasks[i].visible);
+            task_pool_submit(pool, scope_check_proc_task, &tasks[i]);
+        }
+    }
+
+    task_pool_destroy(pool); // Waits for the checks to finish
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (tasks[i].procD.block != NULL) symtab_free_snapshot(tasks[i].snap);
+    }
+
+    alloc_free(tasks);
+
+    diagnostics_set_group(2 * count + 1);
+    scope_check_program_stmts(block.stmts);
+    diagnostics_set_group(0);
+}
 
 // Pre-Conditions: Block is a valid block AST
 // Post-Conditions: Performs declaration checking on block
 block_t scope_check_program(block_t block)
 {
-    symtab_enter_scope(); // Enter scope
-    scope_check_constDecls(block.const_decls); // Check const declarations
-    scope_check_varDecls(block.var_decls); // Check var declarations
-    scope_check_procDecls(block.proc_decls); // Check proc declarations
-    block.stmts = scope_check_stmts(block.stmts); // Check statements declarations
-    symtab_exit_scope(); // Exit scope
+    // Cached results depend on the whole environment, so use one thread then
+    if (parallel_jobs > 1 && block.proc_decls.count > 1 && !proc_cache_enabled())
+    {
+        scope_check_program_parallel(block);
+        return block;
+    }
+
+    ast_visit(&scope_check_visitor, NULL, block_ast, &block, 0);
     return block;
 }
 
+// The entry points below check one part of a program (in the current scope)
+// by visiting it with the callbacks above.
+
+// Pre-Conditions: node is an AST of the kind given by type_tag (see ast_visit.h)
+// Post-Conditions: Performs declaration checking on node
+static void scope_check_node(AST_type type_tag, const void* node)
+{
+    ast_visit(&scope_check_visitor, NULL, type_tag, node, 0);
+}
+
 // Pre-Conditions: varDs is a valid var_decls AST
 // Post-Conditions: Performs declaration checking on varDs
 void scope_check_varDecls(var_decls_t varDs)
 {
-    var_decl_t* varDeclPtr = varDs.var_decls; // Start at first varDecl
-    
-    while (varDeclPtr != NULL) // Iterate through each varDecl
+    ast_list_for_each(var_decl_t, varDeclPtr, varDs) // Iterate through each varDecl
     {
         scope_check_varDecl(*varDeclPtr); // Check varDecl
-        varDeclPtr = varDeclPtr->next; // Move to next one
     }
 }
 
@@ -38,19 +301,16 @@ void scope_check_varDecls(var_decls_t varDs)
 // Post-Conditions: Performs declaration checking on varD
 void scope_check_varDecl(var_decl_t varD)
 {
-    scope_check_idents(varD.ident_list, variable_idk); // Scope check identifiers
+    scope_check_node(var_decl_ast, &varD);
 }
 
 // Pre-Conditions: constDecls is a valid const_decls AST
 // Post-Conditions: Performs declaration checking on constDecls
 void scope_check_constDecls(const_decls_t constDecls)
 {
-    const_decl_t* constDeclPtr = constDecls.start; // Start at first constDecl
-
-    while (constDeclPtr != NULL) // Iterate through each constDecl
+    ast_list_for_each(const_decl_t, constDeclPtr, constDecls) // Iterate through each constDecl
     {
         scope_check_constDecl(*constDeclPtr); // Scope check constDecl
-        constDeclPtr = constDeclPtr->next; // Move to next one
     }
 }
 
@@ -58,19 +318,16 @@ void scope_check_constDecls(const_decls_t constDecls)
 // Post-Conditions: Performs declaration checking on constDecl
 void scope_check_constDecl(const_decl_t constDecl)
 {
-    scope_check_constDefList(constDecl.const_def_list); // Scope check constDefList
+    scope_check_node(const_decl_ast, &constDecl);
 }
 
 // Pre-Conditions: constDefs is a valid const_def_list AST
 // Post-Conditions: Performs declaration checking on constDefs
 void scope_check_constDefList(const_def_list_t constDefs)
 {
-    const_def_t* constDefPtr = constDefs.start; // Start at first constDef
-
-    while (constDefPtr != NULL) // Iterate through each constDef
+    ast_list_for_each(const_def_t, constDefPtr, constDefs) // Iterate through each constDef
     {
         scope_check_constDef(*constDefPtr); // Scope check constDef
-        constDefPtr = constDefPtr->next; // Move to next one
     }
 }
 
@@ -78,19 +335,16 @@ void scope_check_constDefList(const_def_list_t constDefs)
 // Post-Conditions: Performs declaration checking on constDef
 void scope_check_constDef(const_def_t constDef)
 {
-    scope_check_declare_ident(constDef.ident, constant_idk); // Scope check identifier
+    scope_check_node(const_def_ast, &constDef);
 }
 
 // Pre-Conditions: procDs is a valid proc_decls AST
 // Post-Conditions: Performs declaration checking on procDs
 void scope_check_procDecls(proc_decls_t procDs)
 {
-    proc_decl_t* procDeclPtr = procDs.proc_decls; // Start at first procDecl
-
-    while (procDeclPtr != NULL) // Iterate through each procDecl
+    ast_list_for_each(proc_decl_t, procDeclPtr, procDs) // Iterate through each procDecl
     {
         scope_check_procDecl(*procDeclPtr); // Scope check procDecl
-        procDeclPtr = procDeclPtr->next; // Move to next one
     }
 }
 
@@ -98,67 +352,63 @@ void scope_check_procDecls(proc_decls_t procDs)
 // Post-Conditions: Performs declaration checking on procD
 void scope_check_procDecl(proc_decl_t procD)
 {
-    if (symtab_name_declared_currently(procD.name)) // If duplicate declaration, produce error
-    {
-        if (procD.file_loc != NULL)
-        {
-            bail_with_prog_error(*(procD.file_loc), "%s \"%s\" is already declared as a %s", 
-                                 kind2str(procedure_idk), procD.name, kind2str((symtab_lookup(procD.name))->attrs->kind));
-        }
-    }
-
-    else // No duplicate declaration, add to symbol table
-    {
-        int ofst_cnt = symtab_scope_loc_count(); // Record offset
-
-        if (procD.file_loc != NULL)
-        {
-            id_attrs* my_attrs = create_id_attrs(*(procD.file_loc), procedure_idk, ofst_cnt); // Create attributes // FREE THIS
-            symtab_insert(procD.name, my_attrs); // Insert into symbol table
-
-            if (procD.block != NULL)
-            {
-                *(procD.block) = scope_check_program(*procD.block); // Scope check procedure block
-            }
-        }
-    }
+    scope_check_node(proc_decl_ast, &procD);
 }
 
 // Pre-Conditions: idents is a valid ident_list AST
 // Post-Conditions: Performs declaration checking on idents
 void scope_check_idents(ident_list_t idents, id_kind kind)
 {
-    ident_t* identPtr = idents.start; // Start at first identifier
-
-    while (identPtr != NULL) // Iterate through each identifier
+    ast_list_for_each(ident_t, identPtr, idents) // Iterate through each identifier
     {
         scope_check_declare_ident(*identPtr, kind); // Scope check identifier
-        identPtr = identPtr->next; // Move to next one
     }
 }
 
-// Pre-Conditions: ident is a valid ident AST
-// Post-Conditions: Performs declaration checking on ident 
-void scope_check_declare_ident(ident_t ident, id_kind kind)
+// Pre-Conditions: cds and vds are the declarations of constants and variables
+// of the program's block, and the symbol table is initialized and empty
+// Post-Conditions: Enters the program's scope and performs declaration
+// checking on cds and vds
+void scope_check_program_decls(const_decls_t cds, var_decls_t vds)
 {
-    if (symtab_name_declared_currently(ident.name)) // Check for duplicate declaration
+    symtab_enter_scope(); // Enter the program's scope
+
+    for (unsigned int i = 0; i < cds.count; i++)
     {
-        if (ident.file_loc != NULL)
-        {
-            bail_with_prog_error(*(ident.file_loc), "%s \"%s\" is already declared as a %s", 
-                                 kind2str(kind), ident.name, kind2str((symtab_lookup(ident.name))->attrs->kind));
-        }
+        ast_visit(&scope_check_visitor, NULL, const_decl_ast, &cds.elems[i], 0);
     }
 
-    else // No duplicate declaration, add to symbol table
+    for (unsigned int i = 0; i < vds.count; i++)
     {
-        int ofst_cnt = symtab_scope_loc_count(); // Record offset
+        ast_visit(&scope_check_visitor, NULL, var_decl_ast, &vds.elems[i], 0);
+    }
+}
 
-        if (ident.file_loc != NULL)
-        {
-            id_attrs* my_attrs = create_id_attrs(*(ident.file_loc), kind, ofst_cnt); // Create attributes // FREE THIS
-            symtab_insert(ident.name, my_attrs); // Insert into symbol table
-        }
+// Pre-Conditions: scope_check_program_decls has been called, procD is
+// a valid proc_decl AST of a procedure declared in the program's block
+// Post-Conditions: Performs declaration checking on procD
+void scope_check_program_proc(proc_decl_t procD)
+{
+    ast_visit(&scope_check_visitor, NULL, proc_decl_ast, &procD, 0);
+}
+
+// Pre-Conditions: scope_check_program_decls has been called, stmts is
+// a valid stmts AST of the program's block
+// Post-Conditions: Performs declaration checking on stmts and exits
+// the program's scope
+void scope_check_program_stmts(stmts_t stmts)
+{
+    ast_visit(&scope_check_visitor, NULL, stmts_ast, &stmts, 0);
+    symtab_exit_scope(); // Exit the program's scope
+}
+
+// Pre-Conditions: ident is a valid ident AST
+// Post-Conditions: Performs declaration checking on ident 
+void scope_check_declare_ident(ident_t ident, id_kind kind)
+{
+    if (ident.file_loc != NULL)
+    {
+        scope_check_declare_name(*(ident.file_loc), ident.name, ident.hash, kind);
     }
 }
 
@@ -166,35 +416,9 @@ void scope_check_declare_ident(ident_t ident, id_kind kind)
 // Post-Conditions: Performs declaration checking on statement
 stmt_t scope_check_stmt(stmt_t statement)
 {
-    // Switch statement determines what kind of statement, scope checks accordingly
-    switch (statement.stmt_kind)
-    {
-        case assign_stmt:
-            statement.data.assign_stmt = scope_check_assignStmt(statement.data.assign_stmt);
-            break;
-        case call_stmt:
-            statement.data.call_stmt = scope_check_callStmt(statement.data.call_stmt);
-            break;
-        case if_stmt:
-            statement.data.if_stmt = scope_check_ifStmt(statement.data.if_stmt);
-            break;
-        case while_stmt:
-            statement.data.while_stmt = scope_check_whileStmt(statement.data.while_stmt);
-            break;
-        case read_stmt:
-            statement.data.read_stmt = scope_check_readStmt(statement.data.read_stmt);
-            break;
-        case print_stmt:
-            statement.data.print_stmt = scope_check_printStmt(statement.data.print_stmt);
-            break;
-        case block_stmt:
-            statement.data.block_stmt = scope_check_blockStmt(statement.data.block_stmt);
-            break;
-        default: // If none of the previous cases match, produce error
-            bail_with_error("Attempted to scope check an invalid statement kind!");
-            break;
-    }
-
+    const void* node;
+    AST_type type_tag = ast_visit_stmt_node(&statement, &node);
+    scope_check_node(type_tag, node);
     return statement;
 }
 
@@ -202,16 +426,7 @@ stmt_t scope_check_stmt(stmt_t statement)
 // Post-Conditions: Performs declaration checking on aStmt
 assign_stmt_t scope_check_assignStmt(assign_stmt_t aStmt)
 {
-    if (aStmt.file_loc != NULL)
-    {
-        scope_check_ident_declared(*(aStmt.file_loc), aStmt.name); // Make sure ident is declared
-
-        if (aStmt.expr != NULL)
-        {
-            *(aStmt.expr) = scope_check_expr(*(aStmt.expr)); // Scope check expression
-        }
-    }
-
+    scope_check_node(assign_stmt_ast, &aStmt);
     return aStmt;
 }
 
@@ -219,11 +434,7 @@ assign_stmt_t scope_check_assignStmt(assign_stmt_t aStmt)
 // Post-Conditions: Performs declaration checking on cStmt
 call_stmt_t scope_check_callStmt(call_stmt_t cStmt)
 {
-    if (cStmt.file_loc != NULL)
-    {
-        scope_check_ident_declared(*(cStmt.file_loc), cStmt.name); // Make sure ident is declared
-    }
-
+    scope_check_node(call_stmt_ast, &cStmt);
     return cStmt;
 }
 
@@ -231,18 +442,7 @@ call_stmt_t scope_check_callStmt(call_stmt_t cStmt)
 // Post-Conditions: Performs declaration checking on iStmt
 if_stmt_t scope_check_ifStmt(if_stmt_t iStmt)
 {
-    iStmt.condition = scope_check_condition(iStmt.condition); // Scope check condition
-
-    if (iStmt.then_stmts != NULL)
-    {
-        *(iStmt.then_stmts) = scope_check_stmts(*(iStmt.then_stmts)); // Scope check then statements
-    }
-
-    if (iStmt.else_stmts != NULL) // If there are else statements, scope check those too
-    {
-        *(iStmt.else_stmts) = scope_check_stmts(*(iStmt.else_stmts));
-    }
-
+    scope_check_node(if_stmt_ast, &iStmt);
     return iStmt;
 }
 
@@ -250,13 +450,7 @@ if_stmt_t scope_check_ifStmt(if_stmt_t iStmt)
 // Post-Conditions: Performs declaration checking on wStmt
 while_stmt_t scope_check_whileStmt(while_stmt_t wStmt)
 {
-    wStmt.condition = scope_check_condition(wStmt.condition); // Scope check condition
-
-    if (wStmt.body != NULL)
-    {
-        *(wStmt.body) = scope_check_stmts(*(wStmt.body)); // Scope check statements in body of loop
-    }
-
+    scope_check_node(while_stmt_ast, &wStmt);
     return wStmt;
 }
 
@@ -264,11 +458,7 @@ while_stmt_t scope_check_whileStmt(while_stmt_t wStmt)
 // Post-Conditions: Performs declaration checking on rStmt
 read_stmt_t scope_check_readStmt(read_stmt_t rStmt)
 {
-    if (rStmt.file_loc != NULL)
-    {
-        scope_check_ident_declared(*(rStmt.file_loc), rStmt.name); // Make sure ident is declared
-    }
-
+    scope_check_node(read_stmt_ast, &rStmt);
     return rStmt;
 }
 
@@ -276,8 +466,7 @@ read_stmt_t scope_check_readStmt(read_stmt_t rStmt)
 // Post-Conditions: Performs declaration checking on pStmt
 print_stmt_t scope_check_printStmt(print_stmt_t pStmt)
 {
-    pStmt.expr = scope_check_expr(pStmt.expr); // Scope check expression
-
+    scope_check_node(print_stmt_ast, &pStmt);
     return pStmt;
 }
 
@@ -285,11 +474,7 @@ print_stmt_t scope_check_printStmt(print_stmt_t pStmt)
 // Post-Conditions: Performs declaration checking on bStmt
 block_stmt_t scope_check_blockStmt(block_stmt_t bStmt)
 {
-    if (bStmt.block != NULL)
-    {
-        *(bStmt.block) = scope_check_program(*(bStmt.block)); // Scope check block
-    }
-
+    scope_check_node(block_stmt_ast, &bStmt);
     return bStmt;
 }
 
@@ -297,36 +482,17 @@ block_stmt_t scope_check_blockStmt(block_stmt_t bStmt)
 // Post-Conditions: Performs declaration checking on statements
 stmts_t scope_check_stmts(stmts_t statements)
 {
-    // Switch statement to determine what kind of statements, scope check accordingly
-    switch (statements.stmts_kind)
-    {
-        case empty_stmts_e:
-            // No statements, do nothing
-            break;
-        case stmt_list_e: // Actual statements exist
-            if (statements.stmt_list.start != NULL) // Redundant check, shouldn't be empty
-            {
-                statements.stmt_list = scope_check_stmtList(statements.stmt_list); // Scope check statements
-            }
-            break;
-        default:
-            bail_with_error("Attempted to scope check statements with an invalid statements kind!");
-            break;
-    }
-
+    scope_check_node(stmts_ast, &statements);
     return statements;
 }
 
 // Pre-Conditions: stmtList is a valid stmt_list AST
-// Post-Conditions: Performs declaration checking on stmtList 
+// Post-Conditions: Performs declaration checking on stmtList
 stmt_list_t scope_check_stmtList(stmt_list_t stmtList)
 {
-    stmt_t* stmtListPtr = stmtList.start; // Start at first statement
-    
-    while (stmtListPtr != NULL) // Iterate through each statement
+    ast_list_for_each(stmt_t, stmtPtr, stmtList) // Iterate through each statement
     {
-        *stmtListPtr = scope_check_stmt(*stmtListPtr); // Scope check statement
-        stmtListPtr = stmtListPtr->next; // Move to the next one
+        scope_check_stmt(*stmtPtr); // Scope check statement
     }
 
     return stmtList;
@@ -336,25 +502,9 @@ stmt_list_t scope_check_stmtList(stmt_list_t stmtList)
 // Post-Conditions: Performs declaration checking on expression
 expr_t scope_check_expr(expr_t expression)
 {
-    // Switch statement determines what kind of expression, scope check accordingly
-    switch (expression.expr_kind)
-    {
-        case expr_bin:
-            expression.data.binary = scope_check_bin_op_expr(expression.data.binary);
-            break;
-        case expr_negated:
-            expression.data.negated = scope_check_neg_expr(expression.data.negated);
-            break;
-        case expr_ident:
-            expression.data.ident = scope_check_ident_expr(expression.data.ident);
-            break;
-        case expr_number:
-            // Number means no identifiers to scope check, do nothing
-            break;
-        default: // If none of the previous cases match, produce error
-            bail_with_error("Attempted to scope check an invalid expression kind!");
-    }
-
+    const void* node;
+    AST_type type_tag = ast_visit_expr_node(&expression, &node);
+    scope_check_node(type_tag, node);
     return expression;
 }
 
@@ -362,12 +512,7 @@ expr_t scope_check_expr(expr_t expression)
 // Post-Conditions: Performs declaration checking on binOpExpr
 binary_op_expr_t scope_check_bin_op_expr(binary_op_expr_t binOpExpr)
 {
-    if (binOpExpr.expr1 != NULL && binOpExpr.expr2 != NULL)
-    {
-        *(binOpExpr.expr1) = scope_check_expr(*(binOpExpr.expr1)); // Scope check first expression
-        *(binOpExpr.expr2) = scope_check_expr(*(binOpExpr.expr2)); // Scope check second expression
-    }
-
+    scope_check_node(binary_op_expr_ast, &binOpExpr);
     return binOpExpr;
 }
 
@@ -375,11 +520,7 @@ binary_op_expr_t scope_check_bin_op_expr(binary_op_expr_t binOpExpr)
 // Post-Conditions: Performs declaration checking on negExpr
 negated_expr_t scope_check_neg_expr(negated_expr_t negExpr)
 {
-    if (negExpr.expr != NULL)
-    {
-        *(negExpr.expr) = scope_check_expr(*(negExpr.expr)); // Scope check the expression
-    }
-
+    scope_check_node(negated_expr_ast, &negExpr);
     return negExpr;
 }
 
@@ -387,11 +528,7 @@ negated_expr_t scope_check_neg_expr(negated_expr_t negExpr)
 // Post-Conditions: Performs declaration checking on ident as an expression
 ident_t scope_check_ident_expr(ident_t ident)
 {
-    if (ident.file_loc != NULL)
-    {
-        scope_check_ident_declared(*(ident.file_loc), ident.name); // Scope check identifier
-    }
-
+    scope_check_node(ident_ast, &ident);
     return ident;
 }
 
@@ -399,32 +536,159 @@ ident_t scope_check_ident_expr(ident_t ident)
 // Post-Conditions: Performs declaration checking on condition
 condition_t scope_check_condition(condition_t condition)
 {
-    // Switch statement determines what kind of condition, scope check accordingly
-    switch (condition.cond_kind)
+    const void* node;
+    AST_type type_tag = ast_visit_condition_node(&condition, &node);
+    scope_check_node(type_tag, node);
+    return condition;
+}
+
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name),
+// floc is a valid file location
+// Post-Conditions: Declares my_name with the given kind in the current scope,
+// produces an error message if my_name is already declared in that scope
+void scope_check_declare_name(file_location floc, const char* my_name, unsigned long long hash, id_kind kind)
+{
+    if (symtab_name_declared_currently_hashed(my_name, hash)) // Check for duplicate declaration
     {
-        case ck_db:
-            condition.data.db_cond.dividend = scope_check_expr(condition.data.db_cond.dividend); // Scope check dividend expression
-            condition.data.db_cond.divisor = scope_check_expr(condition.data.db_cond.divisor); // Scope check divisor expression
-            break;
-        case ck_rel:
-            condition.data.rel_op_cond.expr1 = scope_check_expr(condition.data.rel_op_cond.expr1); // Scope check first expression
-            condition.data.rel_op_cond.expr2 = scope_check_expr(condition.data.rel_op_cond.expr2); // Scope check second expression
-            break;
-        default: // If none of the previous cases match, produce error
-            bail_with_error("Attempted to scope check an invalid condition kind!");
-            break;
+        id_use* prev = symtab_lookup_hashed(my_name, hash);
+        id_kind prev_kind = id_attrs_kind(prev->attrs);
+        alloc_free(prev);
+        prog_error(floc, "%s \"%s\" is already declared as a %s",
+                   kind2str(kind), my_name, kind2str(prev_kind));
+        // If errors are being saved, keep the first declaration and go on
     }
 
-    return condition;
+    else // No duplicate declaration, add to symbol table
+    {
+        int ofst_cnt = symtab_scope_loc_count(); // Record offset
+        id_attrs my_attrs = id_attrs_make(floc, kind, ofst_cnt); // Create attributes
+        symtab_insert_hashed(my_name, hash, &my_attrs); // Insert a copy into symbol table
+    }
 }
 
-// Pre-Conditions: my_name is not NULL, floc is a valid file location
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name),
+// floc is a valid file location
 // Post-Conditions: Checks if the identifier associated with my_name
 // has been previously declared in the program
-void scope_check_ident_declared(file_location floc, const char* my_name)
+void scope_check_ident_declared(file_location floc, const char* my_name, unsigned long long hash)
 {
-    if (!symtab_name_declared(my_name)) // If my_name was not declared previously, produce error
+    if (!symtab_name_declared_hashed(my_name, hash)) // If my_name was not declared previously, produce error
     {
-        bail_with_prog_error(floc, "identifier \"%s\" is not declared!", my_name);
+        prog_error(floc, "identifier \"%s\" is not declared!", my_name);
+
+        // If errors are being saved, declare my_name here, so its other uses
+        // in this scope are not reported again
+        id_attrs my_attrs = id_attrs_make(floc, variable_idk, symtab_scope_loc_count());
+        symtab_insert_hashed(my_name, hash, &my_attrs);
     }
 }
+
+// Pre-Conditions: n is a node of fa that uses the identifier in its aux string
+// Post-Conditions: Checks that the identifier has been declared
+static void scope_check_flat_use(const flat_ast* fa, const flat_node* n)
+{
+    const char* my_name = flat_ast_str(fa, n->aux); // The image has no hashes, so hash it here
+    scope_check_ident_declared(flat_ast_file_loc(fa, n), my_name, hash_name(my_name));
+}
+
+// Pre-Conditions: n is a node of fa that declares the identifier in its aux string
+// Post-Conditions: Declares the identifier with the given kind in the current scope
+static void scope_check_flat_declare(const flat_ast* fa, const flat_node* n, id_kind kind)
+{
+    const char* my_name = flat_ast_str(fa, n->aux);
+    scope_check_declare_name(flat_ast_file_loc(fa, n), my_name, hash_name(my_name), kind);
+}
+
+// Flat ASTs are checked by ast_visit_flat with the block callbacks above
+// and the ones below, whose data is the flat_ast being checked.
+
+// Pre-Conditions: n is a const_def node of the flat AST data
+// Post-Conditions: Declares the constant, produces an error message if duplicate
+static bool scope_check_flat_const_def_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    scope_check_flat_declare(data, n->node, constant_idk);
+    return true;
+}
+
+// Pre-Conditions: n is an ident node of the flat AST data
+// Post-Conditions: Declares the identifier if it is in a var_decl, otherwise
+// produces an error message if it has not been declared
+static bool scope_check_flat_ident_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    if (parent != NULL && parent->type_tag == var_decl_ast) // Identifier being declared
+    {
+        scope_check_flat_declare(data, n->node, variable_idk);
+    }
+
+    else // Identifier being used
+    {
+        scope_check_flat_use(data, n->node);
+    }
+
+    return true;
+}
+
+// Pre-Conditions: n is a proc_decl node of the flat AST data
+// Post-Conditions: Declares the procedure, produces an error message if duplicate
+static bool scope_check_flat_proc_decl_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    const flat_ast* fa = data;
+    const flat_node* pd = n->node;
+    scope_check_flat_declare(fa, pd, procedure_idk);
+    trace_begin("check", flat_ast_str(fa, pd->aux)); // Ended in scope_check_flat_proc_decl_post
+    return true;
+}
+
+// Pre-Conditions: n is a proc_decl node of the flat AST data whose block has been checked
+// Post-Conditions: Ends the procedure's trace span
+static void scope_check_flat_proc_decl_post(void* data, const ast_visit_node* n, const ast_visit_node* parent)
+{
+    trace_end();
+}
+
+// Pre-Conditions: n is an assign, call or read statement node of the flat AST data
+// Post-Conditions: Checks that the identifier it names is declared
+static bool scope_check_flat_named_stmt_pre(void* data, ast_visit_node* n, const ast_visit_node* parent)
+{
+    scope_check_flat_use(data, n->node);
+    return true;
+}
+
+static const ast_visitor scope_check_flat_visitor = {
+    .pre = {
+        [block_ast] = scope_check_block_pre,
+        [const_def_ast] = scope_check_flat_const_def_pre,
+        [ident_ast] = scope_check_flat_ident_pre,
+        [proc_decl_ast] = scope_check_flat_proc_decl_pre,
+        [assign_stmt_ast] = scope_check_flat_named_stmt_pre,
+        [call_stmt_ast] = scope_check_flat_named_stmt_pre,
+        [read_stmt_ast] = scope_check_flat_named_stmt_pre,
+    },
+    .post = {
+        [block_ast] = scope_check_block_post,
+        [proc_decl_ast] = scope_check_flat_proc_decl_post,
+    },
+};
+
+// Pre-Conditions: fa is a valid flat AST (built in memory or mapped from an image)
+// Post-Conditions: Performs declaration checking on the program in fa
+void scope_check_flat(const flat_ast* fa)
+{
+    ast_visit_flat(&scope_check_flat_visitor, (void*) fa, fa, fa->root, 0);
+}
+
+static bool one_pass = false; // Is checking done by the parser?
+
+// Pre-Conditions: Parsing has not started
+// Post-Conditions: Turns on one-pass mode
+void scope_check_one_pass_enable()
+{
+    one_pass = true;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if one-pass mode is on
+bool scope_check_one_pass_enabled()
+{
+    return one_pass;
+}
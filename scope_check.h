@@ -3,13 +3,23 @@
 
 #ifndef _SCOPE_CHECK_H
 #define _SCOPE_CHECK_H
+#include <stdbool.h>
 #include "ast.h"
+#include "flat_ast.h"
 #include "id_use.h"
 
 // Pre-Conditions: Block is a valid block AST
 // Post-Conditions: Performs declaration checking on block
 extern block_t scope_check_program(block_t block);
 
+// Pre-Conditions: Checking has not started, jobs is positive
+// Post-Conditions: If jobs is more than 1, makes scope_check_program check
+// the blocks of the procedures declared in the program's block on jobs
+// threads at once; each sees a snapshot of the program's scope with the
+// declarations before it (and itself), and errors are still reported
+// in source order (see diagnostics_set_group)
+extern void scope_check_parallel_enable(int jobs);
+
 // Pre-Conditions: varDs is a valid var_decls AST
 // Post-Conditions: Performs declaration checking on varDs
 extern void scope_check_varDecls(var_decls_t varDs);
@@ -46,6 +56,27 @@ extern void scope_check_procDecl(proc_decl_t procD);
 // Post-Conditions: Performs declaration checking on idents
 extern void scope_check_idents(ident_list_t idents, id_kind kind);
 
+// The program's block can also be checked in pieces, in the order they
+// appear in it (as the parser finishes them, see check_pipe.h); the symbol
+// table then holds the declarations that come before each piece.
+
+// Pre-Conditions: cds and vds are the declarations of constants and variables
+// of the program's block, and the symbol table is initialized and empty
+// Post-Conditions: Enters the program's scope and performs declaration
+// checking on cds and vds
+extern void scope_check_program_decls(const_decls_t cds, var_decls_t vds);
+
+// Pre-Conditions: scope_check_program_decls has been called, procD is
+// a valid proc_decl AST of a procedure declared in the program's block
+// Post-Conditions: Performs declaration checking on procD
+extern void scope_check_program_proc(proc_decl_t procD);
+
+// Pre-Conditions: scope_check_program_decls has been called, stmts is
+// a valid stmts AST of the program's block
+// Post-Conditions: Performs declaration checking on stmts and exits
+// the program's scope
+extern void scope_check_program_stmts(stmts_t stmts);
+
 // Pre-Conditions: ident is a valid ident AST
 // Post-Conditions: Performs declaration checking on ident 
 extern void scope_check_declare_ident(ident_t ident, id_kind kind);
@@ -110,9 +141,32 @@ extern ident_t scope_check_ident_expr(ident_t ident);
 // Post-Conditions: Performs declaration checking on condition
 extern condition_t scope_check_condition(condition_t condition);
 
-// Pre-Conditions: my_name is not NULL, floc is a valid file location
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name),
+// floc is a valid file location
+// Post-Conditions: Declares my_name with the given kind in the current scope,
+// produces an error message if my_name is already declared in that scope
+extern void scope_check_declare_name(file_location floc, const char* my_name, unsigned long long hash, id_kind kind);
+
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name),
+// floc is a valid file location
 // Post-Conditions: Checks if the identifier associated with my_name
 // has been previously declared in the program
-extern void scope_check_ident_declared(file_location floc, const char* my_name);
+extern void scope_check_ident_declared(file_location floc, const char* my_name, unsigned long long hash);
+
+// Pre-Conditions: fa is a valid flat AST (built in memory or mapped from an image)
+// Post-Conditions: Performs declaration checking on the program in fa
+extern void scope_check_flat(const flat_ast* fa);
+
+// In one-pass mode, declaration checking is done by the parser's semantic
+// actions (see spl.y) as the program is parsed, instead of by a later
+// traversal of the AST; the symbol table must be initialized before parsing.
+
+// Pre-Conditions: Parsing has not started
+// Post-Conditions: Turns on one-pass mode
+extern void scope_check_one_pass_enable();
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if one-pass mode is on
+extern bool scope_check_one_pass_enabled();
 
 #endif
@@ -2,6 +2,30 @@
 
 %code top {
 #include <stdio.h>
+#include "spl_probes.h"
+
+ /* Bison's default location computation, which is done on every
+    reduction, with the spl:reduce probe added (see spl_probes.h) */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                 \
+    do                                                                  \
+      {                                                                 \
+        SPL_PROBE2(reduce, yyn, N);                                     \
+        if (N)                                                          \
+          {                                                             \
+            (Current).first_line   = YYRHSLOC (Rhs, 1).first_line;      \
+            (Current).first_column = YYRHSLOC (Rhs, 1).first_column;    \
+            (Current).last_line    = YYRHSLOC (Rhs, N).last_line;       \
+            (Current).last_column  = YYRHSLOC (Rhs, N).last_column;     \
+          }                                                             \
+        else                                                            \
+          {                                                             \
+            (Current).first_line   = (Current).last_line   =            \
+              YYRHSLOC (Rhs, 0).last_line;                              \
+            (Current).first_column = (Current).last_column =            \
+              YYRHSLOC (Rhs, 0).last_column;                            \
+          }                                                             \
+      }                                                                 \
+    while (0)
 }
 
 %code requires {
@@ -104,16 +128,53 @@ extern void yyerror(const char *filename, const char *msg);
 
 %start program
 
+ /* Only block's midrule action has a <generic> value, see block below */
+%destructor {
+    ONE_PASS(symtab_exit_scope());
+    ast_stream_block_discarded();
+    check_pipe_block_discarded();
+} <generic>
+
 %code {
  /* extern declarations provided by the lexer */
 extern int yylex(void);
 
+ /* call the lexer through phase_stats_lex, so --time-phases can time it,
+    unless the lexer runs on its own thread (see lex_pipe.h) */
+#include "phase_stats.h"
+#include "lex_pipe.h"
+#define yylex() \
+    (lex_pipe_running() ? lex_pipe_next(&yylval) : phase_stats_lex(yylex))
+
+#include <stdlib.h>
+#include "diagnostics.h"
+#include "symtab.h"
+#include "scope_check.h"
+#include "ast_stream.h"
+#include "check_pipe.h"
+#include "proc_cache.h"
+
+ /* In one-pass mode (see scope_check.h), do the checking done by stmt;
+    the actions below call these as the scopes, declarations and uses
+    of names are parsed */
+#define ONE_PASS(stmt) do { if (scope_check_one_pass_enabled()) { stmt; } } while (0)
+
+ /* Check that the name of the ident t is declared */
+#define CHECK_USE(t) ONE_PASS(scope_check_ident_declared(*((t).file_loc), (t).name, (t).hash))
+
  /* The AST for the program, set by the semantic action 
     for the nonterminal program. */
 block_t progast; 
 
  /* Set the program's ast to be t */
 extern void setProgAST(block_t t);
+
+ /* The parser reports syntax errors through syntax_error (see below) */
+static void syntax_error(const char *file_name, const char *msg);
+#define yyerror(file_name, msg) syntax_error(file_name, msg)
+
+ /* Return an AST for empty at the lexer's current line */
+static empty_t empty_here(void);
 }
 
 %%
@@ -122,46 +183,108 @@ extern void setProgAST(block_t t);
 program : block "." { setProgAST($1); } ;
 
 
-block : "begin" constDecls varDecls procDecls stmts "end" { $$ = ast_block($1, $2, $3, $4, $5); } ;
+ /* In one-pass mode a block's scope is entered by the typed midrule action
+    ($2 stands for the scope), so that the %destructor above exits the scope
+    if error recovery discards the block part way through */
+block : "begin"
+        <generic>{
+            ONE_PASS(symtab_enter_scope());
+            ast_stream_block_begin();
+            check_pipe_block_begin();
+            $$.file_loc = $1.file_loc;
+            $$.type_tag = block_ast;
+        }
+        constDecls varDecls
+        {
+            ast_stream_block_decls($3, $4);
+            check_pipe_block_decls($3, $4);
+        }
+        procDecls stmts "end"
+        {
+            (void) $2;
+            ast_stream_block_end($7);
+            check_pipe_block_end($7);
+            ONE_PASS(symtab_exit_scope());
+            $$ = ast_block($1, $3, $4, $6, $7);
+        } ;
 
 
+ /* A declaration with a syntax error is left out of the block */
 constDecls : empty { $$ = ast_const_decls_empty($1); }
-           | constDecls constDecl { $$ = ast_const_decls($1, $2); } ;
+           | constDecls constDecl { $$ = ast_const_decls($1, $2); }
+           | constDecls "const" error ";" { $$ = $1; } ;
 
 constDecl : "const" constDefList ";" { $$ = ast_const_decl($2); } ;
 
 constDefList : constDef { $$ = ast_const_def_list_singleton($1); }
              | constDefList "," constDef { $$ = ast_const_def_list($1, $3); } ;
 
-constDef : identsym "=" numbersym { $$ = ast_const_def($1, $3); } ;
+constDef : identsym "=" numbersym
+           {
+               ONE_PASS(scope_check_declare_ident($1, constant_idk));
+               $$ = ast_const_def($1, $3);
+           } ;
 
 
 varDecls : empty { $$ = ast_var_decls_empty($1); }
-         | varDecls varDecl { $$ = ast_var_decls($1, $2); } ;
+         | varDecls varDecl { $$ = ast_var_decls($1, $2); }
+         | varDecls "var" error ";" { $$ = $1; } ;
 
 varDecl : "var" identList ";" { $$ = ast_var_decl($2); } ;
 
-identList : identsym { $$ = ast_ident_list_singleton($1); }
-          | identList "," identsym { $$ = ast_ident_list($1, $3); } ;
+identList : identsym
+            {
+                ONE_PASS(scope_check_declare_ident($1, variable_idk));
+                $$ = ast_ident_list_singleton($1);
+            }
+          | identList "," identsym
+            {
+                ONE_PASS(scope_check_declare_ident($3, variable_idk));
+                $$ = ast_ident_list($1, $3);
+            } ;
 
 
 procDecls : empty { $$ = ast_proc_decls_empty($1); }
           | procDecls procDecl { $$ = ast_proc_decls($1, $2); } ;
 
-procDecl : "proc" identsym block ";" { $$ = ast_proc_decl($2, $3); } ;
+ /* The procedure is declared before its block, so it can call itself.
+    When streaming (see ast_stream.h), its block's AST is freed once it
+    has been printed, unless the parser has already read the next token
+    (whose text would be freed with it) */
+procDecl : "proc" identsym
+           {
+               ONE_PASS(scope_check_declare_ident($2, procedure_idk));
+               ast_stream_proc_begin($2.name);
+           }
+           block ";"
+           {
+               if (ast_stream_proc_end(yychar == YYEMPTY)) {
+                   $$ = ast_proc_decl_without_block($2);
+               } else {
+                   $$ = ast_proc_decl($2, $4);
+                   proc_cache_proc_decl(&$$);
+               }
+               check_pipe_proc_decl($$);
+           } ;
 
 
 stmts : empty { $$ = ast_stmts_empty($1); }
       | stmtList { $$ = ast_stmts($1); } ;
 
-empty : %empty 
-        {
-            file_location* file_loc = file_location_make(lexer_filename(), lexer_line());
-            $$ = ast_empty(file_loc);
-        } ;
+empty : %empty { $$ = empty_here(); } ;
 
+ /* A statement with a syntax error is left out of its list */
 stmtList : stmt { $$ = ast_stmt_list_singleton($1); }
-         | stmtList ";" stmt { $$ = ast_stmt_list($1, $3); } ;
+         | stmtList ";" stmt { $$ = ast_stmt_list($1, $3); }
+         | badStmt { $$ = ast_stmt_list_empty(empty_here()); }
+         | stmtList ";" badStmt { $$ = $1; } ;
+
+ /* A statement with a syntax error, skipped up to a ";", "end" or "else";
+    a bad if or while statement is skipped up to its "end"
+    (errors in a block statement are handled by its own stmtList) */
+badStmt : error
+        | "if" error "end"
+        | "while" error "end" ;
 
 stmt : assignStmt { $$ = ast_stmt_assign($1); }
      | callStmt { $$ = ast_stmt_call($1); }
@@ -171,16 +294,17 @@ stmt : assignStmt { $$ = ast_stmt_assign($1); }
      | printStmt { $$ = ast_stmt_print($1); }
      | blockStmt { $$ = ast_stmt_block($1); } ;
 
-assignStmt : identsym ":=" expr { $$ = ast_assign_stmt($1, $3); } ;
+ /* The assigned name is checked before the names in the expression */
+assignStmt : identsym ":=" { CHECK_USE($1); } expr { $$ = ast_assign_stmt($1, $4); } ;
 
-callStmt : "call" identsym { $$ = ast_call_stmt($2); } ;
+callStmt : "call" identsym { CHECK_USE($2); $$ = ast_call_stmt($2); } ;
 
 ifStmt : "if" condition "then" stmts "else" stmts "end" { $$ = ast_if_then_else_stmt($2, $4, $6); }
        | "if" condition "then" stmts "end" { $$ = ast_if_then_stmt($2, $4); } ;
 
 whileStmt : "while" condition "do" stmts "end" { $$ = ast_while_stmt($2, $4); } ;
 
-readStmt : "read" identsym { $$ = ast_read_stmt($2); } ;
+readStmt : "read" identsym { CHECK_USE($2); $$ = ast_read_stmt($2); } ;
 
 printStmt : "print" expr { $$ = ast_print_stmt($2); } ;
 
@@ -205,7 +329,7 @@ term : factor
      | term "*" factor { $$ = ast_expr_binary_op(ast_binary_op_expr($1, $2, $3)); }
      | term "/" factor { $$ = ast_expr_binary_op(ast_binary_op_expr($1, $2, $3)); } ;
 
-factor : identsym { $$ = ast_expr_ident($1); }
+factor : identsym { CHECK_USE($1); $$ = ast_expr_ident($1); }
        | numbersym { $$ = ast_expr_number($1); }
        | sign factor { $$ = ast_expr_signed_expr($1, $2); }
        | "(" expr ")" { $$ = $2; } ;
@@ -217,3 +341,21 @@ sign : "-" | "+" ;
 // Set the program's ast to be ast
 void setProgAST(block_t ast) { progast = ast; }
 
+// Return an AST for empty at the lexer's current line
+static empty_t empty_here(void)
+{
+    file_location* file_loc = file_location_make(lexer_filename(), lexer_line());
+    return ast_empty(file_loc);
+}
+
+// Report the syntax error msg with yyerror.  Unless all errors are
+// being reported (see diagnostics.h), stop at the first one, as the
+// error productions above would otherwise let parsing go on.
+static void syntax_error(const char *file_name, const char *msg)
+{
+    (yyerror)(file_name, msg);
+    if (!diagnostics_collecting()) {
+        exit(EXIT_FAILURE);
+    }
+}
+
@@ -0,0 +1,187 @@
+/* spl_gen.c: generate synthetic SPL programs with controlled shapes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The programs written are all valid SPL (they parse and pass
+// declaration checking), sized by the parameter n:
+//   wide n     one scope declaring n variables, each assigned from the last
+//   deep n     n nested block statements, each declaring a variable
+//   stmts n    a list of n assignment statements
+//   expr n     one assignment whose expression has n terms
+//   procexpr n the same assignment, in the block of a procedure
+//   procs n    n sibling procedures, each calling the one before it
+//   lookup n   n statements using a variable declared LOOKUP_DEPTH scopes out
+
+// number of scopes between the uses and the declarations for lookup
+#define LOOKUP_DEPTH 64
+
+// names written per line in long declarations and expressions
+#define PER_LINE 10
+
+// Print a usage message on stderr and exit with failure
+static void usage(const char *cmdname)
+{
+    fprintf(stderr,
+	    "Usage: %s shape n\n"
+	    "  where shape is one of: wide, deep, stmts, expr, procexpr,\n"
+	    "                        procs, lookup\n",
+	    cmdname);
+    exit(EXIT_FAILURE);
+}
+
+// Print n spaces
+static void indent(int n)
+{
+    printf("%*s", n, "");
+}
+
+// Requires: n > 0
+// Write a block declaring v0, ..., v(n-1), with v0 := 0 and each
+// other vi assigned from v(i-1)
+static void gen_wide(long n)
+{
+    printf("begin\n  var v0");
+    for (long i = 1; i < n; i++) {
+	printf((i % PER_LINE == 0) ? ",\n      v%ld" : ", v%ld", i);
+    }
+    printf(";\n  v0 := 0");
+    for (long i = 1; i < n; i++) {
+	printf(";\n  v%ld := v%ld", i, i - 1);
+    }
+    printf("\nend.\n");
+}
+
+// Requires: n > 0
+// Write n nested blocks, the innermost of which uses the outermost's variable
+static void gen_deep(long n)
+{
+    for (long i = 0; i < n; i++) {
+	indent(i);
+	printf("begin var d%ld;\n", i);
+	indent(i + 1);
+	if (i == 0) {
+	    printf("d0 := 0");
+	} else {
+	    printf("d%ld := d%ld", i, i - 1);
+	}
+	printf((i + 1 < n) ? ";\n" : "\n");
+    }
+    for (long i = n; i-- > 0; ) {
+	indent(i);
+	printf("end%s\n", (i == 0) ? "." : "");
+    }
+}
+
+// Requires: n > 0
+// Write a block with n assignment statements
+static void gen_stmts(long n)
+{
+    printf("begin\n  var x;\n  x := 0");
+    for (long i = 1; i < n; i++) {
+	printf(";\n  x := x + %ld", i);
+    }
+    printf("\nend.\n");
+}
+
+// Requires: n > 0
+// Write an expression with n terms, that uses x, continuing its lines
+// after the given number of spaces
+static void expr_terms(long n, int continued)
+{
+    printf("1");
+    for (long i = 1; i < n; i++) {
+	if (i % PER_LINE == 0) {
+	    printf("\n");
+	    indent(continued);
+	}
+	printf((i % 2 == 0) ? " + x" : " - %ld", i);
+    }
+}
+
+// Requires: n > 0
+// Write a block with one assignment whose expression has n terms
+static void gen_expr(long n)
+{
+    printf("begin\n  var x;\n  x := ");
+    expr_terms(n, 6);
+    printf("\nend.\n");
+}
+
+// Requires: n > 0
+// Write a block with a procedure whose block has one assignment
+// whose expression has n terms, and a call of it
+static void gen_procexpr(long n)
+{
+    printf("begin\n  var x;\n  proc p\n    begin\n      x := ");
+    expr_terms(n, 10);
+    printf("\n    end;\n  call p\nend.\n");
+}
+
+// Requires: n > 0
+// Write n sibling procedures, each calling the one declared before it
+static void gen_procs(long n)
+{
+    printf("begin\n  var x;\n");
+    for (long i = 0; i < n; i++) {
+	printf("  proc p%ld\n    begin var y; y := %ld", i, i);
+	if (i > 0) {
+	    printf("; call p%ld", i - 1);
+	}
+	printf(" end;\n");
+    }
+    printf("  call p%ld\nend.\n", n - 1);
+}
+
+// Requires: n > 0
+// Write n statements that use a variable declared LOOKUP_DEPTH scopes out
+static void gen_lookup(long n)
+{
+    for (int i = 0; i < LOOKUP_DEPTH; i++) {
+	indent(i);
+	printf("begin var l%d;\n", i);
+    }
+    indent(LOOKUP_DEPTH);
+    printf("l%d := l0", LOOKUP_DEPTH - 1);
+    for (long i = 1; i < n; i++) {
+	printf(";\n");
+	indent(LOOKUP_DEPTH);
+	printf("l%d := l%d + l0", LOOKUP_DEPTH - 1, LOOKUP_DEPTH - 1);
+    }
+    printf("\n");
+    for (int i = LOOKUP_DEPTH; i-- > 0; ) {
+	indent(i);
+	printf("end%s\n", (i == 0) ? "." : "");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+	usage(argv[0]);
+    }
+    char *end;
+    long n = strtol(argv[2], &end, 10);
+    if (*end != '\0' || n <= 0) {
+	usage(argv[0]);
+    }
+    printf("%% generated by: spl_gen %s %ld\n", argv[1], n);
+    if (strcmp(argv[1], "wide") == 0) {
+	gen_wide(n);
+    } else if (strcmp(argv[1], "deep") == 0) {
+	gen_deep(n);
+    } else if (strcmp(argv[1], "stmts") == 0) {
+	gen_stmts(n);
+    } else if (strcmp(argv[1], "expr") == 0) {
+	gen_expr(n);
+    } else if (strcmp(argv[1], "procexpr") == 0) {
+	gen_procexpr(n);
+    } else if (strcmp(argv[1], "procs") == 0) {
+	gen_procs(n);
+    } else if (strcmp(argv[1], "lookup") == 0) {
+	gen_lookup(n);
+    } else {
+	usage(argv[0]);
+    }
+    return EXIT_SUCCESS;
+}
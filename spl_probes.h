@@ -0,0 +1,45 @@
+/* spl_probes.h: USDT (static tracepoint) probes in the compiler */
+#ifndef _SPL_PROBES_H
+#define _SPL_PROBES_H
+
+// When <sys/sdt.h> (from systemtap's sdt development files) is available,
+// SPL_PROBEn(name, ...) places a USDT probe spl:name with n arguments,
+// which bpftrace or perf can attach to in a running compiler, e.g.,
+//   bpftrace -e 'usdt:./compiler:spl:scope_lookup { @[arg1] = count(); }'
+// An unattached probe is a single nop instruction.  Otherwise (or when
+// compiled with -DSPL_NO_PROBES) the probes compile to nothing.
+//
+// The probes and their arguments are:
+//   token(code, line)              the lexer made a token (not an ident)
+//   ident(name, line)              the lexer made an identifier token
+//   reduce(rule, length)           the parser reduced by rule, whose right
+//                                  side has length symbols (also fired
+//                                  when error recovery discards symbols)
+//   scope_enter(depth)             the symbol table entered a scope,
+//                                  now depth scopes deep
+//   scope_exit(depth, size)        it left a scope with size associations,
+//                                  now depth scopes deep
+//   scope_insert(name, size)       name was declared in a scope,
+//                                  which now has size associations
+//   scope_lookup(name, probes, found)  a scope was searched for name,
+//                                  comparing probes names, and found is 1
+//                                  if it was there (0 if not)
+
+#if !defined(SPL_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SPL_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef SPL_PROBES_ENABLED
+#define SPL_PROBE1(name, a) DTRACE_PROBE1(spl, name, a)
+#define SPL_PROBE2(name, a, b) DTRACE_PROBE2(spl, name, a, b)
+#define SPL_PROBE3(name, a, b, c) DTRACE_PROBE3(spl, name, a, b, c)
+#else
+#define SPL_PROBE1(name, a) do { } while (0)
+#define SPL_PROBE2(name, a, b) do { } while (0)
+#define SPL_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif
@@ -1,20 +1,199 @@
 // Daniel Landsman
 // symtab.c: symbol table file, includes function bodies
 
+#include <limits.h>
+#include <string.h>
 #include "utilities.h"
 #include "symtab.h"
+#include "alloc_stats.h"
+#include "trace.h"
+#include "spl_probes.h"
+#include "symtab_stats.h"
 
-static int symtab_top = -1; // Index in symtab array that represents top of stack and current nesting level
-static scope* symtab[MAX_NEST_LVL]; // Declare symbol table
+// Each thread has its own symbol table (see symtab_use_snapshot)
+static _Thread_local int symtab_top = -1; // Index in symtab array that represents top of stack and current nesting level
+static _Thread_local scope** symtab = NULL; // Declare symbol table, an array grown as scopes are entered
+static _Thread_local unsigned int symtab_capacity = 0; // Number of scopes the symtab array has room for
+
+#define NO_BINDING UINT_MAX // Index of no binding, ending a bucket's list
+
+// A declaration visible in the symbol table, in its hash table. It refers to
+// its association by where that is in its scope, so it takes 16 bytes.
+typedef struct
+{
+    unsigned int next; // Index of the next binding in the same bucket, or NO_BINDING
+    unsigned int hash_low; // Low 32 bits of hash_name of its name
+    int level; // Nesting level of the scope that declared it
+    unsigned int index; // Index of its association in that scope's array
+} symtab_binding;
+
+// Every name declared in the symbol table's scopes is also in one hash table
+// (as in LeBlanc and Cook's symbol tables), whose buckets list newer bindings
+// before older ones, so the first binding for a name is its innermost
+// declaration and a lookup does not have to search scope by scope.
+// The bindings are kept on a stack in the order they were made, so the
+// bindings of the current scope are on top, and each is first in its bucket.
+static _Thread_local unsigned int* symtab_buckets = NULL; // Array of bucket_count indexes of the first binding in each bucket
+static _Thread_local unsigned int symtab_bucket_count = 0; // Always 0 or a power of 2
+static _Thread_local symtab_binding* symtab_bindings = NULL; // Stack of the bindings, oldest first
+static _Thread_local unsigned int symtab_binding_count = 0; // Bindings on the stack
+static _Thread_local unsigned int symtab_binding_capacity = 0; // Bindings the stack has room for
+static _Thread_local int symtab_base = 0; // Lowest level in the hash table (see symtab_use_snapshot)
+
+// With symtab_use_persistent, each thread's symbol table is instead its current persistent scope
+static bool persistent = false;
+static _Thread_local pscope* symtab_env = NULL; // Current scope, or NULL if there are none
+
+// Pre-Conditions: No symbol table has been used yet
+// Post-Conditions: Makes the symbol tables keep their scopes as persistent
+// scopes (see pscope.h) instead of the array of mutable scopes, so that
+// taking a snapshot costs O(1) and later insertions do not affect it
+extern void symtab_use_persistent()
+{
+    persistent = true;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if the symbol tables keep persistent scopes
+extern bool symtab_persistent()
+{
+    return persistent;
+}
+
+// With symtab_digest_environments, each scope keeps the digest of the
+// associations up to its last one as its env_digest
+static bool digesting = false;
+
+// Pre-Conditions: No symbol table has been used yet
+// Post-Conditions: Makes the symbol tables keep a digest of their
+// associations as they are inserted (see symtab_digest_visible)
+extern void symtab_digest_environments()
+{
+    digesting = true;
+}
+
+// Pre-Conditions: The hash table has buckets
+// Post-Conditions: Returns the bucket of the hash table for names with the
+// given hash (from hash_name, or its low 32 bits)
+static unsigned int* symtab_bucket(unsigned long long hash)
+{
+    return &symtab_buckets[hash & (symtab_bucket_count - 1)];
+}
+
+// Pre-Conditions: b is a binding on the stack
+// Post-Conditions: Returns the association b refers to
+static scope_assoc* symtab_binding_assoc(const symtab_binding* b)
+{
+    return &symtab[b->level]->assoc_arr[b->index];
+}
+
+// Pre-Conditions: my_name is not NULL, hash is hash_name(my_name)
+// Post-Conditions: Returns the innermost binding of my_name in the hash table,
+// or NULL if it has none
+static symtab_binding* symtab_find_binding(const char* my_name, unsigned long long hash)
+{
+    unsigned int compared = 0;
+    unsigned int first = (symtab_bucket_count == 0) ? NO_BINDING : *symtab_bucket(hash);
+
+    for (unsigned int i = first; i != NO_BINDING; i = symtab_bindings[i].next)
+    {
+        symtab_binding* b = &symtab_bindings[i];
+        compared++;
+        if (b->hash_low != (unsigned int)hash) continue; // Only names with the same hash need comparing
+
+        scope_assoc* my_assoc = symtab_binding_assoc(b);
+        if (my_assoc->hash == hash && !strcmp(my_assoc->name, my_name))
+        {
+            symtab_stats_count_scope_lookup(compared);
+            return b;
+        }
+    }
+
+    symtab_stats_count_scope_lookup(compared);
+    return NULL;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Doubles the number of buckets in the hash table (or makes
+// the first ones), keeping the bindings of each name in the same order
+static void symtab_grow_buckets()
+{
+    symtab_bucket_count = (symtab_bucket_count == 0) ? 64 : 2 * symtab_bucket_count;
+    alloc_free(symtab_buckets);
+    symtab_buckets = (unsigned int*)alloc_malloc_in(alloc_scope, symtab_bucket_count * sizeof(unsigned int)); // FREE THIS
+    if (symtab_buckets == NULL) bail_with_error("No space to grow the symbol table's hash table!");
+
+    for (unsigned int i = 0; i < symtab_bucket_count; i++) symtab_buckets[i] = NO_BINDING;
+
+    // Push the bindings oldest first, so that newer ones come first again
+    for (unsigned int i = 0; i < symtab_binding_count; i++)
+    {
+        unsigned int* bucket = symtab_bucket(symtab_bindings[i].hash_low);
+        symtab_bindings[i].next = *bucket;
+        *bucket = i;
+    }
+}
+
+// Pre-Conditions: hash is hash_name of the name of the association at index
+// of the scope at level, which is the current level
+// Post-Conditions: Adds a binding of that name to that association to the
+// hash table, hiding its bindings at outer levels
+static void symtab_bind(unsigned long long hash, int level, unsigned int index)
+{
+    if (symtab_binding_count >= symtab_bucket_count) symtab_grow_buckets();
+
+    if (symtab_binding_count == symtab_binding_capacity) // Make room by doubling the stack
+    {
+        unsigned int new_capacity = (symtab_binding_capacity == 0) ? 64 : 2 * symtab_binding_capacity;
+        symtab_binding* new_bindings = (symtab_binding*)alloc_realloc_in(alloc_scope_assoc, symtab_bindings, new_capacity * sizeof(symtab_binding)); // FREE THIS
+        if (new_bindings == NULL) bail_with_error("No space to grow the symbol table's bindings!");
+        symtab_bindings = new_bindings;
+        symtab_binding_capacity = new_capacity;
+    }
+
+    unsigned int* bucket = symtab_bucket(hash);
+    symtab_binding* b = &symtab_bindings[symtab_binding_count];
+    b->next = *bucket;
+    b->hash_low = (unsigned int)hash;
+    b->level = level;
+    b->index = index;
+    *bucket = symtab_binding_count;
+    symtab_binding_count++;
+}
+
+// Pre-Conditions: The hash table has a binding
+// Post-Conditions: Removes the newest binding from the hash table
+static void symtab_unbind_newest()
+{
+    symtab_binding* b = &symtab_bindings[--symtab_binding_count];
+    *symtab_bucket(b->hash_low) = b->next; // Newest, so first in its bucket
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Frees the hash table and all its bindings
+static void symtab_clear_bindings()
+{
+    alloc_free(symtab_buckets);
+    symtab_buckets = NULL;
+    symtab_bucket_count = 0;
+    alloc_free(symtab_bindings);
+    symtab_bindings = NULL;
+    symtab_binding_count = 0;
+    symtab_binding_capacity = 0;
+}
 
 // Pre-Conditions: Symbol table is properly declared with proper max size
 // Post-Conditions: Initializes symbol table to be completely empty
 extern void symtab_initialize()
 {
     symtab_top = -1; // Symbol table with no active scopes
+    symtab_base = 0;
+    symtab_clear_bindings();
+    pscope_release(symtab_env);
+    symtab_env = NULL;
 
-    // Set all possible scope levels to NULL
-    for (int i = 0; i < MAX_NEST_LVL; i++)
+    // Set all scope levels there is room for to NULL
+    for (unsigned int i = 0; i < symtab_capacity; i++)
     {
         symtab[i] = NULL;
     }
@@ -24,6 +203,7 @@ extern void symtab_initialize()
 // Post-Conditions: Returns size of the symbol table as an unsigned int
 extern unsigned int symtab_size()
 {
+    if (persistent) return (symtab_env == NULL) ? 0 : symtab_env->depth + 1;
     return symtab_top + 1;
 }
 
@@ -40,6 +220,7 @@ extern bool symtab_empty()
 // top of the symbol table
 extern unsigned int symtab_scope_loc_count()
 {
+    if (persistent) return symtab_env->size;
     return scope_loc_count(symtab[symtab_top]);
 }
 
@@ -49,6 +230,7 @@ extern unsigned int symtab_scope_loc_count()
 // of the symbol table
 extern unsigned int symtab_scope_size()
 {
+    if (persistent) return symtab_env->size;
     return scope_size(symtab[symtab_top]);
 }
 
@@ -58,6 +240,7 @@ extern unsigned int symtab_scope_size()
 // table is full, returns false otherwise
 extern bool symtab_scope_full()
 {
+    if (persistent) return (symtab_env->size >= MAX_SCOPE_SIZE);
     return scope_full(symtab[symtab_top]);
 }
 
@@ -72,7 +255,7 @@ extern unsigned int symtab_current_nest_lvl()
         bail_with_error("Symbol table is not in an active scope!");
     }
 
-    return symtab_top;
+    return symtab_size() - 1;
 }
 
 // Pre-Conditions: Symbol table is properly declared with proper max size
@@ -85,26 +268,55 @@ extern bool symtab_full()
 // Pre-Conditions: Symbol table is properly declared with proper max size and
 // my_name is not NULL
 // Post-Conditions: Searches for an association involving my_name in the
-// entire symbol table, returns the corresponding id_use structure if found,
-// returns NULL if not found
+// entire symbol table, returns the corresponding id_use structure if found
+// (whose attributes stay where they are until an association is next inserted
+// into the scope holding them), returns NULL if not found
 extern id_use* symtab_lookup(const char* my_name)
+{
+    return symtab_lookup_hashed(my_name, hash_name(my_name));
+}
+
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// my_name is not NULL, and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_lookup(my_name) returns, without
+// hashing my_name again
+extern id_use* symtab_lookup_hashed(const char* my_name, unsigned long long hash)
 {
     unsigned int lvlsOut = 0; // Start off at 0 levels out
 
-    // Iterate down the stack from the top
-    for (int i = symtab_top; i >= 0; i--)
+    if (persistent)
+    {
+        id_attrs* my_attrs = pscope_lookup(symtab_env, my_name, hash, &lvlsOut);
+        symtab_stats_count_symtab_lookup(my_attrs == NULL ? lvlsOut : lvlsOut + 1);
+        return (my_attrs == NULL) ? NULL : id_use_create(my_attrs, lvlsOut); // FREE THIS
+    }
+
+    // The hash table has the innermost declaration of the scopes it covers
+    symtab_binding* b = symtab_find_binding(my_name, hash);
+    if (b != NULL)
     {
-        // Look for the association involving my_name
-        id_attrs* my_attrs = scope_lookup(symtab[i], my_name);
+        lvlsOut = symtab_top - b->level;
+        symtab_stats_count_symtab_lookup(lvlsOut + 1);
+        return id_use_create(&symtab_binding_assoc(b)->attrs, lvlsOut); // FREE THIS
+    }
+    lvlsOut = symtab_top + 1 - symtab_base;
+
+    // Iterate down the rest of the stack (a snapshot's scopes)
+    for (int i = symtab_base - 1; i >= 0; i--)
+    {
+        // Look for the association involving my_name, if the scope's Bloom filter allows it
+        id_attrs* my_attrs = scope_lookup_hashed(symtab[i], my_name, hash);
 
         if (my_attrs != NULL) // Association was found, create and return an id_use structure
         {
+            symtab_stats_count_symtab_lookup(lvlsOut + 1);
             return id_use_create(my_attrs, lvlsOut); // FREE THIS
         }
 
         lvlsOut++; // Not found in current scope, we have to search another level out
     }
 
+    symtab_stats_count_symtab_lookup(symtab_size());
     return NULL; // Association was not found anywhere in symbol table
 }
 
@@ -115,7 +327,18 @@ extern id_use* symtab_lookup(const char* my_name)
 // version of the symtab_lookup() function.
 extern bool symtab_name_declared(const char* my_name)
 {
-    return (symtab_lookup(my_name) != NULL);
+    return symtab_name_declared_hashed(my_name, hash_name(my_name));
+}
+
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// my_name is not NULL, and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_name_declared(my_name) returns,
+// without hashing my_name again
+extern bool symtab_name_declared_hashed(const char* my_name, unsigned long long hash)
+{
+    id_use* my_use = symtab_lookup_hashed(my_name, hash);
+    alloc_free(my_use); // Only whether it was found matters
+    return (my_use != NULL);
 }
 
 // Pre-Conditions: Symbol table is properly declared with proper max size,
@@ -124,27 +347,128 @@ extern bool symtab_name_declared(const char* my_name)
 // current scope at the top of the symbol table, returns false otherwise
 extern bool symtab_name_declared_currently(const char* my_name)
 {
+    return symtab_name_declared_currently_hashed(my_name, hash_name(my_name));
+}
+
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// current scope at top of symbol table is not NULL, my_name is not NULL,
+// and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_name_declared_currently(my_name)
+// returns, without hashing my_name again
+extern bool symtab_name_declared_currently_hashed(const char* my_name, unsigned long long hash)
+{
+    symtab_stats_count_declared_currently();
+
+    if (persistent)
+    {
+        symtab_current_nest_lvl(); // Bails if there is no current scope
+        return (pscope_lookup_current(symtab_env, my_name, hash) != NULL);
+    }
+
+    if ((int)symtab_current_nest_lvl() >= symtab_base) // Current scope's names are in the hash table
+    {
+        symtab_binding* b = symtab_find_binding(my_name, hash);
+        return (b != NULL && b->level == symtab_top);
+    }
+
     // Search for my_name association in top of symtab stack
-    return (scope_declared(symtab[symtab_current_nest_lvl()], my_name));
+    return (scope_lookup_hashed(symtab[symtab_current_nest_lvl()], my_name, hash) != NULL);
+}
+
+// Pre-Conditions: d is the env_digest of the scopes up to some association
+// (all 0 if none), and name and attrs are those of the next association,
+// which is at nesting level lvl
+// Post-Conditions: Returns the env_digest of the scopes up to that association
+static digest symtab_digest_assoc(digest d, int lvl, const char* name, id_attrs* attrs)
+{
+    int fields[3] = { lvl, id_attrs_kind(attrs), id_attrs_offset_count(attrs) };
+    digest_ctx ctx;
+    digest_init(&ctx);
+    digest_add(&ctx, d.bytes, sizeof(d.bytes));
+    digest_add(&ctx, fields, sizeof(fields));
+    digest_add(&ctx, name, strlen(name) + 1);
+    return digest_finish(&ctx);
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns the env_digest of the current scope, or all 0
+// if there are no scopes
+static digest symtab_env_digest()
+{
+    static const digest none;
+    if (persistent) return (symtab_env == NULL) ? none : symtab_env->env_digest;
+    return (symtab_top < 0) ? none : symtab[symtab_top]->env_digest;
 }
 
 // Pre-Conditions: Symbol table is properly declared with proper max size and
 // is in an active scope (size is positive), my_name and my_attrs are not NULL, 
 //current scope at top of symbol table is not NULL
-// Post-Conditions: Inserts an association of my_name to my_attrs into the current
-// scope at the top of the symbol table, produces error message if association
-// for my_name already exists in current scope
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs into
+// the current scope at the top of the symbol table, produces error message if
+// association for my_name already exists in current scope
 extern void symtab_insert(const char* my_name, id_attrs* my_attrs)
 {
+    symtab_insert_hashed(my_name, hash_name(my_name), my_attrs);
+}
+
+// Pre-Conditions: As for symtab_insert, and hash is hash_name(my_name)
+// Post-Conditions: Does what symtab_insert(my_name, my_attrs) does,
+// without hashing my_name again
+extern void symtab_insert_hashed(const char* my_name, unsigned long long hash, id_attrs* my_attrs)
+{
+    symtab_stats_count_insert();
+
     // If association for my_name found in current scope
-    if (symtab_name_declared_currently(my_name))
+    if (symtab_name_declared_currently_hashed(my_name, hash))
     {
-        bail_with_prog_error(my_attrs->file_loc, "Attempted to insert \"%s\", which has already been declared in the symbol table's current scope!", my_name);
+        bail_with_prog_error(id_attrs_file_loc(my_attrs), "Attempted to insert \"%s\", which has already been declared in the symbol table's current scope!", my_name);
+    }
+
+    else if (persistent) // The new version replaces the current scope
+    {
+        pscope* new_env = pscope_insert(symtab_env, my_name, hash, my_attrs);
+        pscope_release(symtab_env);
+        symtab_env = new_env;
+        if (digesting) symtab_env->env_digest = symtab_digest_assoc(symtab_env->env_digest, symtab_env->depth, my_name, &symtab_env->newest->attrs);
     }
 
     else // Association not found, we're good to insert at current scope
     {
-        scope_insert(symtab[symtab_current_nest_lvl()], my_name, my_attrs);
+        scope* my_scope = symtab[symtab_top];
+        scope_append(my_scope, my_name, hash, my_attrs);
+        symtab_bind(hash, symtab_top, scope_size(my_scope) - 1);
+        if (digesting) my_scope->env_digest = symtab_digest_assoc(my_scope->env_digest, symtab_top, my_name, &my_scope->assoc_arr[scope_size(my_scope) - 1].attrs);
+    }
+}
+
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// symtab_digest_environments has been called
+// Post-Conditions: Returns a digest of every association in the symbol
+// table (its nesting level, name, kind and offset), in order from the
+// outermost scope in, so equal digests mean equal environments;
+// each scope keeps the digest of the associations up to its last one as its
+// env_digest, extended as they are inserted, so this takes O(1)
+extern digest symtab_digest_visible()
+{
+    return symtab_env_digest();
+}
+
+// Pre-Conditions: Symbol table is properly declared with proper max size
+// Post-Conditions: Makes sure the symbol table has room for one more scope
+static void symtab_make_room()
+{
+    if (symtab_full())
+    {
+        bail_with_error("Scopes are nested more than %d deep!", MAX_NEST_LVL);
+    }
+
+    if (symtab_size() == symtab_capacity) // Make room by doubling the array
+    {
+        unsigned int new_capacity = (symtab_capacity == 0) ? 64 : 2 * symtab_capacity;
+        scope** new_symtab = (scope**)alloc_realloc_in(alloc_scope, symtab, new_capacity * sizeof(scope*));
+        if (new_symtab == NULL) bail_with_error("No space to grow the symbol table!");
+        symtab = new_symtab;
+        symtab_capacity = new_capacity;
     }
 }
 
@@ -152,8 +476,28 @@ extern void symtab_insert(const char* my_name, id_attrs* my_attrs)
 // Post-Conditions: Enter a new scope for the symbol table
 extern void symtab_enter_scope()
 {
-    symtab_top++; // Increment index, "pushes" another scope onto stack
-    symtab[symtab_top] = scope_initialize(); // Initialize new entered scope
+    if (persistent)
+    {
+        if (symtab_full()) bail_with_error("Scopes are nested more than %d deep!", MAX_NEST_LVL);
+        pscope* new_env = pscope_enter(symtab_env);
+        new_env->env_digest = symtab_env_digest(); // Its associations add to those around it
+        pscope_release(symtab_env);
+        symtab_env = new_env;
+    }
+
+    else
+    {
+        symtab_make_room();
+
+        digest env_digest = symtab_env_digest(); // Its associations add to those around it
+        symtab_top++; // Increment index, "pushes" another scope onto stack
+        symtab[symtab_top] = scope_initialize(); // Initialize new entered scope
+        symtab[symtab_top]->env_digest = env_digest;
+    }
+
+    SPL_PROBE1(scope_enter, symtab_size());
+    symtab_stats_count_scope_enter(symtab_size());
+    trace_counter("symtab depth", symtab_size());
 }
 
 // Pre-Conditions: Symbol table is properly declared with proper max size and
@@ -167,5 +511,125 @@ extern void symtab_exit_scope()
     {
         bail_with_error("Attempted to exit scope when symbol table is not in an active scope!");
     }
+
+    if (persistent)
+    {
+        SPL_PROBE2(scope_exit, symtab_size() - 1, symtab_env->size);
+        symtab_stats_count_scope_exit(symtab_env->size);
+        pscope* new_env = pscope_retain(symtab_env->parent);
+        pscope_release(symtab_env); // Frees what no snapshot still refers to
+        symtab_env = new_env;
+        trace_counter("symtab depth", symtab_size());
+        return;
+    }
+
+    SPL_PROBE2(scope_exit, symtab_top, scope_size(symtab[symtab_top]));
+    symtab_stats_count_scope_exit(scope_size(symtab[symtab_top]));
+
+    // Pop the bindings this scope added to the hash table
+    for (unsigned int i = 0; symtab_top >= symtab_base && i < scope_size(symtab[symtab_top]); i++)
+    {
+        symtab_unbind_newest(); // They are the newest, as only the current scope is inserted into
+    }
+
+    scope_destroy(symtab[symtab_top]); // Nothing refers to its associations after this
+    symtab[symtab_top] = NULL;
     symtab_top--; // Decrement index, "pops" scope off of stack
+    trace_counter("symtab depth", symtab_size());
+}
+
+// Pre-Conditions: Symbol table is in an active scope, top_size is at most
+// the size of the current scope, and no associations are inserted into
+// any of the symbol table's scopes until the snapshot is freed (with
+// persistent scopes: top_size is the size of the current scope, and the
+// symbol table may go on changing)
+// Post-Conditions: Returns a snapshot of the symbol table, in which only the
+// first top_size associations of the current scope are visible
+extern symtab_snapshot symtab_take_snapshot(unsigned int top_size)
+{
+    symtab_snapshot snap;
+    snap.count = symtab_size();
+    snap.env = NULL;
+
+    if (persistent) // The current scope is already an unchanging environment
+    {
+        if (top_size != symtab_scope_size()) bail_with_error("A persistent symbol table's snapshot must show the whole current scope!");
+        snap.scopes = NULL;
+        snap.env = pscope_retain(symtab_env);
+        return snap;
+    }
+
+    snap.scopes = (scope**)alloc_malloc_in(alloc_scope, snap.count * sizeof(scope*)); // FREE THIS
+    if (snap.scopes == NULL) bail_with_error("No space to allocate a symbol table snapshot!");
+
+    for (int lvl = 0; lvl <= symtab_top; lvl++)
+    {
+        unsigned int size = (lvl == symtab_top) ? top_size : scope_size(symtab[lvl]);
+        snap.scopes[lvl] = scope_view(symtab[lvl], size);
+    }
+
+    if (digesting && top_size < scope_size(symtab[symtab_top])) // Digest just the visible part of the current scope
+    {
+        scope* view = snap.scopes[symtab_top];
+        view->env_digest = (symtab_top == 0) ? (digest) { { 0 } } : symtab[symtab_top - 1]->env_digest;
+
+        for (unsigned int i = 0; i < top_size; i++)
+        {
+            view->env_digest = symtab_digest_assoc(view->env_digest, symtab_top, view->assoc_arr[i].name, &view->assoc_arr[i].attrs);
+        }
+    }
+
+    return snap;
+}
+
+// Pre-Conditions: The calling thread's symbol table is empty
+// Post-Conditions: Makes the calling thread's symbol table hold the scopes
+// of snap (shared, read-only), so that scopes entered later go on top of them
+extern void symtab_use_snapshot(symtab_snapshot snap)
+{
+    if (persistent)
+    {
+        symtab_env = pscope_retain(snap.env);
+        return;
+    }
+
+    for (unsigned int i = 0; i < snap.count; i++)
+    {
+        symtab_make_room();
+        symtab_top++;
+        symtab[symtab_top] = snap.scopes[i];
+    }
+
+    symtab_base = symtab_top + 1; // Their names are looked up in them, not in the hash table
+}
+
+// Pre-Conditions: The calling thread's symbol table holds only the scopes
+// given to it by symtab_use_snapshot
+// Post-Conditions: Empties the calling thread's symbol table, without
+// destroying those scopes, and frees its array
+extern void symtab_leave_snapshot()
+{
+    pscope_release(symtab_env);
+    symtab_env = NULL;
+    symtab_top = -1;
+    symtab_base = 0;
+    symtab_clear_bindings();
+    alloc_free(symtab);
+    symtab = NULL;
+    symtab_capacity = 0;
+}
+
+// Pre-Conditions: snap was returned by symtab_take_snapshot and is not in use
+// Post-Conditions: Frees snap's views of the scopes (but not the scopes),
+// or with persistent scopes, drops its reference to the current scope
+extern void symtab_free_snapshot(symtab_snapshot snap)
+{
+    pscope_release(snap.env);
+
+    for (unsigned int i = 0; snap.scopes != NULL && i < snap.count; i++)
+    {
+        scope_view_destroy(snap.scopes[i]);
+    }
+
+    alloc_free(snap.scopes);
 }
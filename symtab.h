@@ -5,9 +5,35 @@
 #define _SYMTAB_H
 
 #include "scope.h"
+#include "pscope.h"
 #include "id_use.h"
 
-#define MAX_NEST_LVL 100
+#define MAX_NEST_LVL (1 << 20) // Deepest nesting of scopes allowed
+
+// Each thread has its own symbol table, which the functions below use.
+// A snapshot of one thread's symbol table lets other threads look up
+// names in its scopes, while entering scopes of their own on top of them.
+typedef struct
+{
+    unsigned int count; // Number of scopes
+    scope** scopes; // Read-only views of the scopes, outermost first
+    pscope* env; // Or, with persistent scopes, the current scope (retained)
+} symtab_snapshot;
+
+// Pre-Conditions: No symbol table has been used yet
+// Post-Conditions: Makes the symbol tables keep their scopes as persistent
+// scopes (see pscope.h) instead of the array of mutable scopes, so that
+// taking a snapshot costs O(1) and later insertions do not affect it
+extern void symtab_use_persistent();
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if the symbol tables keep persistent scopes
+extern bool symtab_persistent();
+
+// Pre-Conditions: No symbol table has been used yet
+// Post-Conditions: Makes the symbol tables keep a digest of their
+// associations as they are inserted (see symtab_digest_visible)
+extern void symtab_digest_environments();
 
 // Pre-Conditions: Symbol table is properly declared with proper max size
 // Post-Conditions: Initializes symbol table to be completely empty
@@ -52,10 +78,17 @@ extern bool symtab_full();
 // Pre-Conditions: Symbol table is properly declared with proper max size and
 // my_name is not NULL
 // Post-Conditions: Searches for an association involving my_name in the
-// entire symbol table, returns the corresponding id_use structure if found,
-// returns NULL if not found
+// entire symbol table, returns the corresponding id_use structure if found
+// (whose attributes stay where they are until an association is next inserted
+// into the scope holding them), returns NULL if not found
 extern id_use* symtab_lookup(const char* my_name);
 
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// my_name is not NULL, and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_lookup(my_name) returns, without
+// hashing my_name again
+extern id_use* symtab_lookup_hashed(const char* my_name, unsigned long long hash);
+
 // Pre-Conditions: Symbol table is properly declared with proper max size and
 // my_name is not NULL
 // Post-Conditions: Returns true if an association involving my_name is found
@@ -63,20 +96,46 @@ extern id_use* symtab_lookup(const char* my_name);
 // version of the symtab_lookup() function.
 extern bool symtab_name_declared(const char* my_name);
 
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// my_name is not NULL, and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_name_declared(my_name) returns,
+// without hashing my_name again
+extern bool symtab_name_declared_hashed(const char* my_name, unsigned long long hash);
+
 // Pre-Conditions: Symbol table is properly declared with proper max size,
 // current scope at top of symbol table is not NULL, and my_name is not NULL
 // Post-Conditions: Returns true if my_name has an association in the
 // current scope at the top of the symbol table, returns false otherwise
 extern bool symtab_name_declared_currently(const char* my_name);
 
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// current scope at top of symbol table is not NULL, my_name is not NULL,
+// and hash is hash_name(my_name)
+// Post-Conditions: Returns what symtab_name_declared_currently(my_name)
+// returns, without hashing my_name again
+extern bool symtab_name_declared_currently_hashed(const char* my_name, unsigned long long hash);
+
 // Pre-Conditions: Symbol table is properly declared with proper max size and
 // is in an active scope (size is positive), my_name and my_attrs are not NULL, 
 //current scope at top of symbol table is not NULL
-// Post-Conditions: Inserts an association of my_name to my_attrs into the current
-// scope at the top of the symbol table, produces error message if association
-// for my_name already exists in current scope
+// Post-Conditions: Inserts an association of my_name to a copy of my_attrs into
+// the current scope at the top of the symbol table, produces error message if
+// association for my_name already exists in current scope
 extern void symtab_insert(const char* my_name, id_attrs* my_attrs);
 
+// Pre-Conditions: As for symtab_insert, and hash is hash_name(my_name)
+// Post-Conditions: Does what symtab_insert(my_name, my_attrs) does,
+// without hashing my_name again
+extern void symtab_insert_hashed(const char* my_name, unsigned long long hash, id_attrs* my_attrs);
+
+// Pre-Conditions: Symbol table is properly declared with proper max size,
+// symtab_digest_environments has been called
+// Post-Conditions: Returns a digest of every association in the symbol
+// table (its nesting level, name, kind and offset), in order from the
+// outermost scope in, so equal digests mean equal environments
+// (it is kept up to date as associations are inserted, so this takes O(1))
+extern digest symtab_digest_visible();
+
 // Pre-Conditions: Symbol table is properly declared with proper max size
 // Post-Conditions: Enter a new scope for the symbol table
 extern void symtab_enter_scope();
@@ -87,4 +146,29 @@ extern void symtab_enter_scope();
 // produces an error message if there are no more scopes to leave
 extern void symtab_exit_scope();
 
+// Pre-Conditions: Symbol table is in an active scope, top_size is at most
+// the size of the current scope, and no associations are inserted into
+// any of the symbol table's scopes until the snapshot is freed (with
+// persistent scopes: top_size is the size of the current scope, and the
+// symbol table may go on changing)
+// Post-Conditions: Returns a snapshot of the symbol table, in which only the
+// first top_size associations of the current scope are visible
+extern symtab_snapshot symtab_take_snapshot(unsigned int top_size);
+
+// Pre-Conditions: The calling thread's symbol table is empty
+// Post-Conditions: Makes the calling thread's symbol table hold the scopes
+// of snap (shared, read-only), so that scopes entered later go on top of them
+extern void symtab_use_snapshot(symtab_snapshot snap);
+
+// Pre-Conditions: The calling thread's symbol table holds only the scopes
+// given to it by symtab_use_snapshot
+// Post-Conditions: Empties the calling thread's symbol table, without
+// destroying those scopes, and frees its array
+extern void symtab_leave_snapshot();
+
+// Pre-Conditions: snap was returned by symtab_take_snapshot and is not in use
+// Post-Conditions: Frees snap's views of the scopes (but not the scopes),
+// or with persistent scopes, drops its reference to the current scope
+extern void symtab_free_snapshot(symtab_snapshot snap);
+
 #endif
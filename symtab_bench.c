@@ -0,0 +1,386 @@
+// symtab_bench.c: microbenchmarks of the scope and symbol table operations
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "scope.h"
+#include "symtab.h"
+#include "alloc_stats.h"
+#include "utilities.h"
+
+// The patterns of operations that can be measured
+typedef enum { pattern_insert, pattern_hit, pattern_miss, pattern_deep } pattern_kind;
+static const char* pattern_names[] = { "insert", "hit", "miss", "deep" };
+#define PATTERN_COUNT (pattern_deep + 1)
+
+// How the names are spelled, and how the names to look up are chosen
+typedef enum { names_seq, names_random, names_prefix } names_kind;
+static const char* names_names[] = { "seq", "random", "prefix" };
+typedef enum { keys_uniform, keys_zipf } keys_kind;
+static const char* keys_names[] = { "uniform", "zipf" };
+
+// The settings for a run, from the command line
+typedef struct
+{
+    bool run[PATTERN_COUNT]; // Which patterns to measure
+    unsigned int size; // Names declared per scope
+    unsigned int depth; // Scopes for the deep pattern
+    unsigned long ops; // Lookups to time (inserts are size per round)
+    names_kind names;
+    keys_kind keys;
+    unsigned long long seed;
+    bool json;
+} bench_settings;
+
+// The result of measuring one pattern
+typedef struct
+{
+    pattern_kind pattern;
+    unsigned long ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+} bench_result;
+
+static unsigned long long rng_state;
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns the next pseudo-random number (xorshift64*)
+static unsigned long long rng_next()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns the monotonic clock's time in nanoseconds
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Pre-Conditions: prefix is not NULL
+// Post-Conditions: Returns a fresh name, distinct for distinct (prefix, i),
+// spelled in the way given by kind
+static char* make_name(names_kind kind, const char* prefix, unsigned int i)
+{
+    char buf[96];
+
+    switch (kind)
+    {
+        case names_seq:
+            snprintf(buf, sizeof(buf), "%s%u", prefix, i);
+            break;
+        case names_random: // Random letters, made unique by the number
+        {
+            int len = 4 + (int)(rng_next() % 9);
+            int pos = snprintf(buf, sizeof(buf), "%s", prefix);
+            for (int k = 0; k < len; k++) buf[pos++] = 'a' + (char)(rng_next() % 26);
+            snprintf(buf + pos, sizeof(buf) - pos, "%u", i);
+            break;
+        }
+        case names_prefix: // A long shared prefix makes every comparison slow
+            snprintf(buf, sizeof(buf), "%slongcommonidentifierprefix%u", prefix, i);
+            break;
+    }
+
+    char* ret = alloc_strdup_in(alloc_token_text, buf);
+    if (ret == NULL) bail_with_error("No space for a name!");
+    return ret;
+}
+
+// Pre-Conditions: count > 0
+// Post-Conditions: Returns count fresh names made by make_name
+static char** make_names(names_kind kind, const char* prefix, unsigned int count)
+{
+    char** ret = (char**)alloc_malloc(count * sizeof(char*));
+    if (ret == NULL) bail_with_error("No space for names!");
+    for (unsigned int i = 0; i < count; i++) ret[i] = make_name(kind, prefix, i);
+    return ret;
+}
+
+// Pre-Conditions: count > 0, ops > 0
+// Post-Conditions: Returns ops indexes from 0 to count-1, chosen as given by kind
+// (zipf picks index i with probability proportional to 1/(i+1))
+static unsigned int* make_keys(keys_kind kind, unsigned int count, unsigned long ops)
+{
+    unsigned int* ret = (unsigned int*)alloc_malloc(ops * sizeof(unsigned int));
+    double* cdf = NULL;
+    if (ret == NULL) bail_with_error("No space for keys!");
+
+    if (kind == keys_zipf)
+    {
+        cdf = (double*)alloc_malloc(count * sizeof(double));
+        if (cdf == NULL) bail_with_error("No space for keys!");
+        double sum = 0;
+        for (unsigned int i = 0; i < count; i++) cdf[i] = (sum += 1.0 / (i + 1));
+        for (unsigned int i = 0; i < count; i++) cdf[i] /= sum;
+    }
+
+    for (unsigned long j = 0; j < ops; j++)
+    {
+        if (kind == keys_uniform)
+        {
+            ret[j] = (unsigned int)(rng_next() % count);
+            continue;
+        }
+
+        // Binary search for the first cdf entry at least u
+        double u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+        unsigned int lo = 0, hi = count - 1;
+        while (lo < hi)
+        {
+            unsigned int mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        ret[j] = lo;
+    }
+
+    alloc_free(cdf);
+    return ret;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns attributes for a variable (which inserting copies)
+static id_attrs bench_attrs()
+{
+    file_location floc = { "symtab_bench", 1 };
+    return id_attrs_make(floc, variable_idk, 0);
+}
+
+// Pre-Conditions: names has count names
+// Post-Conditions: Enters a new scope in the symbol table and declares the names in it
+static void declare_scope(char** names, unsigned int count)
+{
+    id_attrs attrs = bench_attrs();
+    symtab_enter_scope();
+    for (unsigned int i = 0; i < count; i++) symtab_insert(names[i], &attrs);
+}
+
+// Pre-Conditions: The symbol table has the scopes to search, keys has ops
+// indexes into names, and every name is declared if must_find is true
+// Post-Conditions: Looks up each key's name with symtab_lookup, bailing
+// if the result is not as expected
+static void lookup_keys(char** names, unsigned int* keys, unsigned long ops, bool must_find)
+{
+    for (unsigned long j = 0; j < ops; j++)
+    {
+        id_use* use = symtab_lookup(names[keys[j]]);
+        if ((use != NULL) != must_find) bail_with_error("Unexpected result looking up %s!", names[keys[j]]);
+        alloc_free(use);
+    }
+}
+
+// Pre-Conditions: settings is not NULL, pattern is one of its patterns
+// Post-Conditions: Measures pattern and returns the result
+static bench_result run_pattern(const bench_settings* settings, pattern_kind pattern)
+{
+    unsigned int size = settings->size;
+    unsigned long ops = settings->ops;
+    char** names = NULL;
+    char** others = NULL;
+    unsigned int* keys = NULL;
+    unsigned int key_count = size;
+
+    // Set up everything that is not being measured
+    symtab_initialize();
+    switch (pattern)
+    {
+        case pattern_insert:
+            names = make_names(settings->names, "v", size);
+            ops = (ops + size - 1) / size * size; // Whole rounds of size inserts
+            break;
+        case pattern_hit:
+            names = make_names(settings->names, "v", size);
+            declare_scope(names, size);
+            keys = make_keys(settings->keys, size, ops);
+            break;
+        case pattern_miss:
+            names = make_names(settings->names, "v", size);
+            others = make_names(settings->names, "m", size);
+            declare_scope(names, size);
+            keys = make_keys(settings->keys, size, ops);
+            break;
+        case pattern_deep: // Names of outer scopes come first, so zipf favors them
+            key_count = size * settings->depth;
+            names = make_names(settings->names, "d", key_count);
+            for (unsigned int lvl = 0; lvl < settings->depth; lvl++) declare_scope(names + lvl * size, size);
+            keys = make_keys(settings->keys, key_count, ops);
+            break;
+    }
+
+    id_attrs attrs = bench_attrs();
+    alloc_counts before = alloc_stats_counts();
+    double start = now_ns();
+    switch (pattern)
+    {
+        case pattern_insert:
+            for (unsigned long done = 0; done < ops && symtab_persistent(); done += size)
+            {
+                symtab_enter_scope();
+                for (unsigned int i = 0; i < size; i++) symtab_insert(names[i], &attrs);
+                symtab_exit_scope();
+            }
+            for (unsigned long done = 0; done < ops && !symtab_persistent(); done += size)
+            {
+                scope* my_scope = scope_initialize();
+                for (unsigned int i = 0; i < size; i++) scope_insert(my_scope, names[i], &attrs);
+                scope_destroy(my_scope);
+            }
+            break;
+        case pattern_hit:
+        case pattern_deep:
+            lookup_keys(names, keys, ops, true);
+            break;
+        case pattern_miss:
+            lookup_keys(others, keys, ops, false);
+            break;
+    }
+    double elapsed = now_ns() - start;
+    alloc_counts after = alloc_stats_counts();
+
+    // The scopes in the symbol table are not freed, as in the compiler
+    for (unsigned int i = 0; i < key_count; i++) alloc_free(names[i]);
+    for (unsigned int i = 0; others != NULL && i < size; i++) alloc_free(others[i]);
+    alloc_free(names);
+    alloc_free(others);
+    alloc_free(keys);
+
+    bench_result ret;
+    ret.pattern = pattern;
+    ret.ops = ops;
+    ret.ns_per_op = elapsed / ops;
+    ret.allocs_per_op = (double)(after.count - before.count) / ops;
+    ret.bytes_per_op = (double)(after.bytes - before.bytes) / ops;
+    return ret;
+}
+
+// Pre-Conditions: settings and r are not NULL
+// Post-Conditions: Prints r on stdout, as a JSON object if settings->json is true
+static void print_result(const bench_settings* settings, const bench_result* r, bool first)
+{
+    unsigned int depth = (r->pattern == pattern_deep) ? settings->depth : 1;
+
+    if (settings->json)
+    {
+        printf("%s\n  {\"pattern\": \"%s\", \"names\": \"%s\", \"keys\": \"%s\", "
+               "\"size\": %u, \"depth\": %u, \"ops\": %lu, \"ns_per_op\": %.2f, "
+               "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}",
+               first ? "" : ",", pattern_names[r->pattern], names_names[settings->names],
+               keys_names[settings->keys], settings->size, depth, r->ops,
+               r->ns_per_op, r->allocs_per_op, r->bytes_per_op);
+        return;
+    }
+
+    if (first)
+    {
+        printf("%-8s %-8s %-8s %8s %6s %10s %10s %10s %10s\n", "pattern", "names", "keys",
+               "size", "depth", "ops", "ns/op", "allocs/op", "bytes/op");
+    }
+    printf("%-8s %-8s %-8s %8u %6u %10lu %10.2f %10.3f %10.1f\n", pattern_names[r->pattern],
+           names_names[settings->names], keys_names[settings->keys], settings->size, depth,
+           r->ops, r->ns_per_op, r->allocs_per_op, r->bytes_per_op);
+}
+
+// Pre-Conditions: cmdname is not NULL
+// Post-Conditions: Prints a usage message on stderr and exits with failure
+static void usage(const char* cmdname)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "Options:\n"
+            "  --pattern=P   insert, hit, miss, deep or all (the default)\n"
+            "  --size=N      names declared per scope (default 256)\n"
+            "  --depth=N     scopes for the deep pattern (default 16)\n"
+            "  --ops=N       operations to time (default 200000)\n"
+            "  --names=D     how names are spelled: seq (the default), random or prefix\n"
+            "  --keys=D      which names are looked up: uniform (the default) or zipf\n"
+            "  --seed=N      seed for the random choices (default 1)\n"
+            "  --persistent  use the symbol table's persistent scopes\n"
+            "  --json        print the results as a JSON array\n",
+            cmdname);
+    exit(EXIT_FAILURE);
+}
+
+// Pre-Conditions: text and cmdname are not NULL
+// Post-Conditions: Returns text as a number in [min, max], or uses usage() if it is not one
+static unsigned long long parse_number(const char* cmdname, const char* text,
+                                       unsigned long long min, unsigned long long max)
+{
+    char* end;
+    unsigned long long ret = strtoull(text, &end, 10);
+    if (*end != '\0' || end == text || ret < min || ret > max) usage(cmdname);
+    return ret;
+}
+
+// Pre-Conditions: names has count entries, text and cmdname are not NULL
+// Post-Conditions: Returns the index of text in names, or uses usage() if it is not there
+static int parse_choice(const char* cmdname, const char* text, const char** names, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(text, names[i]) == 0) return i;
+    }
+    usage(cmdname);
+    return 0;
+}
+
+// The parser's yyerror, which utilities.c refers to, is not linked in
+void yyerror(const char* filename, const char* msg)
+{
+    fprintf(stderr, "%s: %s\n", filename, msg);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* cmdname = argv[0];
+    bench_settings settings = { { true, true, true, true }, 256, 16, 200000,
+                                names_seq, keys_uniform, 1, false };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* opt = argv[i];
+        const char* val = strchr(opt, '=');
+        val = (val == NULL) ? "" : val + 1;
+
+        if (strncmp(opt, "--pattern=", 10) == 0)
+        {
+            bool all = (strcmp(val, "all") == 0);
+            int p = all ? 0 : parse_choice(cmdname, val, pattern_names, PATTERN_COUNT);
+            for (int k = 0; k < PATTERN_COUNT; k++) settings.run[k] = all || k == p;
+        }
+        else if (strncmp(opt, "--size=", 7) == 0) settings.size = parse_number(cmdname, val, 1, MAX_SCOPE_SIZE);
+        else if (strncmp(opt, "--depth=", 8) == 0) settings.depth = parse_number(cmdname, val, 1, MAX_NEST_LVL);
+        else if (strncmp(opt, "--ops=", 6) == 0) settings.ops = parse_number(cmdname, val, 1, 1UL << 40);
+        else if (strncmp(opt, "--names=", 8) == 0) settings.names = parse_choice(cmdname, val, names_names, 3);
+        else if (strncmp(opt, "--keys=", 7) == 0) settings.keys = parse_choice(cmdname, val, keys_names, 2);
+        else if (strncmp(opt, "--seed=", 7) == 0) settings.seed = parse_number(cmdname, val, 1, ~0ULL);
+        else if (strcmp(opt, "--persistent") == 0) symtab_use_persistent();
+        else if (strcmp(opt, "--json") == 0) settings.json = true;
+        else usage(cmdname);
+    }
+
+    if ((unsigned long long)settings.size * settings.depth > MAX_SCOPE_SIZE) usage(cmdname);
+
+    rng_state = settings.seed;
+    bool first = true;
+    if (settings.json) printf("[");
+    for (int p = 0; p < PATTERN_COUNT; p++)
+    {
+        if (!settings.run[p]) continue;
+        bench_result r = run_pattern(&settings, (pattern_kind)p);
+        print_result(&settings, &r, first);
+        first = false;
+    }
+    if (settings.json) printf("\n]\n");
+
+    return EXIT_SUCCESS;
+}
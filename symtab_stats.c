@@ -0,0 +1,164 @@
+// symtab_stats.c: symbol table statistics file, includes function bodies
+
+#include <stdatomic.h>
+#include "symtab_stats.h"
+
+// Counts of calls and histograms, only updated when enabled is true
+// (atomic, as the symbol tables of several threads may count at once)
+static bool enabled = false;
+static atomic_ulong symtab_lookups;
+static atomic_ulong scope_lookups;
+static atomic_ulong inserts;
+static atomic_ulong declared_currently;
+static atomic_ulong scopes_walked_hist[SYMTAB_STATS_BUCKETS];
+static atomic_ulong compared_hist[SYMTAB_STATS_BUCKETS];
+static atomic_ulong scopes_exited;
+static atomic_ulong scope_size_sum;
+static atomic_uint scope_size_max;
+static atomic_uint peak_depth;
+
+// Pre-Conditions: None.
+// Post-Conditions: Adds n to *counter
+static void add(atomic_ulong* counter, unsigned long n)
+{
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Makes *max at least v
+static void raise_to(atomic_uint* max, unsigned int v)
+{
+    unsigned int old = atomic_load_explicit(max, memory_order_relaxed);
+
+    while (v > old && !atomic_compare_exchange_weak_explicit(max, &old, v, memory_order_relaxed, memory_order_relaxed))
+    {
+        ; // old now holds the current maximum, try again
+    }
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns the histogram bucket that counts v
+static unsigned int bucket_of(unsigned int v)
+{
+    unsigned int b = 0;
+
+    while (v != 0 && b < SYMTAB_STATS_BUCKETS - 1)
+    {
+        v >>= 1;
+        b++;
+    }
+
+    return b;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Turns on counting; until this is called, the counting
+// functions below do nothing
+void symtab_stats_enable()
+{
+    enabled = true;
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if counting is turned on, false otherwise
+bool symtab_stats_enabled()
+{
+    return enabled;
+}
+
+// Pre-Conditions: A symtab_lookup searched scopes_walked scopes
+// Post-Conditions: Counts the lookup and how many scopes it walked
+void symtab_stats_count_symtab_lookup(unsigned int scopes_walked)
+{
+    if (!enabled) return;
+    add(&symtab_lookups, 1);
+    add(&scopes_walked_hist[bucket_of(scopes_walked)], 1);
+}
+
+// Pre-Conditions: A scope_lookup compared compared associations' names
+// Post-Conditions: Counts the lookup and how many names it compared
+void symtab_stats_count_scope_lookup(unsigned int compared)
+{
+    if (!enabled) return;
+    add(&scope_lookups, 1);
+    add(&compared_hist[bucket_of(compared)], 1);
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Counts a call of symtab_insert
+void symtab_stats_count_insert()
+{
+    if (!enabled) return;
+    add(&inserts, 1);
+}
+
+// Pre-Conditions: None.
+// Post-Conditions: Counts a call of symtab_name_declared_currently
+void symtab_stats_count_declared_currently()
+{
+    if (!enabled) return;
+    add(&declared_currently, 1);
+}
+
+// Pre-Conditions: The symbol table just entered a scope, making it depth deep
+// Post-Conditions: Updates the peak nesting level
+void symtab_stats_count_scope_enter(unsigned int depth)
+{
+    if (!enabled) return;
+    raise_to(&peak_depth, depth);
+}
+
+// Pre-Conditions: The symbol table is leaving a scope with size associations
+// Post-Conditions: Updates the scope size statistics
+void symtab_stats_count_scope_exit(unsigned int size)
+{
+    if (!enabled) return;
+    add(&scopes_exited, 1);
+    add(&scope_size_sum, size);
+    raise_to(&scope_size_max, size);
+}
+
+// Pre-Conditions: out is not NULL, hist has SYMTAB_STATS_BUCKETS buckets
+// Post-Conditions: Prints the nonempty buckets of hist on out, under title
+static void print_histogram(FILE* out, const char* title, atomic_ulong* hist, unsigned long total)
+{
+    fprintf(out, "%s:\n", title);
+
+    for (unsigned int b = 0; b < SYMTAB_STATS_BUCKETS; b++)
+    {
+        unsigned long count = atomic_load(&hist[b]);
+
+        if (count == 0) continue;
+
+        // Bucket b holds [lo, hi]
+        unsigned long lo = (b == 0) ? 0 : 1UL << (b - 1);
+        unsigned long hi = (b == 0) ? 0 : (1UL << b) - 1;
+        char range[48];
+
+        if (b == SYMTAB_STATS_BUCKETS - 1) snprintf(range, sizeof(range), "%lu+", lo);
+        else if (lo == hi) snprintf(range, sizeof(range), "%lu", lo);
+        else snprintf(range, sizeof(range), "%lu-%lu", lo, hi);
+
+        fprintf(out, "  %12s %12lu %6.1f%%\n", range, count, 100.0 * count / total);
+    }
+}
+
+// Pre-Conditions: out is not NULL
+// Post-Conditions: Prints the counts, histograms and scope statistics on out
+void symtab_stats_report(FILE* out)
+{
+    unsigned long n_symtab_lookups = atomic_load(&symtab_lookups);
+    unsigned long n_scope_lookups = atomic_load(&scope_lookups);
+    unsigned long n_scopes_exited = atomic_load(&scopes_exited);
+
+    fprintf(out, "symtab_lookup calls:                  %lu\n", n_symtab_lookups);
+    fprintf(out, "scope_lookup calls:                   %lu\n", n_scope_lookups);
+    fprintf(out, "symtab_insert calls:                  %lu\n", atomic_load(&inserts));
+    fprintf(out, "symtab_name_declared_currently calls: %lu\n", atomic_load(&declared_currently));
+    print_histogram(out, "scopes walked per symtab_lookup", scopes_walked_hist, n_symtab_lookups);
+    print_histogram(out, "names compared per scope_lookup", compared_hist, n_scope_lookups);
+    fprintf(out, "scopes: %lu, max size: %u, mean size: %.2f, peak nesting depth: %u\n",
+            n_scopes_exited, atomic_load(&scope_size_max),
+            (n_scopes_exited == 0) ? 0.0 : (double) atomic_load(&scope_size_sum) / n_scopes_exited,
+            atomic_load(&peak_depth));
+}
@@ -0,0 +1,52 @@
+// symtab_stats.h: symbol table statistics file, includes function declarations
+
+#ifndef _SYMTAB_STATS_H
+#define _SYMTAB_STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Number of histogram buckets: bucket 0 counts 0, and bucket k > 0
+// counts values from 2^(k-1) to 2^k - 1 (the last bucket counts the rest)
+#define SYMTAB_STATS_BUCKETS 16
+
+// The counting functions below may be called by several threads at once
+
+// Pre-Conditions: None.
+// Post-Conditions: Turns on counting; until this is called, the counting
+// functions below do nothing
+extern void symtab_stats_enable();
+
+// Pre-Conditions: None.
+// Post-Conditions: Returns true if counting is turned on, false otherwise
+extern bool symtab_stats_enabled();
+
+// Pre-Conditions: A symtab_lookup searched scopes_walked scopes
+// Post-Conditions: Counts the lookup and how many scopes it walked
+extern void symtab_stats_count_symtab_lookup(unsigned int scopes_walked);
+
+// Pre-Conditions: A scope_lookup compared compared associations' names
+// Post-Conditions: Counts the lookup and how many names it compared
+extern void symtab_stats_count_scope_lookup(unsigned int compared);
+
+// Pre-Conditions: None.
+// Post-Conditions: Counts a call of symtab_insert
+extern void symtab_stats_count_insert();
+
+// Pre-Conditions: None.
+// Post-Conditions: Counts a call of symtab_name_declared_currently
+extern void symtab_stats_count_declared_currently();
+
+// Pre-Conditions: The symbol table just entered a scope, making it depth deep
+// Post-Conditions: Updates the peak nesting level
+extern void symtab_stats_count_scope_enter(unsigned int depth);
+
+// Pre-Conditions: The symbol table is leaving a scope with size associations
+// Post-Conditions: Updates the scope size statistics
+extern void symtab_stats_count_scope_exit(unsigned int size);
+
+// Pre-Conditions: out is not NULL
+// Post-Conditions: Prints the counts, histograms and scope statistics on out
+extern void symtab_stats_report(FILE* out);
+
+#endif
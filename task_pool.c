@@ -0,0 +1,148 @@
+/* task_pool.c: a fixed set of worker threads that run submitted tasks */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "task_pool.h"
+#include "utilities.h"
+#include "alloc_stats.h"
+
+// a queued task
+typedef struct task_s {
+    task_fn fn;
+    void *arg;
+    struct task_s *next;
+} task;
+
+struct task_pool_s {
+    pthread_mutex_t lock;      // protects all the fields below
+    pthread_cond_t work_ready; // signaled when a task is queued or on shutdown
+    pthread_cond_t all_done;   // signaled when pending becomes 0
+    task *head;                // queue of tasks not yet started, oldest first
+    task *tail;
+    unsigned int pending;      // tasks queued or running
+    bool shutting_down;
+    int nthreads;
+    pthread_t *threads;
+};
+
+// Run tasks from the pool given by arg until it shuts down
+static void *worker(void *arg)
+{
+    task_pool *pool = (task_pool *) arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+	while (pool->head == NULL && !pool->shutting_down) {
+	    pthread_cond_wait(&pool->work_ready, &pool->lock);
+	}
+	if (pool->head == NULL) {
+	    break;
+	}
+	task *t = pool->head;
+	pool->head = t->next;
+	if (pool->head == NULL) {
+	    pool->tail = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	t->fn(t->arg);
+	alloc_free(t);
+	pthread_mutex_lock(&pool->lock);
+	if (--pool->pending == 0) {
+	    pthread_cond_broadcast(&pool->all_done);
+	}
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Requires: nthreads > 0
+// Return a new pool with nthreads worker threads,
+// bailing with an error message if they cannot be started.
+task_pool *task_pool_create(int nthreads)
+{
+    task_pool *pool = (task_pool *) alloc_malloc_in(alloc_task_pool,
+						    sizeof(task_pool));
+    pthread_t *threads = (pthread_t *) alloc_malloc_in(alloc_task_pool,
+						       nthreads * sizeof(pthread_t));
+    if (pool == NULL || threads == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "task_pool");
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->pending = 0;
+    pool->shutting_down = false;
+    pool->nthreads = nthreads;
+    pool->threads = threads;
+    for (int i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, worker, pool) != 0) {
+	    bail_with_error("Cannot start worker thread %d!", i);
+	}
+    }
+    return pool;
+}
+
+// Requires: pool was created and not yet destroyed
+// Queue the task fn(arg) to be run by one of pool's workers.
+// This may be called by tasks that are running in pool.
+void task_pool_submit(task_pool *pool, task_fn fn, void *arg)
+{
+    task *t = (task *) alloc_malloc_in(alloc_task_pool, sizeof(task));
+    if (t == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "task");
+    }
+    t->fn = fn;
+    t->arg = arg;
+    t->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+	pool->head = t;
+    } else {
+	pool->tail->next = t;
+    }
+    pool->tail = t;
+    pool->pending++;
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Requires: pool was created and not yet destroyed
+// Wait until every task submitted to pool (including any submitted
+// by those tasks) has finished.
+void task_pool_wait(task_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+	pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Requires: pool was created and not yet destroyed
+// Wait for pool's tasks to finish, then stop its workers and free it.
+void task_pool_destroy(task_pool *pool)
+{
+    task_pool_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; i++) {
+	pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->all_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    alloc_free(pool->threads);
+    alloc_free(pool);
+}
+
+// Return the number of processors online (at least 1)
+int task_pool_cpu_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int) n;
+}
@@ -0,0 +1,32 @@
+/* task_pool.h: a fixed set of worker threads that run submitted tasks */
+#ifndef _TASK_POOL_H
+#define _TASK_POOL_H
+
+// A task is a function called (on some worker thread) with its argument
+typedef void (*task_fn)(void *arg);
+
+typedef struct task_pool_s task_pool;
+
+// Requires: nthreads > 0
+// Return a new pool with nthreads worker threads,
+// bailing with an error message if they cannot be started.
+extern task_pool *task_pool_create(int nthreads);
+
+// Requires: pool was created and not yet destroyed
+// Queue the task fn(arg) to be run by one of pool's workers.
+// This may be called by tasks that are running in pool.
+extern void task_pool_submit(task_pool *pool, task_fn fn, void *arg);
+
+// Requires: pool was created and not yet destroyed
+// Wait until every task submitted to pool (including any submitted
+// by those tasks) has finished.
+extern void task_pool_wait(task_pool *pool);
+
+// Requires: pool was created and not yet destroyed
+// Wait for pool's tasks to finish, then stop its workers and free it.
+extern void task_pool_destroy(task_pool *pool);
+
+// Return the number of processors online (at least 1)
+extern int task_pool_cpu_count();
+
+#endif
@@ -0,0 +1,160 @@
+/* trace.c: Chrome/Perfetto trace-event output */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "trace.h"
+#include "utilities.h"
+
+static FILE *trace_file = NULL;  // protected by lock
+static atomic_bool tracing;      // is trace_file open?
+static bool first_event = true;
+static double start_time;  // in microseconds
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Thread numbers for the tracks: the first thread to trace is 1, etc.
+static atomic_int thread_count;
+static _Thread_local int thread_num = 0;
+
+// Return the time in microseconds on the monotonic clock
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Return the calling thread's number
+static int this_thread()
+{
+    if (thread_num == 0) {
+	thread_num = atomic_fetch_add(&thread_count, 1) + 1;
+    }
+    return thread_num;
+}
+
+// Write s to trace_file as the contents of a JSON string
+static void write_json_chars(const char *s)
+{
+    for (; *s != '\0'; s++) {
+	unsigned char c = (unsigned char) *s;
+	if (c == '"' || c == '\\') {
+	    fprintf(trace_file, "\\%c", c);
+	} else if (c < ' ') {
+	    fprintf(trace_file, "\\u%04x", c);
+	} else {
+	    fputc(c, trace_file);
+	}
+    }
+}
+
+// Requires: lock is held and tracing is on
+// Start writing an event with the given phase letter and name
+// (if not NULL, followed by detail, if that is not NULL),
+// leaving it open for more fields.
+static void start_event(char ph, const char *name, const char *detail)
+{
+    fputs(first_event ? "\n{" : ",\n{", trace_file);
+    first_event = false;
+    if (name != NULL) {
+	fputs("\"name\":\"", trace_file);
+	write_json_chars(name);
+	if (detail != NULL) {
+	    fputc(' ', trace_file);
+	    write_json_chars(detail);
+	}
+	fputs("\",", trace_file);
+    }
+    fprintf(trace_file, "\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+	    ph, now() - start_time, this_thread());
+}
+
+// Requires: fname != NULL
+// Start tracing to the file named fname, bailing with an error message
+// if it cannot be opened.
+void trace_open(const char *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+	bail_with_error("Cannot open %s", fname);
+    }
+    pthread_mutex_lock(&lock);
+    trace_file = f;
+    start_time = now();
+    fputs("{\"traceEvents\":[", trace_file);
+    atomic_store(&tracing, true);
+    pthread_mutex_unlock(&lock);
+}
+
+// Is tracing on?
+bool trace_enabled()
+{
+    return atomic_load_explicit(&tracing, memory_order_relaxed);
+}
+
+// Requires: name != NULL
+// Start a span named name (followed by a space and detail,
+// if detail != NULL) on the calling thread's track.
+void trace_begin(const char *name, const char *detail)
+{
+    if (!trace_enabled()) {
+	return;
+    }
+    pthread_mutex_lock(&lock);
+    if (trace_file != NULL) {
+	start_event('B', name, detail);
+	fputc('}', trace_file);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Requires: a span was started (and not yet ended) on this thread
+// End the calling thread's most recently started span.
+void trace_end()
+{
+    if (!trace_enabled()) {
+	return;
+    }
+    pthread_mutex_lock(&lock);
+    if (trace_file != NULL) {
+	start_event('E', NULL, NULL);
+	fputc('}', trace_file);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Requires: name != NULL
+// Record that the counter named name now has the given value.
+void trace_counter(const char *name, long value)
+{
+    if (!trace_enabled()) {
+	return;
+    }
+    pthread_mutex_lock(&lock);
+    if (trace_file != NULL) {
+	start_event('C', name, NULL);
+	fputs(",\"args\":{\"", trace_file);
+	write_json_chars(name);
+	fprintf(trace_file, "\":%ld}}", value);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Finish the trace file (if tracing is on) and turn tracing off.
+// This is safe to call more than once, e.g., with atexit.
+void trace_close()
+{
+    pthread_mutex_lock(&lock);
+    FILE *f = trace_file;
+    trace_file = NULL;
+    atomic_store(&tracing, false);
+    pthread_mutex_unlock(&lock);
+    if (f != NULL) {
+	fputs("\n]}\n", f);
+	// this may run at exit, so report a problem without exiting again
+	if (fclose(f) == EOF) {
+	    perror("Cannot write the trace file");
+	}
+    }
+}
@@ -0,0 +1,37 @@
+/* trace.h: Chrome/Perfetto trace-event output */
+#ifndef _TRACE_H
+#define _TRACE_H
+#include <stdbool.h>
+
+// When tracing is on (see trace_open), spans and counters are written
+// to a file in the Chrome trace-event JSON format, which can be loaded
+// into chrome://tracing or ui.perfetto.dev.  Each thread's spans are
+// shown on their own track.  When tracing is off, the other functions
+// do nothing.  These functions may be called by several threads at once.
+
+// Requires: fname != NULL
+// Start tracing to the file named fname, bailing with an error message
+// if it cannot be opened.
+extern void trace_open(const char *fname);
+
+// Is tracing on?
+extern bool trace_enabled();
+
+// Requires: name != NULL
+// Start a span named name (followed by a space and detail,
+// if detail != NULL) on the calling thread's track.
+extern void trace_begin(const char *name, const char *detail);
+
+// Requires: a span was started (and not yet ended) on this thread
+// End the calling thread's most recently started span.
+extern void trace_end();
+
+// Requires: name != NULL
+// Record that the counter named name now has the given value.
+extern void trace_counter(const char *name, long value);
+
+// Finish the trace file (if tracing is on) and turn tracing off.
+// This is safe to call more than once, e.g., with atexit.
+extern void trace_close();
+
+#endif
@@ -1,33 +1,621 @@
 /* $Id: unparser.c,v 1.22 2024/10/07 21:38:11 leavens Exp $ */
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "unparser.h"
+#include "out_buffer.h"
+#include "ast_visit.h"
 #include "utilities.h"
+#include "alloc_stats.h"
+#include "proc_cache.h"
+#include "task_pool.h"
+#include "trace.h"
 
 // Amount of spaces to indent per nesting level
 #define SPACES_PER_LEVEL 2
 
 // Print SPACES_PER_LEVEL * level spaces to out
-static void indent(FILE *out, int level)
+static void indent(out_buffer *out, int level)
 {
-    int num = SPACES_PER_LEVEL * level;
-    for (int i = 0; i < num; i++) {
-	fprintf(out, " ");
-    }
+    out_buffer_spaces(out, SPACES_PER_LEVEL * level);
 }
 
 // Print (to out) a semicolon, but only if addSemiToEnd is true,
 // and then print a newline.
-static void newlineAndOptionalSemi(FILE *out, bool addSemiToEnd)
+static void newlineAndOptionalSemi(out_buffer *out, bool addSemiToEnd)
+{
+    out_buffer_puts(out, (addSemiToEnd ? ";\n" : "\n"));
+}
+
+// Print (to out) the operator op with a space on each side
+static void unparseOperator(out_buffer *out, const char *op)
+{
+    out_buffer_puts(out, " ");
+    out_buffer_puts(out, op);
+    out_buffer_puts(out, " ");
+}
+
+// Print (to out) the heading of the procedure named name
+// (without indentation) and a newline
+static void unparseProcHeading(out_buffer *out, const char *name)
+{
+    out_buffer_puts(out, "proc ");
+    out_buffer_puts(out, name);
+    out_buffer_puts(out, "\n");
+}
+
+// The unparser is a set of ast_visit callbacks whose data is an unparse_ctx.
+// Each node's level is the indentation level it is printed at.
+// A block prints up to its "end"; what follows that (a newline,
+// possibly after a semicolon) is printed by the block's parent.
+// Statements are followed by a semicolon unless they are last in their list.
+// The same callbacks unparse flat ASTs (see ast_visit_flat), reading
+// the nodes' names and values with nodeText and nodeValue.
+
+// What the unparser's callbacks print to
+typedef struct unparse_ctx_s {
+    out_buffer *out;
+    const flat_ast *fa;  // the flat AST being unparsed, if not NULL
+    task_pool *pool;  // when not NULL, procedures are unparsed by its tasks
+    bool root_semi;  // add a semicolon after the root, if it is a statement?
+    // the procedure tasks started while printing to out, in order
+    unsigned int count;
+    unsigned int capacity;
+    struct proc_task_s **elems;
+} unparse_ctx;
+
+// A procedure declaration being unparsed by a task, into its own buffer
+typedef struct proc_task_s {
+    const proc_decl_t *pd;
+    int level;
+    digest key;              // its procedure cache key, if that is enabled
+    bool from_cache;         // was its text found in the procedure cache?
+    size_t offset;           // where its text goes in its parent's buffer
+    out_buffer out;
+    unparse_ctx ctx;         // ctx.out is &out
+} proc_task;
+
+// Make ctx print to out, unparsing procedures with tasks in pool
+// unless pool is NULL
+static void unparseCtxInit(unparse_ctx *ctx, out_buffer *out, task_pool *pool)
+{
+    ctx->out = out;
+    ctx->fa = NULL;
+    ctx->pool = pool;
+    ctx->root_semi = false;
+    ctx->count = 0;
+    ctx->capacity = 0;
+    ctx->elems = NULL;
+}
+
+// Return the buffer that the callbacks with the given data print to
+static out_buffer *ctxOut(void *data)
+{
+    return ((unparse_ctx *) data)->out;
+}
+
+static void unparseProcDeclCtx(unparse_ctx *ctx, const proc_decl_t *pd,
+			       int level);
+static void unparseProcDeclLater(unparse_ctx *ctx, const proc_decl_t *pd,
+				 int level);
+
+// Return the name in the node n that the callbacks with the given data
+// are visiting (a declaration, an assign, call or read statement,
+// or an identifier), or its operator (a relational condition
+// or a binary operator expression)
+static const char *nodeText(void *data, const ast_visit_node *n)
+{
+    const flat_ast *fa = ((unparse_ctx *) data)->fa;
+    if (fa != NULL) {
+	return flat_ast_str(fa, ((const flat_node *) n->node)->aux);
+    }
+    switch (n->type_tag) {
+    case const_def_ast:
+	return ((const const_def_t *) n->node)->ident.name;
+    case proc_decl_ast:
+	return ((const proc_decl_t *) n->node)->name;
+    case assign_stmt_ast:
+	return ((const assign_stmt_t *) n->node)->name;
+    case call_stmt_ast:
+	return ((const call_stmt_t *) n->node)->name;
+    case read_stmt_ast:
+	return ((const read_stmt_t *) n->node)->name;
+    case ident_ast:
+	return ((const ident_t *) n->node)->name;
+    case rel_op_condition_ast:
+	return ((const rel_op_condition_t *) n->node)->rel_op.text;
+    case binary_op_expr_ast:
+	return ((const binary_op_expr_t *) n->node)->arith_op.text;
+    default:
+	bail_with_error("Unexpected type_tag (%d) in nodeText!", n->type_tag);
+	return NULL;
+    }
+}
+
+// Return the value of the number node, or of the number in the const-def
+// node, n that the callbacks with the given data are visiting
+static word_type nodeValue(void *data, const ast_visit_node *n)
+{
+    const flat_ast *fa = ((unparse_ctx *) data)->fa;
+    if (fa != NULL) {
+	const flat_node *fn = n->node;
+	if (n->type_tag == const_def_ast) {
+	    fn = flat_ast_node_at(fa, fn->child);
+	}
+	return (word_type) fn->aux;
+    }
+    if (n->type_tag == const_def_ast) {
+	return ((const const_def_t *) n->node)->number.value;
+    }
+    return ((const number_t *) n->node)->value;
+}
+
+// Print to the buffer of the callbacks with the given data
+// whatever separates the child n of parent from the children before it
+static void unparseSeparator(void *data, const ast_visit_node *n,
+			     const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    if (parent == NULL) {
+	return;
+    }
+    switch (parent->type_tag) {
+    case const_decl_ast:
+	if (n->index > 0) {
+	    out_buffer_puts(out, ", ");
+	}
+	break;
+    case var_decl_ast:
+	out_buffer_puts(out, (n->index > 0) ? ", " : " ");
+	break;
+    case if_stmt_ast:
+	if (n->index == 1) {
+	    out_buffer_puts(out, "\n");
+	    indent(out, parent->level);
+	    out_buffer_puts(out, "then\n");
+	} else if (n->index == 2) {
+	    indent(out, parent->level);
+	    out_buffer_puts(out, "else\n");
+	}
+	break;
+    case while_stmt_ast:
+	if (n->index == 1) {
+	    out_buffer_puts(out, "\n");
+	    indent(out, parent->level);
+	    out_buffer_puts(out, "do\n");
+	}
+	break;
+    case db_condition_ast:
+	if (n->index == 1) {
+	    out_buffer_puts(out, " by ");
+	}
+	break;
+    case rel_op_condition_ast:
+	if (n->index == 1) {
+	    unparseOperator(out, nodeText(data, parent));
+	}
+	break;
+    case binary_op_expr_ast:
+	if (n->index == 1) {
+	    unparseOperator(out, nodeText(data, parent));
+	}
+	break;
+    default:
+	break;
+    }
+}
+
+// Print the separator before the node n, which has nothing else before
+// its children, and visit the children
+static bool unparseChildrenPre(void *data, ast_visit_node *n,
+			       const ast_visit_node *parent)
+{
+    unparseSeparator(data, n, parent);
+    return true;
+}
+
+// Print a block's "begin", with its contents indented one more level
+static bool unparseBlockPre(void *data, ast_visit_node *n,
+			    const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, "begin\n");
+    n->child_level = n->level + 1;
+    return true;
+}
+
+// Print a block's "end"
+static void unparseBlockPost(void *data, const ast_visit_node *n,
+			     const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, "end");
+}
+
+// Start a const-decl
+static bool unparseConstDeclPre(void *data, ast_visit_node *n,
+				const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, "const ");
+    return true;
+}
+
+// Print a const-def, after a comma if it is not the first in its list
+// (skipping the number child it has in a flat AST)
+static bool unparseConstDefPre(void *data, ast_visit_node *n,
+			       const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    unparseSeparator(data, n, parent);
+    out_buffer_puts(out, nodeText(data, n));
+    out_buffer_puts(out, " = ");
+    out_buffer_int(out, nodeValue(data, n));
+    return false;
+}
+
+// Start a var-decl
+static bool unparseVarDeclPre(void *data, ast_visit_node *n,
+			      const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, "var");
+    return true;
+}
+
+// End a declaration (or procedure declaration) with a semicolon
+static void unparseDeclPost(void *data, const ast_visit_node *n,
+			    const ast_visit_node *parent)
+{
+    out_buffer_puts(ctxOut(data), ";\n");
+}
+
+// Print a procedure's heading, or all of it if its text is in the cache
+// (flat ASTs are unparsed without tasks or the cache)
+static bool unparseProcDeclPre(void *data, ast_visit_node *n,
+			       const ast_visit_node *parent)
+{
+    unparse_ctx *ctx = (unparse_ctx *) data;
+    if (ctx->fa != NULL || (ctx->pool == NULL && !proc_cache_enabled())) {
+	const char *name = nodeText(data, n);
+	trace_begin("unparse", name);
+	indent(ctx->out, n->level);
+	unparseProcHeading(ctx->out, name);
+	return true;
+    }
+    if (ctx->pool != NULL) {
+	unparseProcDeclLater(ctx, n->node, n->level);
+    } else {
+	unparseProcDeclCtx(ctx, n->node, n->level);
+    }
+    return false;
+}
+
+// End a procedure declaration that unparseProcDeclPre started
+static void unparseProcDeclPost(void *data, const ast_visit_node *n,
+				const ast_visit_node *parent)
+{
+    trace_end();
+    unparseDeclPost(data, n, parent);
+}
+
+// Print the indentation for the statement n and then the text s
+static bool unparseStmtStart(void *data, const ast_visit_node *n,
+			     const char *s)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, s);
+    return true;
+}
+
+// Start an assignment statement
+static bool unparseAssignStmtPre(void *data, ast_visit_node *n,
+				 const ast_visit_node *parent)
+{
+    if (((unparse_ctx *) data)->fa == NULL
+	&& ((const assign_stmt_t *) n->node)->expr == NULL) {
+	bail_with_error("Found null expression in assignment statment!");
+    }
+    unparseStmtStart(data, n, nodeText(data, n));
+    out_buffer_puts(ctxOut(data), " := ");
+    return true;
+}
+
+// Print a call statement
+static bool unparseCallStmtPre(void *data, ast_visit_node *n,
+			       const ast_visit_node *parent)
+{
+    unparseStmtStart(data, n, "call ");
+    out_buffer_puts(ctxOut(data), nodeText(data, n));
+    return true;
+}
+
+// Print a read statement
+static bool unparseReadStmtPre(void *data, ast_visit_node *n,
+			       const ast_visit_node *parent)
+{
+    unparseStmtStart(data, n, "read ");
+    out_buffer_puts(ctxOut(data), nodeText(data, n));
+    return true;
+}
+
+// Start a print statement
+static bool unparsePrintStmtPre(void *data, ast_visit_node *n,
+				const ast_visit_node *parent)
+{
+    return unparseStmtStart(data, n, "print ");
+}
+
+// Start an if statement, with its bodies indented one more level
+static bool unparseIfStmtPre(void *data, ast_visit_node *n,
+			     const ast_visit_node *parent)
+{
+    n->child_level = n->level + 1;
+    return unparseStmtStart(data, n, "if ");
+}
+
+// Start a while statement, with its body indented one more level
+static bool unparseWhileStmtPre(void *data, ast_visit_node *n,
+				const ast_visit_node *parent)
+{
+    n->child_level = n->level + 1;
+    return unparseStmtStart(data, n, "while ");
+}
+
+// End a statement, adding a semicolon if it is not the last in its list
+// (or, for the root, if the context says so)
+static void unparseStmtPost(void *data, const ast_visit_node *n,
+			    const ast_visit_node *parent)
+{
+    bool semi = (parent == NULL) ? ((unparse_ctx *) data)->root_semi : !n->last;
+    newlineAndOptionalSemi(ctxOut(data), semi);
+}
+
+// End a compound (if or while) statement
+static void unparseCompoundStmtPost(void *data, const ast_visit_node *n,
+				    const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    indent(out, n->level);
+    out_buffer_puts(out, "end");
+    unparseStmtPost(data, n, parent);
+}
+
+// Start a divisibility condition
+static bool unparseDbCondPre(void *data, ast_visit_node *n,
+			     const ast_visit_node *parent)
+{
+    out_buffer_puts(ctxOut(data), "divisible ");
+    return true;
+}
+
+// Start a binary operator expression, with parentheses around it
+static bool unparseBinOpExprPre(void *data, ast_visit_node *n,
+				const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    unparseSeparator(data, n, parent);
+    out_buffer_puts(out, "(");
+    return true;
+}
+
+// Start a negated expression, with parentheses around its operand
+static bool unparseNegatedExprPre(void *data, ast_visit_node *n,
+				  const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    unparseSeparator(data, n, parent);
+    out_buffer_puts(out, "-(");
+    return true;
+}
+
+// Close the parentheses around an expression
+static void unparseParenExprPost(void *data, const ast_visit_node *n,
+				 const ast_visit_node *parent)
+{
+    out_buffer_puts(ctxOut(data), ")");
+}
+
+// Print an identifier (use or declaration)
+static bool unparseIdentPre(void *data, ast_visit_node *n,
+			    const ast_visit_node *parent)
 {
-    fprintf(out, "%s\n", (addSemiToEnd ? ";" : ""));
+    out_buffer *out = ctxOut(data);
+    unparseSeparator(data, n, parent);
+    out_buffer_puts(out, nodeText(data, n));
+    return true;
+}
+
+// Print a number in decimal format
+static bool unparseNumberPre(void *data, ast_visit_node *n,
+			     const ast_visit_node *parent)
+{
+    out_buffer *out = ctxOut(data);
+    unparseSeparator(data, n, parent);
+    out_buffer_int(out, nodeValue(data, n));
+    return true;
+}
+
+static const ast_visitor unparse_visitor = {
+    .pre = {
+	[block_ast] = unparseBlockPre,
+	[const_decl_ast] = unparseConstDeclPre,
+	[const_def_ast] = unparseConstDefPre,
+	[var_decl_ast] = unparseVarDeclPre,
+	[proc_decl_ast] = unparseProcDeclPre,
+	[stmts_ast] = unparseChildrenPre,
+	[assign_stmt_ast] = unparseAssignStmtPre,
+	[call_stmt_ast] = unparseCallStmtPre,
+	[if_stmt_ast] = unparseIfStmtPre,
+	[while_stmt_ast] = unparseWhileStmtPre,
+	[read_stmt_ast] = unparseReadStmtPre,
+	[print_stmt_ast] = unparsePrintStmtPre,
+	[db_condition_ast] = unparseDbCondPre,
+	[binary_op_expr_ast] = unparseBinOpExprPre,
+	[negated_expr_ast] = unparseNegatedExprPre,
+	[ident_ast] = unparseIdentPre,
+	[number_ast] = unparseNumberPre,
+    },
+    .post = {
+	[block_ast] = unparseBlockPost,
+	[const_decl_ast] = unparseDeclPost,
+	[var_decl_ast] = unparseDeclPost,
+	[proc_decl_ast] = unparseProcDeclPost,
+	[assign_stmt_ast] = unparseStmtPost,
+	[call_stmt_ast] = unparseStmtPost,
+	[if_stmt_ast] = unparseCompoundStmtPost,
+	[while_stmt_ast] = unparseCompoundStmtPost,
+	[read_stmt_ast] = unparseStmtPost,
+	[print_stmt_ast] = unparseStmtPost,
+	[block_stmt_ast] = unparseStmtPost,
+	[binary_op_expr_ast] = unparseParenExprPost,
+	[negated_expr_ast] = unparseParenExprPost,
+    },
+};
+
+// Unparse the given block, indented by the given level, to ctx
+// adding a semicolon to the end if addSemiToEnd is true.
+static void unparseBlockCtx(unparse_ctx *ctx, const block_t *blk, int level,
+			    bool addSemiToEnd)
+{
+    ast_visit(&unparse_visitor, ctx, block_ast, blk, level);
+    newlineAndOptionalSemi(ctx->out, addSemiToEnd);
+}
+
+// Unparse the given proc-decl given by the AST pd to ctx
+// with the given nesting level followed by a semicolon
+// (reusing the text from the procedure cache, if that is enabled)
+static void unparseProcDeclCtx(unparse_ctx *ctx, const proc_decl_t *pd,
+			       int level)
+{
+    out_buffer *out = ctx->out;
+    digest key = { { 0 } };
+    trace_begin("unparse", pd->name);
+    if (proc_cache_enabled()) {
+	key = proc_cache_text_key(*pd, level);
+	if (proc_cache_read_text(out, key)) {
+	    trace_end();
+	    return;
+	}
+    }
+    size_t start = out->len;
+    indent(out, level);
+    unparseProcHeading(out, pd->name);
+    unparseBlockCtx(ctx, pd->block, level, true);
+    if (proc_cache_enabled()) {
+	proc_cache_store_text(key, out->data + start, out->len - start);
+    }
+    trace_end();
+}
+
+// Unparse the procedure of the proc_task given by arg into its buffer
+// (its nested procedures are started as tasks of their own)
+static void unparseProcTask(void *arg)
+{
+    proc_task *t = (proc_task *) arg;
+    trace_begin("unparse", t->pd->name);
+    if (proc_cache_enabled()) {
+	t->key = proc_cache_text_key(*(t->pd), t->level);
+	t->from_cache = proc_cache_read_text(&t->out, t->key);
+	if (t->from_cache) {
+	    trace_end();
+	    return;
+	}
+    }
+    indent(&t->out, t->level);
+    unparseProcHeading(&t->out, t->pd->name);
+    unparseBlockCtx(&t->ctx, t->pd->block, t->level, true);
+    trace_end();
+}
+
+// Start a task in ctx's pool to unparse pd with the given nesting level,
+// its text to go at the current end of ctx's buffer
+static void unparseProcDeclLater(unparse_ctx *ctx, const proc_decl_t *pd,
+				 int level)
+{
+    proc_task *t = (proc_task *) alloc_malloc_in(alloc_output,
+						 sizeof(proc_task));
+    if (t == NULL) {
+	bail_with_error("Unable to allocate space for a %s!", "proc_task");
+    }
+    t->pd = pd;
+    t->level = level;
+    t->key = (digest) { { 0 } };
+    t->from_cache = false;
+    t->offset = ctx->out->len;
+    out_buffer_init(&t->out);
+    unparseCtxInit(&t->ctx, &t->out, ctx->pool);
+    ctx->elems = ast_list_grow(alloc_output, ctx->elems, ctx->count,
+			       &ctx->capacity, sizeof(proc_task *));
+    ctx->elems[ctx->count++] = t;
+    task_pool_submit(ctx->pool, unparseProcTask, t);
+}
+
+// Requires: all of the tasks started from ctx have finished
+// Append the text in ctx's buffer to dst, with the text of the procedures
+// its tasks unparsed spliced in where they go, and free those tasks
+static void spliceProcTasks(out_buffer *dst, unparse_ctx *ctx)
+{
+    size_t pos = 0;
+    for (unsigned int i = 0; i < ctx->count; i++) {
+	proc_task *t = ctx->elems[i];
+	out_buffer_write(dst, ctx->out->data + pos, t->offset - pos);
+	pos = t->offset;
+	size_t start = dst->len;
+	spliceProcTasks(dst, &t->ctx);
+	if (proc_cache_enabled() && !t->from_cache) {
+	    proc_cache_store_text(t->key, dst->data + start, dst->len - start);
+	}
+	out_buffer_free(&t->out);
+	alloc_free(t);
+    }
+    out_buffer_write(dst, ctx->out->data + pos, ctx->out->len - pos);
+    alloc_free(ctx->elems);
+}
+
+// Write the contents of the buffer b to out and free b
+static void flushAndFree(out_buffer *b, FILE *out)
+{
+    out_buffer_flush(b, out);
+    out_buffer_free(b);
 }
 
 // Unparse the given program AST and then print a period and an newline
 void unparseProgram(FILE *out, block_t prog)
 {
-    unparseBlock(out, prog, 0, false);
-    fprintf(out, ".\n");
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    unparseBlockCtx(&ctx, &prog, 0, false);
+    out_buffer_puts(&b, ".\n");
+    flushAndFree(&b, out);
+}
+
+// Requires: nthreads > 0
+// Unparse the given program AST and then print a period and an newline,
+// unparsing each procedure declaration (at any level) into its own buffer
+// on one of nthreads threads, so the output is the same as unparseProgram's
+void unparseProgramParallel(FILE *out, block_t prog, int nthreads)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, task_pool_create(nthreads));
+    unparseBlockCtx(&ctx, &prog, 0, false);
+    out_buffer_puts(&b, ".\n");
+    task_pool_wait(ctx.pool);
+    task_pool_destroy(ctx.pool);
+    out_buffer all;
+    out_buffer_init(&all);
+    spliceProcTasks(&all, &ctx);
+    out_buffer_free(&b);
+    flushAndFree(&all, out);
 }
 
 // Unparse the given block, indented by the given level, to out
@@ -35,28 +623,98 @@ void unparseProgram(FILE *out, block_t prog)
 extern void unparseBlock(FILE *out, block_t blk, int level,
 			 bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "begin\n");
-    unparseConstDecls(out, blk.const_decls, level+1);
-    unparseVarDecls(out, blk.var_decls, level+1);
-    unparseProcDecls(out, blk.proc_decls, level+1);
-    unparseStmts(out, blk.stmts, level+1);
-    indent(out, level);
-    fprintf(out, "end");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    unparseBlockCtx(&ctx, &blk, level, addSemiToEnd);
+    flushAndFree(&b, out);
+}
+
+// Unparse the given proc-decl given by the AST pd to out
+// with the given nesting level followed by a semicolon
+// (reusing the text from the procedure cache, if that is enabled)
+void unparseProcDecl(FILE *out, proc_decl_t pd, int level)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    unparseProcDeclCtx(&ctx, &pd, level);
+    flushAndFree(&b, out);
+}
+
+// Unparse the "begin" of a block, indented by the given level, to out,
+// followed by the block's constant and variable declarations cds and vds
+void unparseBlockStart(FILE *out, const_decls_t cds, var_decls_t vds,
+		       int level)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    indent(&b, level);
+    out_buffer_puts(&b, "begin\n");
+    for (unsigned int i = 0; i < cds.count; i++) {
+	ast_visit(&unparse_visitor, &ctx, const_decl_ast, &cds.elems[i],
+		  level + 1);
+    }
+    for (unsigned int i = 0; i < vds.count; i++) {
+	ast_visit(&unparse_visitor, &ctx, var_decl_ast, &vds.elems[i],
+		  level + 1);
+    }
+    flushAndFree(&b, out);
+}
+
+// Unparse the heading of the procedure named name to out,
+// indented by the given level (its block follows at the same level)
+void unparseProcStart(FILE *out, const char *name, int level)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    indent(&b, level);
+    unparseProcHeading(&b, name);
+    flushAndFree(&b, out);
+}
+
+// Unparse the statements stmts of a block whose start was printed
+// by unparseBlockStart with the given level, and then its "end", to out,
+// adding a semicolon to the end if addSemiToEnd is true.
+void unparseBlockEnd(FILE *out, stmts_t stmts, int level, bool addSemiToEnd)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    ast_visit(&unparse_visitor, &ctx, stmts_ast, &stmts, level + 1);
+    indent(&b, level);
+    out_buffer_puts(&b, "end");
+    newlineAndOptionalSemi(&b, addSemiToEnd);
+    flushAndFree(&b, out);
+}
+
+// Unparse the node (of the kind given by type_tag, see ast_visit.h)
+// to out, at the given level, adding a semicolon to the end
+// if it is a statement and addSemiToEnd is true
+static void unparseNode(FILE *out, AST_type type_tag, const void *node,
+			int level, bool addSemiToEnd)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    ctx.root_semi = addSemiToEnd;
+    ast_visit(&unparse_visitor, &ctx, type_tag, node, level);
+    flushAndFree(&b, out);
 }
 
 // Unparse the list of const-decls given by the AST cds to out
 // with the given nesting level
-// (note that if cds == NULL, then nothing is printed)
+// (note that if cds is empty, then nothing is printed)
 void unparseConstDecls(FILE *out, const_decls_t cds, int level)
 {
-    // debug_print("unparseConstDecls entry ...\n");
-    assert(cds.type_tag == const_decls_ast);
-    const_decl_t *cd_listp = cds.start;
-    while (cd_listp != NULL) {
-	unparseConstDecl(out, *cd_listp, level);
-	cd_listp = cd_listp->next;
+    ast_list_for_each(const_decl_t, cd, cds) {
+	unparseConstDecl(out, *cd, level);
     }
 }
 
@@ -64,49 +722,36 @@ void unparseConstDecls(FILE *out, const_decls_t cds, int level)
 // indented for the given nesting level
 void unparseConstDecl(FILE *out, const_decl_t cd, int level)
 {
-    // debug_print("unparseConstDecl entry ...\n");
-    indent(out, level);
-    fprintf(out, "const ");
-    unparseConstDefList(out, cd.const_def_list, level);
+    unparseNode(out, const_decl_ast, &cd, level, false);
 }
 
 // Unparse the list of const-defs given by the AST cdl to out
 // with the given nesting level, followed by a semicolon and a newline.
 void unparseConstDefList(FILE *out, const_def_list_t cdl, int level)
 {
-    // debug_print("unparseConstDefList entry ...\n");
-    assert(cdl.type_tag == const_def_list_ast);
-    bool printed_already = false;
-    const_def_t *cdp = cdl.start;
-    while (cdp != NULL) {
-	if (printed_already) {
+    ast_list_for_each(const_def_t, cdp, cdl) {
+	if (cdp != cdl.elems) {
 	    fprintf(out, ", ");
 	}
 	unparseConstDef(out, *cdp, level);
-	printed_already = true;
-	cdp = cdp->next;
     }
     fprintf(out, ";\n");
 }
 
 // Unparse the const-def given by the AST cdf to out
 // with the given nesting level
-extern void unparseConstDef(FILE *out, const_def_t cdf, int level)
+void unparseConstDef(FILE *out, const_def_t cdf, int level)
 {
-    fprintf(out, "%s = %d", cdf.ident.name, cdf.number.value);
+    unparseNode(out, const_def_ast, &cdf, level, false);
 }
 
-// Unparse the list of vart-decls given by the AST vds to out
+// Unparse the list of var-decls given by the AST vds to out
 // with the given nesting level
-// (note that if vds.var_decls == NULL, then nothing is printed)
+// (note that if vds is empty, then nothing is printed)
 void unparseVarDecls(FILE *out, var_decls_t vds, int level)
 {
-    // debug_print("Entering unparseVarDecls ...\n");
-    assert(vds.type_tag == var_decls_ast);
-    var_decl_t *vdp = vds.var_decls;
-    while (vdp != NULL) {
-	unparseVarDecl(out, *vdp, level);
-	vdp = vdp->next;
+    ast_list_for_each(var_decl_t, vd, vds) {
+	unparseVarDecl(out, *vd, level);
     }
 }
 
@@ -114,69 +759,35 @@ void unparseVarDecls(FILE *out, var_decls_t vds, int level)
 // indented for the given nesting level
 void unparseVarDecl(FILE *out, var_decl_t vd, int level)
 {
-    // debug_print("Entering unparseVarDecl ...\n");
-    indent(out, level);
-    fprintf(out, "var");
-    unparseIdentList(out, vd.ident_list);
-    fprintf(out, ";\n");
+    unparseNode(out, var_decl_ast, &vd, level, false);
 }
 
 // Unparse the identifiers in idents to out, with a space before each,
 // and a comma as a separator
 void unparseIdentList(FILE *out, ident_list_t ident_list)
 {
-    // debug_print("Entering unparseIdentList ...\n");
-    ident_t *ip = ident_list.start;
-    bool already_printed =false;
-    while (ip != NULL) {
-	// debug_print("in unparseIdents ip is %x\n", ip);
-	// debug_print("in unparseIdents ip->name is %s\n", ip->name);
-	if (already_printed) {
-	    fprintf(out, ", %s", ip->name);
-	} else {
-	    fprintf(out, " %s", ip->name);
-	}
-	already_printed = true;
-	ip = ip->next;
+    ast_list_for_each(ident_t, ip, ident_list) {
+	fprintf(out, (ip == ident_list.elems) ? " " : ", ");
+	unparseIdent(out, *ip);
     }
 }
 
 // Unparse the list of proc-decls given by the AST pds to out
 // with the given nesting level
-// (note that if pds.proc_decls is NULL, then nothing is printed)
+// (note that if pds is empty, then nothing is printed)
 void unparseProcDecls(FILE *out, proc_decls_t pds, int level)
 {
-    // debug_print("unparseProcDecls entry ...\n");
-    assert(pds.type_tag == proc_decls_ast);
-    proc_decl_t *pdp = pds.proc_decls;
-    while (pdp != NULL) {
-	unparseProcDecl(out, *pdp, level);
-	pdp = pdp ->next;
+    ast_list_for_each(proc_decl_t, pd, pds) {
+	unparseProcDecl(out, *pd, level);
     }
 }
 
-// Unparse the given proc-decl given by the AST pd to out
-// with the given nesting level followed by a semicolon
-void unparseProcDecl(FILE *out, proc_decl_t pd, int level)
-{
-    // debug_print("unparseProcDecl entry ...\n");
-    indent(out, level);
-    fprintf(out, "proc %s\n", pd.name);
-    unparseBlock(out, *(pd.block), level, true);
-}
-
-
 // Unparse the stmts given by stmt to out
 // with indentation level given by level.
 // (The statements always occur before an end, so a semicolon is never added.)
 void unparseStmts(FILE *out, stmts_t stmts, int level)
 {
-    // indent(out, level);
-    // fprintf(out, "%% stmts at level %d\n", level);
-    if (stmts.stmts_kind != empty_stmts_e) {
-	stmt_list_t sl = stmts.stmt_list;
-	unparseStmtList(out, sl, level, false);
-    }
+    unparseNode(out, stmts_ast, &stmts, level, false);
 }
 
 // Unparse the stmts given by stmt to out
@@ -185,12 +796,9 @@ void unparseStmts(FILE *out, stmts_t stmts, int level)
 void unparseStmtList(FILE *out, stmt_list_t stmt_list, int level,
 		     bool addSemiToEnd)
 {
-    // indent(out, level);
-    // fprintf(out, "%% stmtList at level %d\n", level);    
-    stmt_t *s = stmt_list.start;
-    while (s != NULL) {
-	unparseStmt(out, *s, level, addSemiToEnd || (s->next != NULL));
-	s = s->next;
+    ast_list_for_each(stmt_t, s, stmt_list) {
+	unparseStmt(out, *s, level,
+		    addSemiToEnd || !ast_list_is_last(stmt_list, s));
     }
 }
 
@@ -199,62 +807,27 @@ void unparseStmtList(FILE *out, stmt_list_t stmt_list, int level,
 // adding a semicolon to the end if addSemiToENd is true.
 void unparseStmt(FILE *out, stmt_t stmt, int level, bool addSemiToEnd)
 {
-    // debug_print("In unparseStmt stmt.type_tag is %d\n", stmt.type_tag);
-    assert(stmt.type_tag == stmt_ast);
-    switch (stmt.stmt_kind) {
-    case assign_stmt:
-	assert(stmt.data.assign_stmt.type_tag == assign_stmt_ast);
-	unparseAssignStmt(out, stmt.data.assign_stmt, level, addSemiToEnd);
-	break;
-    case call_stmt:
-	unparseCallStmt(out, stmt.data.call_stmt, level, addSemiToEnd);
-	break;
-    case if_stmt:
-	unparseIfStmt(out, stmt.data.if_stmt, level, addSemiToEnd);
-	break;
-    case while_stmt:
-	unparseWhileStmt(out, stmt.data.while_stmt, level, addSemiToEnd);
-	break;
-    case read_stmt:
-	unparseReadStmt(out, stmt.data.read_stmt, level, addSemiToEnd);
-	break;
-    case print_stmt:
-	unparsePrintStmt(out, stmt.data.print_stmt, level, addSemiToEnd);
-	break;
-    case block_stmt:
-	unparseBlockStmt(out, stmt.data.block_stmt, level, addSemiToEnd);
-	break;
-    default:
-	bail_with_error("Unknown stmt_kind (%d) in unparseStmt!",
-			stmt.stmt_kind);
-	break;
-    }
+    const void *node;
+    AST_type tag = ast_visit_stmt_node(&stmt, &node);
+    unparseNode(out, tag, node, level, addSemiToEnd);
 }
 
 // Unparse the assignment statment given by stmt to out
 // with indentation level given by level,
 // and add a semicolon at the end if addSemiToEnd is true.
 void unparseAssignStmt(FILE *out, assign_stmt_t stmt, int level,
-			      bool addSemiToEnd)
+		       bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "%s := ", stmt.name);
-    if (stmt.expr == NULL) {
-	bail_with_error("Found null expression in assignment statment!");
-    }
-    unparseExpr(out, *(stmt.expr));
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, assign_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the call statment given by stmt to out
 // with indentation level given by level,
 // and add a semicolon at the end if addSemiToEnd is true.
 void unparseCallStmt(FILE *out, call_stmt_t stmt, int level,
-			    bool addSemiToEnd)
+		     bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "call %s", stmt.name);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, call_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the sequential statment given by stmt to out
@@ -263,7 +836,7 @@ void unparseCallStmt(FILE *out, call_stmt_t stmt, int level,
 void unparseBlockStmt(FILE *out, block_stmt_t stmt, int level,
 		      bool addSemiToEnd)
 {
-    unparseBlock(out, *(stmt.block), level, addSemiToEnd);
+    unparseNode(out, block_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the if-statment given by stmt to out
@@ -271,21 +844,7 @@ void unparseBlockStmt(FILE *out, block_stmt_t stmt, int level,
 // and add a semicolon at the end if addSemiToEnd is true.
 void unparseIfStmt(FILE *out, if_stmt_t stmt, int level, bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "if ");
-    unparseCondition(out, stmt.condition);
-    fprintf(out, "\n");
-    indent(out, level);
-    fprintf(out, "then\n");
-    unparseStmts(out, *(stmt.then_stmts), level+1);
-    if (stmt.else_stmts != NULL) {
-	indent(out, level);
-	fprintf(out, "else\n");
-	unparseStmts(out, *(stmt.else_stmts), level+1);
-    }
-    indent(out, level);
-    fprintf(out, "end");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, if_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the while-statment given by stmt to out
@@ -294,25 +853,14 @@ void unparseIfStmt(FILE *out, if_stmt_t stmt, int level, bool addSemiToEnd)
 void unparseWhileStmt(FILE *out, while_stmt_t stmt, int level,
 		      bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "while ");
-    unparseCondition(out, stmt.condition);
-    fprintf(out, "\n");
-    indent(out, level);
-    fprintf(out, "do\n");
-    unparseStmts(out, *(stmt.body), level+1);
-    indent(out, level);
-    fprintf(out, "end");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, while_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the read statment given by stmt to out
 // and add a semicolon at the end if addSemiToEnd is true.
 void unparseReadStmt(FILE *out, read_stmt_t stmt, int level, bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "read %s", stmt.name);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, read_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the write statment given by stmt to out
@@ -320,46 +868,27 @@ void unparseReadStmt(FILE *out, read_stmt_t stmt, int level, bool addSemiToEnd)
 void unparsePrintStmt(FILE *out, print_stmt_t stmt, int level,
 		      bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "print ");
-    unparseExpr(out, stmt.expr);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparseNode(out, print_stmt_ast, &stmt, level, addSemiToEnd);
 }
 
 // Unparse the condition given by cond to out
 void unparseCondition(FILE *out, condition_t cond)
 {
-    switch (cond.cond_kind) {
-    case ck_db:
-	unparseDbCond(out, cond.data.db_cond);
-	break;
-    case ck_rel:
-	unparseRelOpCond(out, cond.data.rel_op_cond);
-	break;
-    default:
-	bail_with_error("Unexpected condition_kind_e (%d) in unparseCondition!",
-			cond.cond_kind);
-	break;
-    }
+    const void *node;
+    AST_type tag = ast_visit_condition_node(&cond, &node);
+    unparseNode(out, tag, node, 0, false);
 }
 
 // Unparse the odd condition given by cond to out
 void unparseDbCond(FILE *out, db_condition_t dbcond)
 {
-    fprintf(out, "divisible ");
-    unparseExpr(out, dbcond.dividend);
-    fprintf(out, " by ");
-    unparseExpr(out, dbcond.divisor);
+    unparseNode(out, db_condition_ast, &dbcond, 0, false);
 }
 
 // Unparse the binary relation condition given by cond to out
 void unparseRelOpCond(FILE *out, rel_op_condition_t cond)
 {
-    unparseExpr(out, cond.expr1);
-    fprintf(out, " ");
-    unparseToken(out, cond.rel_op);
-    fprintf(out, " ");
-    unparseExpr(out, cond.expr2);
+    unparseNode(out, rel_op_condition_ast, &cond, 0, false);
 }
 
 // Unparse the given token, t, to out
@@ -372,56 +901,54 @@ void unparseToken(FILE *out, token_t t)
 // adding parentheses to indicate the nesting relationships
 void unparseExpr(FILE *out, expr_t exp)
 {
-    switch (exp.expr_kind) {
-    case expr_bin:
-	unparseBinOpExpr(out, exp.data.binary);
-	break;
-    case expr_negated:
-	unparseNegatedExpr(out, exp.data.negated);
-	break;
-    case expr_ident:
-	unparseIdent(out, exp.data.ident);
-	break;
-    case expr_number:
-	unparseNumber(out, exp.data.number);
-	break;
-    default:
-	bail_with_error("Unexpected expr_kind_e (%d) in unparseExpr!",
-			exp.expr_kind);
-	break;
-    }
+    const void *node;
+    AST_type tag = ast_visit_expr_node(&exp, &node);
+    unparseNode(out, tag, node, 0, false);
 }
 
 // Unparse the expression given by the AST exp to out
 // adding parentheses (whether needed or not)
 void unparseBinOpExpr(FILE *out, binary_op_expr_t exp)
 {
-    fprintf(out, "(");
-    unparseExpr(out, *(exp.expr1));
-    fprintf(out, " ");
-    unparseToken(out, exp.arith_op);
-    fprintf(out, " ");
-    unparseExpr(out, *(exp.expr2));
-    fprintf(out, ")");
+    unparseNode(out, binary_op_expr_ast, &exp, 0, false);
+}
+
+// Unparse the given bin_arith_opo to out
+void unparseArithOp(FILE *out, token_t arith_op)
+{
+    unparseToken(out, arith_op);
 }
 
 // Unparse the expression given by the AST exp to out
 // adding parentheses (whether needed or not)
 void unparseNegatedExpr(FILE *out, negated_expr_t exp)
 {
-    fprintf(out, "-(");
-    unparseExpr(out, *(exp.expr));
-    fprintf(out, ")");
+    unparseNode(out, negated_expr_ast, &exp, 0, false);
 }
 
 // Unparse the given identifier reference (i.e., identifier use), id, to out
 void unparseIdent(FILE *out, ident_t id)
 {
-    fprintf(out, "%s", id.name);
+    unparseNode(out, ident_ast, &id, 0, false);
 }
 
 // Unparse the given number AST, num, to out in decimal format
 void unparseNumber(FILE *out, number_t num)
 {
-    fprintf(out, "%d", num.value);
+    unparseNode(out, number_ast, &num, 0, false);
+}
+
+// Unparse the program in the flat AST fa to out, then print a period
+// and a newline (the output is the same as unparseProgram's would be
+// for the AST that fa was built from)
+void unparseFlat(FILE *out, const flat_ast *fa)
+{
+    out_buffer b;
+    out_buffer_init(&b);
+    unparse_ctx ctx;
+    unparseCtxInit(&ctx, &b, NULL);
+    ctx.fa = fa;
+    ast_visit_flat(&unparse_visitor, &ctx, fa, fa->root, 0);
+    out_buffer_puts(&b, "\n.\n");
+    flushAndFree(&b, out);
 }
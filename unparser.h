@@ -3,10 +3,17 @@
 #define _UNPARSER_H
 #include <stdio.h>
 #include "ast.h"
+#include "flat_ast.h"
 
 // Unparse the given program AST and then print a period and an newline
 extern void unparseProgram(FILE *out, block_t prog);
 
+// Requires: nthreads > 0
+// Unparse the given program AST and then print a period and an newline,
+// unparsing each procedure declaration (at any level) into its own buffer
+// on one of nthreads threads, so the output is the same as unparseProgram's
+extern void unparseProgramParallel(FILE *out, block_t prog, int nthreads);
+
 // Unparse the given block, indented by the given level, to out
 // adding a semicolon to the end if addSemiToEnd is true.
 extern void unparseBlock(FILE *out, block_t blk, int indentLevel,
@@ -51,6 +58,25 @@ extern void unparseProcDecls(FILE *out, proc_decls_t pds, int level);
 // with the given nesting level
 extern void unparseProcDecl(FILE *out, proc_decl_t pd, int level);
 
+// The following print a block a part at a time, so that the parser can
+// print each procedure as soon as it is parsed (see ast_stream.h);
+// together they print the same text as unparseBlock.
+
+// Unparse the "begin" of a block, indented by the given level, to out,
+// followed by the block's constant and variable declarations cds and vds
+extern void unparseBlockStart(FILE *out, const_decls_t cds, var_decls_t vds,
+			      int level);
+
+// Unparse the heading of the procedure named name to out,
+// indented by the given level (its block follows at the same level)
+extern void unparseProcStart(FILE *out, const char *name, int level);
+
+// Unparse the statements stmts of a block whose start was printed
+// by unparseBlockStart with the given level, and then its "end", to out,
+// adding a semicolon to the end if addSemiToEnd is true.
+extern void unparseBlockEnd(FILE *out, stmts_t stmts, int level,
+			    bool addSemiToEnd);
+
 // Unparse the statement given by the AST stmt to out,
 // indented for the given level,
 // adding a semicolon to the end if addSemiToEnd is true.
@@ -135,4 +161,9 @@ extern void unparseIdent(FILE *out, ident_t id);
 // Unparse the given number to out in decimal format
 extern void unparseNumber(FILE *out, number_t num);
 
+// Unparse the program in the flat AST fa to out, then print a period
+// and a newline (the output is the same as unparseProgram's would be
+// for the AST that fa was built from)
+extern void unparseFlat(FILE *out, const flat_ast *fa);
+
 #endif
@@ -111,3 +111,22 @@ void newline(FILE *out)
     fflush(out);
 }
 
+// Return the 64-bit FNV-1a hash of the len bytes starting at data,
+// continuing from the hash value h (so pass HASH_SEED to start a new hash).
+unsigned long long hash_bytes(unsigned long long h,
+			      const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+	h ^= p[i];
+	h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Return the hash of the (non-NULL) identifier name, as used by
+// the symbol table (the lexer computes it once for each identifier token).
+unsigned long long hash_name(const char *name)
+{
+    return hash_bytes(HASH_SEED, name, strlen(name));
+}
@@ -38,4 +38,16 @@ extern void formatted_yyerror(const char *filename, const char *fmt, ...);
 // print a newline on out and flush out
 extern void newline(FILE *out);
 
+// starting value for hash_bytes
+#define HASH_SEED 14695981039346656037ULL
+
+// Return the 64-bit FNV-1a hash of the len bytes starting at data,
+// continuing from the hash value h (so pass HASH_SEED to start a new hash).
+extern unsigned long long hash_bytes(unsigned long long h,
+				     const void *data, size_t len);
+
+// Return the hash of the (non-NULL) identifier name, as used by
+// the symbol table (the lexer computes it once for each identifier token).
+extern unsigned long long hash_name(const char *name);
+
 #endif